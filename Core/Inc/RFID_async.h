@@ -0,0 +1,62 @@
+#ifndef __RFID_ASYNC_H
+#define __RFID_ASYNC_H
+
+#include "rc522.h"
+
+typedef enum {
+    RFID_STEP_REQA,         // REQA, ответ ATQA
+    RFID_STEP_WUPA,         // WUPA: как REQA, но будит и карты в HALT
+    RFID_STEP_ANTICOLL,     // битовая антиколлизия текущего уровня каскада
+    RFID_STEP_SELECT,       // SELECT уровня, сразу после ANTICOLL; UID -> req->card, req->uid
+    RFID_STEP_AUTH,         // аутентификация Key A блока block ключом key
+    RFID_STEP_READ,         // чтение блока block в data (16 байт)
+    RFID_STEP_WRITE,        // запись 16 байт data в блок block
+    RFID_STEP_CHECK         // проверка UID из SELECT функцией req->check, без обмена с картой
+} rfid_step_op_t;
+
+#define RFID_CHECK_DONE     0x80                // ответ req->check: остальные шаги не нужны, цепочка успешна
+
+typedef struct
+{
+    rfid_step_op_t op;
+    uint8_t block;
+    uint8_t *key;
+    uint8_t *data;
+} rfid_step_t;
+
+typedef struct rfid_request_s rfid_request_t;
+
+/*!
+ * \brief Цепочка обменов с картой, выполняемая по шагам из RFID_poll
+ * \details Заполняются steps, count, halt, callback и ctx, остальное - результат и
+ * внутреннее состояние. Структура должна жить до вызова callback.
+ */
+struct rfid_request_s
+{
+    const rfid_step_t *steps;
+    uint8_t count;
+    uint8_t halt;                               // по окончании перевести карту в HALT
+    void (*callback)(rfid_request_t *req);      // вызывается из RFID_poll
+    void *ctx;
+    uint8_t (*check)(const rfid_uid_t *card);   // для RFID_STEP_CHECK: MI_OK - продолжать цепочку, RFID_CHECK_DONE
+
+    uint8_t status;                             // MI_OK / MI_ERR / MI_NOTAGERR
+    uint8_t failed_step;                        // номер шага с ошибкой
+    uint32_t start;                             // MFRC522_Cycles при RFID_submit
+    uint8_t uid[UID_SIZE];                      // 4 байта UID для аутентификации и BCC
+    rfid_uid_t card;                            // полный UID после SELECT
+
+    uint8_t sel[9];                             // кадр ANTICOLL/SELECT текущего уровня
+    uint8_t level;                              // уровень каскада 0..2
+    uint8_t known;                              // известные биты UID уровня
+
+    uint8_t step;
+    uint8_t phase;
+    uint8_t frame[MAX_FRAME_LEN];
+};
+
+uint8_t RFID_submit(rfid_request_t *req);
+uint8_t RFID_busy(void);
+void RFID_poll(void);
+
+#endif /* __RFID_ASYNC_H */
@@ -0,0 +1,26 @@
+#ifndef __RFID_CACHE_H
+#define __RFID_CACHE_H
+
+#include "rc522.h"
+
+#define RFID_CACHE_SIZE             16          // карт в кэше, при переполнении вытесняется давно не предъявленная
+#define RFID_CACHE_TTL_MS           60000       // срок действия результата проверки
+
+/*!
+ * \brief Счетчики кэша
+ */
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;                            // включая просроченные
+    uint32_t expired;                           // запись найдена, но срок вышел
+    uint32_t evictions;                         // вытеснено действующих записей
+} rfid_cache_stats_t;
+
+void RFID_cache_clear(void);
+uint8_t RFID_cache_get(const rfid_uid_t *card, uint8_t *result);
+void RFID_cache_put(const rfid_uid_t *card, uint8_t result);
+void RFID_cache_invalidate(const rfid_uid_t *card);
+const rfid_cache_stats_t *RFID_cache_stats(void);
+
+#endif /* __RFID_CACHE_H */
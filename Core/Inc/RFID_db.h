@@ -0,0 +1,55 @@
+#ifndef __RFID_DB_H
+#define __RFID_DB_H
+
+#include "rc522.h"
+
+#define RFID_DB_ADDR                0x08020000  // сектор 5 flash (128 КБ), вне области программы
+#define RFID_DB_SIZE                0x20000
+#define RFID_DB_MAGIC               0x31424443  // 'CDB1'
+#define RFID_DB_UID_LEN             7           // UID 4 и 7 байт целиком, у UID 10 байт - первые 7
+#define RFID_DB_INTERP_PROBES       8           // шагов интерполяции до перехода на деление пополам
+
+// Атрибуты карты
+#define RFID_DB_ATTR_READERS        0x0F        // считыватели, на которых карта действует: бит - номер считывателя
+#define RFID_DB_ATTR_BLOCKED        0x80        // карта изъята: отказ
+
+/*!
+ * \brief Заголовок базы в начале сектора, пишется последним: без него база пуста
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t count;                             // записей
+    uint32_t crc;                               // CRC32 записей
+    uint32_t generation;                        // номер выпуска базы
+} rfid_db_header_t;
+
+/*!
+ * \brief Карта в базе. Записи отсортированы по hash: распределение ключей равномерное
+ * при любых UID, и интерполяционный поиск находит запись за 2-3 чтения flash.
+ */
+typedef struct
+{
+    uint32_t hash;                              // CRC32 длины UID и всех байт UID
+    uint8_t uid[RFID_DB_UID_LEN];               // дополнен нулями до RFID_DB_UID_LEN
+    uint8_t attr;                               // RFID_DB_ATTR_*
+} rfid_db_rec_t;
+
+#define RFID_DB_MAX                 ((RFID_DB_SIZE - sizeof(rfid_db_header_t)) / sizeof(rfid_db_rec_t))
+
+/*
+ * Образ базы (Tools/carddb): rfid_db_header_t, затем count записей rfid_db_rec_t.
+ * Загружается в RFID_DB_ADDR программатором или по частям RFID_db_write_*.
+ */
+
+void RFID_db_init(void);
+uint32_t RFID_db_count(void);
+uint32_t RFID_db_generation(void);
+uint32_t RFID_db_hash(const rfid_uid_t *card);
+uint8_t RFID_db_lookup(const rfid_uid_t *card, uint8_t *attr);
+
+uint8_t RFID_db_write_begin(void);
+uint8_t RFID_db_write(uint32_t offset, const void *data, uint32_t len);
+uint8_t RFID_db_write_end(void);
+
+#endif /* __RFID_DB_H */
@@ -0,0 +1,61 @@
+#ifndef __RFID_DETECT_H
+#define __RFID_DETECT_H
+
+#include "RFID_async.h"
+
+#define RFID_DET_INTERVAL_MS        40          // Период зонда без карты: не больше добавки к задержке открытия
+#define RFID_DET_BURST_MS           5           // Поле перед REQA: время запуска карты (ISO14443-3, 5 мс)
+#define RFID_DET_GAIN               4           // RxGain зонда: 33 дБ, как в полном режиме
+#define RFID_DET_HOLD_MS            300         // Полный режим после последнего ответа карты
+
+/*!
+ * \brief Политика обнаружения карты в режиме пониженного потребления
+ * \details Без карты RC522 в PowerDown, поле выключено. Раз в interval_ms поле включается
+ * на burst_ms и уходит один REQA. Ответ (или коллизия) - переход в полный режим,
+ * где работают цепочки замка и инвентаризации. Из полного режима - обратно, когда
+ * карты не отвечают hold_ms и WUPA-проверка присутствия не нашла карт в HALT.
+ */
+typedef struct
+{
+    uint16_t interval_ms;                       // период зонда
+    uint8_t burst_ms;                           // включение поля до REQA
+    uint8_t gain;                               // RxGain (RFCfgReg) на время зонда 0..7, больше - чувствительнее
+    uint16_t hold_ms;                           // удержание полного режима
+} rfid_detect_policy_t;
+
+typedef struct
+{
+    uint32_t probes;                            // зондов REQA
+    uint32_t wakes;                             // переходов в полный режим по зонду
+    uint32_t sleeps;                            // переходов в режим пониженного потребления
+} rfid_detect_stats_t;
+
+/*!
+ * \brief Обнаружение на одном считывателе, у каждого свое (RFID_reader_t)
+ */
+typedef struct
+{
+    rfid_request_t req;                         // зонд REQA или проверка WUPA
+    rfid_detect_policy_t policy;
+    rfid_detect_stats_t stats;
+    uint8_t enabled;
+    uint8_t state;
+    uint8_t wake;                               // RFID_detect_wake во время зонда или проверки
+    volatile uint8_t ready;
+    uint32_t since;                             // HAL_GetTick входа в состояние или последнего ответа карты
+    uint32_t field_on;                          // HAL_GetTick включения поля: отсчет запуска карты
+    uint32_t answers;                           // MFRC522_Answers на момент since
+} rfid_detect_t;
+
+void RFID_detect_init(void);
+void RFID_detect_enable(uint8_t enable);
+void RFID_detect_set_policy(const rfid_detect_policy_t *policy);
+const rfid_detect_policy_t *RFID_detect_policy(void);
+const rfid_detect_stats_t *RFID_detect_stats(void);
+void RFID_detect_task(void);
+uint8_t RFID_detect_active(void);
+uint8_t RFID_detect_wake(void);
+uint8_t RFID_detect_powered(void);
+void RFID_detect_reinit(void);
+
+#endif /* __RFID_DETECT_H */
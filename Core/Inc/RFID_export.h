@@ -0,0 +1,52 @@
+#ifndef __RFID_EXPORT_H
+#define __RFID_EXPORT_H
+
+#include "RFID_log.h"
+
+#define RFID_EXPORT_CHUNK           2048        // байт в одной передаче tl_send, целое число записей
+#define RFID_EXPORT_PART            (RFID_EXPORT_CHUNK - 2) // данных в части RFID_export_send
+#define RFID_EXPORT_REPEAT_MS       200         // повтор пакета tl без ответа
+#define RFID_EXPORT_RESET_MS        2000        // сброс приема tl без пакетов
+#define RFID_EXPORT_RECENT          8           // недавних UID, на которые запись ссылается одним байтом
+#define RFID_EXPORT_VERSION         1
+
+#define RFID_EXPORT_CMD_LOG         0x4C        // 'L' и seq (LE32): выгрузка журнала с записи seq
+#define RFID_EXPORT_MAGIC           0x4C
+
+/*
+ * Выгрузка журнала RFID_log по UART2 протоколом tl_protocol.
+ *
+ * Запрос (прием tl): 'L', seq (LE32) - записи с номером не меньше seq. Устройство отвечает подряд
+ * передачами tl_send по RFID_EXPORT_CHUNK байт без новых запросов, пока записи не кончатся.
+ * Прерванная выгрузка продолжается запросом с seq последней полученной записи + 1.
+ *
+ * Передача (все числа LE):
+ *   magic    u8    RFID_EXPORT_MAGIC
+ *   version  u8    RFID_EXPORT_VERSION
+ *   flags    u8    b0 - последняя передача выгрузки
+ *   reserved u8
+ *   count    u16   записей
+ *   boot     u16   boot первой записи
+ *   seq      u32   seq первой записи
+ *   time     u32   time первой записи
+ *   count записей, каждая - разность с предыдущей (первая - с полями заголовка, seq - 1):
+ *   head     u8    b0 - разрыв seq, b1 - новый boot, b3..b2 - decision, b5..b4 - source, b7..b6 - reader
+ *   [gap]    var   b0: seq = seq предыдущей + 1 + gap
+ *   [boot]   var   b1: boot, а time ниже - абсолютное
+ *   time     var   мс от предыдущей записи (b1: HAL_GetTick)
+ *   latency  var   мкс
+ *   uid      u8    0x80 | i - i-й недавний UID (список с переносом в начало), иначе длина UID и его байты
+ * var - целое без знака по 7 бит, старший бит - продолжение (LEB128). Сложение по модулю 2^32.
+ *
+ * Тем же каналом другие службы передают свои данные частями (RFID_export_send):
+ *   magic    u8    тип: RFID_IMAGE_MAGIC, RFID_TRACE_MAGIC
+ *   flags    u8    b0 - последняя часть
+ *   данные части, приемник склеивает части одного типа до последней
+ */
+
+void RFID_export_init(int socket);
+void RFID_export_task(void);
+uint8_t RFID_export_send(uint8_t magic, uint8_t last, const uint8_t *data, uint16_t len);
+uint8_t RFID_export_sent(void);
+
+#endif /* __RFID_EXPORT_H */
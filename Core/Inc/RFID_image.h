@@ -0,0 +1,46 @@
+#ifndef __RFID_IMAGE_H
+#define __RFID_IMAGE_H
+
+#include "rc522.h"
+
+#define RFID_IMAGE_KEYS             8           // Ключей в таблице
+#define RFID_IMAGE_MAX_SECTORS      40          // MIFARE Classic 4K
+#define RFID_IMAGE_KEY_UNKNOWN      0xFF        // Ключ сектора не известен - перебор таблицы
+#define RFID_IMAGE_MAGIC            0x49        // 'I': тип частей образа в канале RFID_export
+// Часть образа: сектор 4K (16 блоков), у последнего - битовая карта и CRC32
+#define RFID_IMAGE_PART             (16 * MAX_LEN + (RFID_IMAGE_MAX_SECTORS + 7) / 8 + 4)
+
+#define RFID_IMAGE_WRITE_TRAILERS   0x01        // Записывать трейлеры секторов (ключи и права доступа)
+
+/*!
+ * \brief Таблица ключей Key A для чтения и записи образа
+ * \details sector_key запоминает подошедший ключ, следующие карты партии
+ * аутентифицируются с первой попытки.
+ */
+typedef struct
+{
+    uint8_t keys[RFID_IMAGE_KEYS][KEY_LEN];
+    uint8_t count;
+    uint8_t sector_key[RFID_IMAGE_MAX_SECTORS];
+} rfid_key_table_t;
+
+/*
+ * Формат образа, передаваемого RFID_image_read:
+ *   'M' 'F' <число секторов> <длина UID> <UID>
+ *   блоки 0..N-1 по 16 байт в порядке адресов (нечитаемый сектор - нули)
+ *   битовая карта прочитанных секторов, 5 байт
+ *   CRC32 всего предыдущего, младшим байтом вперед
+ * Образ уходит частями RFID_export_send типа RFID_IMAGE_MAGIC: заголовок, затем по сектору,
+ * последняя часть (флаг в заголовке части) - с битовой картой и CRC32. Образ без последней
+ * части - чтение прервано (RFID_image_result).
+ */
+
+void RFID_image_init(void);
+void RFID_key_table_init(rfid_key_table_t *table);
+uint8_t RFID_image_sectors(uint8_t sak);
+uint8_t RFID_image_read(rfid_key_table_t *table);
+uint8_t RFID_image_result(void);
+void RFID_image_task(void);
+uint8_t RFID_image_write(const uint8_t *image, uint8_t sectors, rfid_key_table_t *table, uint8_t flags);
+
+#endif /* __RFID_IMAGE_H */
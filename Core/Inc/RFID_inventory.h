@@ -0,0 +1,27 @@
+#ifndef __RFID_INVENTORY_H
+#define __RFID_INVENTORY_H
+
+#include "rc522.h"
+
+#define RFID_INV_MAX_CARDS          32          // Карт за один проход, на следующей новой проход завершается
+#define RFID_INV_SLOTS              64          // Ячеек хеш-таблицы (степень 2, не меньше 2 * RFID_INV_MAX_CARDS)
+#define RFID_INV_MAX_ERRORS         8           // Ошибок обмена подряд до завершения прохода
+
+/*!
+ * \brief Приемник результатов инвентаризации, вызывается из RFID_inventory_task
+ * \details Каждый UID передается один раз. uid == NULL - проход завершен.
+ * Передается не больше RFID_INV_MAX_CARDS карт: следующая новая карта завершает проход
+ * и выставляет RFID_inventory_overflow. Приемник не должен блокировать главный цикл.
+ */
+typedef void (*rfid_inv_sink_t)(const rfid_uid_t *uid, void *ctx);
+
+uint8_t RFID_inventory_start(rfid_inv_sink_t sink, void *ctx);
+void RFID_inventory_task(void);
+uint8_t RFID_inventory_busy(void);
+uint8_t RFID_inventory_count(void);
+const rfid_uid_t *RFID_inventory_card(uint8_t index);
+uint8_t RFID_inventory_overflow(void);
+
+void RFID_inventory_uart_sink(const rfid_uid_t *uid, void *ctx);
+
+#endif /* __RFID_INVENTORY_H */
@@ -0,0 +1,102 @@
+#ifndef __RFID_LOG_H
+#define __RFID_LOG_H
+
+#include "rc522.h"
+
+#define RFID_LOG_ADDR               0x08040000  // сектора 6 и 7 flash по 128 КБ, по очереди
+#define RFID_LOG_SECTOR_SIZE        0x20000
+#define RFID_LOG_SECTORS            2
+#define RFID_LOG_MAGIC              0x31474F4C  // 'LOG1'
+#define RFID_LOG_RAM                32          // записей в RAM до записи в flash
+#define RFID_LOG_BATCH              8           // записей в пакете: 256 байт одной записью flash
+#define RFID_LOG_FLUSH_MS           2000        // неполный пакет пишется, если событий не было столько
+#define RFID_LOG_IDLE_MS            10000       // следующий сектор стирается (1-2 с) только после паузы без карт
+
+/*!
+ * \brief Решение по карте
+ */
+typedef enum
+{
+    RFID_LOG_DENIED,
+    RFID_LOG_OPENED,
+    RFID_LOG_CLOSED
+} rfid_log_decision_t;
+
+/*!
+ * \brief Чем принято решение
+ */
+typedef enum
+{
+    RFID_LOG_SRC_PASSWORD,                      // пароль в блоке 1 или ошибка его чтения
+    RFID_LOG_SRC_CACHE,                         // RFID_cache
+    RFID_LOG_SRC_DB,                            // RFID_db
+    RFID_LOG_SRC_BLOOM                          // отказ фильтром Блума - только в старых журналах
+} rfid_log_source_t;
+
+/*!
+ * \brief Событие журнала, 32 байта - слот в секторе
+ * \details Часов нет: время - мс от запуска с номером boot. CRC32 по всем полям до crc:
+ * запись, прерванная отключением питания, при чтении пропускается.
+ */
+typedef struct
+{
+    uint32_t seq;                               // сквозной номер записи
+    uint32_t time;                              // HAL_GetTick события
+    uint8_t uid[UID_MAX_LEN];
+    uint8_t uid_size;
+    uint8_t decision;                           // rfid_log_decision_t
+    uint8_t reader;                             // номер считывателя
+    uint8_t source;                             // rfid_log_source_t
+    uint16_t boot;                              // номер запуска
+    uint32_t latency_us;                        // от начала цепочки появления карты до решения
+    uint32_t crc;
+} rfid_log_rec_t;
+
+/*!
+ * \brief Заголовок сектора в слоте 0, пишется сразу после стирания
+ * \details Сектор с наибольшим gen - текущий, по gen сектора читаются от старых к новым.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t gen;                               // номер стирания, растет на 1
+    uint8_t reserved[20];
+    uint32_t crc;
+} rfid_log_sector_t;
+
+#define RFID_LOG_SLOTS              (RFID_LOG_SECTOR_SIZE / sizeof(rfid_log_rec_t))
+
+/*!
+ * \brief Состояние журнала
+ */
+typedef struct
+{
+    uint32_t seq;                               // номер следующей записи
+    uint16_t boot;
+    uint8_t pending;                            // записей в RAM
+    uint32_t written;                           // записано в flash с запуска
+    uint32_t dropped;                           // потеряно при переполнении RAM
+    uint32_t torn;                              // пропущено при чтении: неверная CRC
+    uint32_t errors;                            // ошибок записи flash
+    uint32_t erases;                            // стираний с запуска
+} rfid_log_stats_t;
+
+/*!
+ * \brief Положение чтения журнала (RFID_log_rewind, RFID_log_next)
+ */
+typedef struct
+{
+    int8_t sector;                              // -1 - записи кончились
+    uint16_t slot;
+    uint32_t gen;
+} rfid_log_iter_t;
+
+void RFID_log_init(void);
+void RFID_log_event(const rfid_uid_t *card, uint8_t decision, uint8_t source, uint8_t reader, uint32_t latency_us);
+void RFID_log_task(void);
+uint8_t RFID_log_flush(void);
+void RFID_log_rewind(rfid_log_iter_t *it);
+uint8_t RFID_log_next(rfid_log_iter_t *it, rfid_log_rec_t *rec);
+const rfid_log_stats_t *RFID_log_stats(void);
+
+#endif /* __RFID_LOG_H */
@@ -4,18 +4,63 @@
 #include "rc522.h"
 
 #define BUFF_SIZE  256
+#define RFID_NO_SECTOR  0xFF
+#define RFID_CHECK_MS     500                   //период проверки исправности RC522
+#define RFID_WATCHDOG_MS  600000                //плановая переинициализация без признаков сбоя, 0 - нет
+
+/*!
+ * \brief Причины переинициализации RC522, первые - результаты MFRC522_Check
+ */
+typedef enum
+{
+    RFID_REINIT_NONE      = RC522_FAULT_NONE,
+    RFID_REINIT_VERSION   = RC522_FAULT_VERSION,
+    RFID_REINIT_REGISTERS = RC522_FAULT_REGISTERS,
+    RFID_REINIT_ERRORS    = RC522_FAULT_ERRORS,
+    RFID_REINIT_WATCHDOG,
+    RFID_REINIT_CAUSES
+} RFID_reinit_cause_t;
+
+/*!
+ * \brief Надзор за RC522: проверки и счетчики переинициализаций по причинам
+ */
+typedef struct
+{
+    uint32_t checks;                            //выполнено проверок
+    uint32_t reinits[RFID_REINIT_CAUSES];       //переинициализаций по причинам
+    uint32_t since_reinit;                      //проверок после последней переинициализации
+    uint32_t answers;                           //MFRC522_Answers на момент последней проверки
+    uint8_t last_cause;                         //причина последней переинициализации
+    uint8_t pending;                            //причина ожидающей переинициализации
+} RFID_health_t;
+
+/*!
+ * \brief Состояние обмена с выбранной картой: повторный SELECT и аутентификация
+ * пропускаются, пока операции идут в одном секторе тем же ключом
+ */
+typedef struct
+{
+    uint8_t selected;                           //карта в состоянии ACTIVE после RFID_getUID
+    uint8_t sector;                             //сектор, для которого включен Crypto1 (Status2Reg.MFCrypto1On)
+    uint8_t key[KEY_LEN];
+    uint8_t uid[4];
+} RFID_session_t;
+
+typedef struct RFID_reader_s RFID_reader_t;
+
 typedef struct 
 {
     uint8_t buff[BUFF_SIZE];
-    uint8_t uid[UID_SIZE];
+    uint8_t uid[UID_SIZE];                      //4 байта UID для аутентификации и BCC
     uint8_t data[MAX_LEN];
     uint8_t defkey[KEY_LEN];
-    timeout_t timer;
+    RFID_reader_t *reader;                      //считыватель, выбранный RFID_reader_use: сессия, карта, надзор
     
 } RFID_522_struct_t;
 
 void RFID_init(void);
 void RFID_reinit(void);
+uint8_t RFID_reinit_pending(void);
 void RFID_close(void);
 
 uint8_t RFID_WriteReadBlock(uint8_t addrBlock,
@@ -27,5 +72,12 @@ uint8_t RFID_ReadSector(uint8_t addrSector, uint8_t *data, uint8_t *key, uint8_t
 
 uint8_t RFID_ChangeKey(uint8_t addrAuth, uint8_t *old_key, uint8_t *new_param, uint8_t *uid);
 uint8_t RFID_getUID(uint8_t *uid_buff);
+void RFID_session_reset(void);
+uint8_t RFID_session_select(void);
+uint8_t RFID_session_auth(uint8_t block, uint8_t *key, uint8_t *uid);
+
+uint8_t RFID_sector(uint8_t block);
+uint8_t RFID_sector_first_block(uint8_t sector);
+uint8_t RFID_sector_blocks(uint8_t sector);
 
 #endif /* __RFID_522_H */
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef __RFID_NTAG_H
+#define __RFID_NTAG_H
+
+#include "rc522.h"
+
+#define RFID_NTAG_USER_FIRST        4           // первая страница пользовательской памяти
+
+/*!
+ * \brief Карты семейства Ultralight по ответу GET_VERSION
+ */
+typedef enum
+{
+    RFID_NTAG_NONE,                             // не определялась или не Ultralight
+    RFID_NTAG_ULTRALIGHT,                       // Ultralight/Ultralight C: нет GET_VERSION и FAST_READ
+    RFID_NTAG_UL_EV1_48,                        // MF0UL11
+    RFID_NTAG_UL_EV1_128,                       // MF0UL21
+    RFID_NTAG_213,
+    RFID_NTAG_215,
+    RFID_NTAG_216,
+    RFID_NTAG_TYPES
+} RFID_ntag_type_t;
+
+/*!
+ * \brief Выбранная карта Ultralight/NTAG: тип и границы памяти
+ * \details Заполняется RFID_ntag_detect после RFID_getUID и действует до выбора другой карты.
+ */
+typedef struct
+{
+    uint8_t type;                               // RFID_ntag_type_t
+    uint8_t pages;                              // страниц всего
+    uint8_t user_last;                          // последняя страница пользовательской памяти
+    uint8_t pwd_page;                           // страница PWD, 0 - пароля нет
+    uint8_t version[8];                         // ответ GET_VERSION
+} RFID_ntag_t;
+
+uint8_t RFID_ntag_detect(void);
+uint8_t RFID_ntag_read(uint8_t page, uint8_t count, uint8_t *data);
+uint8_t RFID_ntag_read_user(uint8_t *data, uint16_t size, uint16_t *len);
+uint8_t RFID_ntag_write(uint8_t page, const uint8_t *data, uint8_t count);
+uint8_t RFID_ntag_auth(const uint8_t *pwd, const uint8_t *pack);
+
+#endif /* __RFID_NTAG_H */
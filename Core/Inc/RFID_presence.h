@@ -0,0 +1,48 @@
+#ifndef __RFID_PRESENCE_H
+#define __RFID_PRESENCE_H
+
+#include "RFID_async.h"
+
+#define RFID_PRES_PROBE_MS          100         // Период проверки присутствия выбранной карты
+#define RFID_PRES_MISSES            3           // Пропущенных проверок подряд до CARD_LEFT (гистерезис)
+#define RFID_PRES_MAX_STEPS         4           // Шагов проверки при появлении карты после SELECT
+
+typedef enum {
+    RFID_CARD_ARRIVED,      // карта выбрана, шаги появления выполнены (результат - status)
+    RFID_CARD_PRESENT,      // проверка присутствия: карта с тем же UID в поле
+    RFID_CARD_LEFT          // RFID_PRES_MISSES проверок подряд карта не ответила
+} rfid_card_event_t;
+
+/*!
+ * \brief Обработчик событий карты, вызывается из RFID_presence_task
+ * \details card - UID отслеживаемой карты, status - для ARRIVED итог шагов появления.
+ * Обработчик не должен блокировать главный цикл.
+ */
+typedef void (*rfid_presence_cb_t)(rfid_card_event_t event, const rfid_uid_t *card, uint8_t status, void *ctx);
+
+#define RFID_PRES_SELECT_STEPS      3           // REQA, ANTICOLL, SELECT в начале цепочки появления
+
+/*!
+ * \brief Отслеживание карты на одном считывателе, у каждого свое (RFID_reader_t)
+ */
+typedef struct
+{
+    rfid_request_t req;
+    rfid_step_t arrival[RFID_PRES_SELECT_STEPS + RFID_PRES_MAX_STEPS];
+    rfid_presence_cb_t cb;
+    void *ctx;
+    uint8_t count;                              // шагов цепочки появления
+    uint8_t state;
+    uint8_t misses;
+    volatile uint8_t ready;
+    uint32_t probe_time;                        // HAL_GetTick последней проверки присутствия
+    rfid_uid_t card;
+} rfid_presence_t;
+
+void RFID_presence_init(rfid_presence_cb_t cb, void *ctx, const rfid_step_t *steps, uint8_t count);
+void RFID_presence_check(uint8_t (*check)(const rfid_uid_t *card));
+void RFID_presence_task(void);
+uint8_t RFID_presence_present(void);
+const rfid_uid_t *RFID_presence_card(void);
+
+#endif /* __RFID_PRESENCE_H */
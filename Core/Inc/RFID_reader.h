@@ -0,0 +1,40 @@
+#ifndef __RFID_READER_H
+#define __RFID_READER_H
+
+#include "RFID_detect.h"
+#include "RFID_presence.h"
+#include "RFID_tcl.h"
+#include "RFID_ntag.h"
+
+#define RFID_READER_CHAINS          1           // Цепочек за ход считывателя: больше - меньше переключений, дольше ждут остальные
+
+/*!
+ * \brief Считыватель на общей шине SPI2 со своим состоянием верхнего уровня
+ * \details Функции RFID_* работают со считывателем rfid.reader. Планировщик RFID_reader_task
+ * переключает считыватели по кругу между цепочками: за ход считыватель запускает не больше
+ * RFID_READER_CHAINS цепочек, поэтому задержка обнаружения карты на любом из них ограничена
+ * RC522_READERS ходами и ни один считыватель не занимает шину надолго.
+ */
+struct RFID_reader_s
+{
+    mfrc522_t *dev;
+    uint8_t index;
+    uint8_t chains;                             //цепочек, принятых RFID_submit за текущий ход
+    uint32_t turns;                             //ходов планировщика
+    RFID_session_t session;
+    rfid_uid_t card;                            //полный UID выбранной карты
+    RFID_health_t health;
+    timeout_t timer;                            //период проверки RFID_CHECK_MS
+    rfid_detect_t detect;
+    rfid_presence_t presence;
+    RFID_tcl_t tcl;                             //сессия ISO14443-4 выбранной карты
+    RFID_ntag_t ntag;                           //тип выбранной карты Ultralight/NTAG
+};
+
+void RFID_reader_init(void);
+uint8_t RFID_reader_use(uint8_t index);
+RFID_reader_t *RFID_reader(uint8_t index);
+uint8_t RFID_reader_may_submit(void);
+void RFID_reader_task(void);
+
+#endif /* __RFID_READER_H */
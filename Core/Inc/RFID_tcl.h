@@ -0,0 +1,34 @@
+#ifndef __RFID_TCL_H
+#define __RFID_TCL_H
+
+#include "rc522.h"
+
+#define RFID_TCL_FSDI               5           // FSD = 64: кадр карты целиком помещается в FIFO RC522
+#define RFID_TCL_FSD                64          // наибольший кадр от карты с PCB и CRC
+#define RFID_TCL_ATS_MAX            20          // ATS длиннее обрезается, исторические байты не нужны
+#define RFID_TCL_RETRIES            2           // повторов после таймаута или ошибки кадра (ISO14443-4, 7.5.6)
+#define RFID_TCL_FWT_ACT_US         5300        // ожидание ATS и ответа PPS: 65536/fc с запасом
+#define RFID_TCL_DFWT_US            3700        // добавка к FWT карты: 49152/fc
+
+/*!
+ * \brief Сессия ISO14443-4 (T=CL) с выбранной картой на одном считывателе
+ * \details Кадры без CID и NAD. Блоки больше FSC к карте и больше FSD от карты идут цепочкой.
+ */
+typedef struct
+{
+    uint8_t active;                             // ATS получен, обмен блоками разрешен
+    uint8_t block;                              // номер блока PCD, 0/1
+    uint8_t fsc;                                // наибольший кадр к карте с PCB и CRC
+    uint8_t tx_rate;                            // RC522_RATE_* к карте после PPS
+    uint8_t rx_rate;                            // RC522_RATE_* от карты после PPS
+    uint32_t fwt_us;                            // время ожидания кадра (FWI из ATS)
+    uint8_t ats[RFID_TCL_ATS_MAX];
+    uint8_t ats_len;
+} RFID_tcl_t;
+
+uint8_t RFID_tcl_activate(uint8_t max_rate);
+uint8_t RFID_tcl_exchange(const uint8_t *apdu, uint16_t len, uint8_t *resp, uint16_t size, uint16_t *resp_len);
+uint8_t RFID_tcl_deselect(void);
+void RFID_tcl_reset(void);
+
+#endif /* __RFID_TCL_H */
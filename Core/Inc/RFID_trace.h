@@ -0,0 +1,55 @@
+#ifndef __RFID_TRACE_H
+#define __RFID_TRACE_H
+
+#include "rc522.h"
+
+#define RFID_TRACE                  0           // 1 - запись обменов RC522 с картами в RAM, 0 - код записи не собирается
+#define RFID_TRACE_RECORDS          64          // записей в кольцевом буфере, старые перезаписываются
+#define RFID_TRACE_DATA             18          // байт кадра в записи: блок MIFARE с CRC_A
+#define RFID_TRACE_VERSION          1
+#define RFID_TRACE_MAGIC            0x54        // 'T': тип частей выгрузки в канале RFID_export
+#define RFID_TRACE_PART             512         // байт в части выгрузки
+
+/*!
+ * \brief Один обмен MFRC522_ToCardStart/MFRC522_ToCardPoll
+ * \details Запись фиксированного размера: стоимость записи не зависит от длины кадра.
+ */
+typedef struct
+{
+    uint32_t start;                             // счетчик тактов (DWT) при запуске команды
+    uint32_t cycles;                            // длительность до результата, такты
+    uint16_t rx_bits;                           // принято бит
+    uint8_t reader;                             // номер считывателя
+    uint8_t command;                            // PCD_TRANSCEIVE, PCD_AUTHENT
+    uint8_t status;                             // MI_* результата MFRC522_ToCardPoll
+    uint8_t error;                              // ErrorReg, 0xFF - команда зависла
+    uint8_t coll;                               // CollReg
+    uint8_t tx_len;                             // передано байт
+    uint8_t tx[RFID_TRACE_DATA];
+    uint8_t rx[RFID_TRACE_DATA];
+} rfid_trace_rec_t;
+
+/*
+ * Формат выгрузки RFID_trace_dump, многобайтные поля младшим байтом вперед:
+ *   'R' 'T' <версия> <тактов в мкс> <число записей, 2> <потеряно записей, 4>
+ *   записи от старой к новой:
+ *     <start, 4> <cycles, 4> <rx_bits, 2> <reader> <command> <status> <error> <coll> <tx_len>
+ *     первые MIN(tx_len, 18) байт передачи, первые MIN((rx_bits + 7) / 8, 18) байт ответа
+ *   CRC32 всего предыдущего
+ * Выгрузка уходит частями RFID_export_send типа RFID_TRACE_MAGIC по целому числу записей,
+ * последняя часть (флаг в заголовке части) - с CRC32.
+ * Tools/trace2pcap переводит выгрузку в pcap (LINKTYPE_ISO_14443) для Wireshark.
+ */
+
+#if RFID_TRACE
+void RFID_trace_start(uint8_t reader, uint8_t command, const uint8_t *tx, uint8_t len, uint32_t start);
+void RFID_trace_done(uint8_t status, uint8_t error, uint8_t coll, const uint8_t *rx, uint16_t bits, uint32_t now);
+#endif
+void RFID_trace_enable(uint8_t on);
+uint16_t RFID_trace_count(void);
+uint8_t RFID_trace_dump(void);
+uint8_t RFID_trace_result(void);
+void RFID_trace_task(void);
+void RFID_trace_clear(void);
+
+#endif /* __RFID_TRACE_H */
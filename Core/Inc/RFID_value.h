@@ -0,0 +1,22 @@
+#ifndef __RFID_VALUE_H
+#define __RFID_VALUE_H
+
+#include "rc522.h"
+
+/*
+ * Блок значения MIFARE Classic (16 байт):
+ *   value, ~value, value - 32 бита со знаком, младшим байтом вперед
+ *   addr, ~addr, addr, ~addr - адрес блока (для резервной копии - адрес основного)
+ * Карта проверяет формат сама и выполняет INC/DEC/RESTORE только над правильным блоком.
+ */
+
+void RFID_value_encode(int32_t value, uint8_t addr, uint8_t *block);
+uint8_t RFID_value_decode(const uint8_t *block, int32_t *value, uint8_t *addr);
+
+uint8_t RFID_value_format(uint8_t addrBlock, int32_t value, uint8_t *key, uint8_t *uid);
+uint8_t RFID_value_read(uint8_t addrBlock, int32_t *value, uint8_t *key, uint8_t *uid);
+uint8_t RFID_value_increment(uint8_t addrBlock, int32_t delta, uint8_t *key, uint8_t *uid);
+uint8_t RFID_value_decrement(uint8_t addrBlock, int32_t delta, uint8_t *key, uint8_t *uid);
+uint8_t RFID_value_copy(uint8_t srcBlock, uint8_t dstBlock, uint8_t *key, uint8_t *uid);
+
+#endif /* __RFID_VALUE_H */
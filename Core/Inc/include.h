@@ -14,13 +14,30 @@
 #include "delay.h"
 #include "wdt.h"
 #include "crc_hw.h"
+#include "crc_a.h"
 #include "led.h"
 #include "software_timer.h"
 #include "fifo.h"
+#include "flash_hal.h"
 #include "interface.h"
 
 #include "low_level.h"
+#include "spi_dma.h"
 #include "RFID_module.h"
+#include "RFID_async.h"
+#include "RFID_inventory.h"
+#include "RFID_detect.h"
+#include "RFID_presence.h"
+#include "RFID_tcl.h"
+#include "RFID_ntag.h"
+#include "RFID_reader.h"
+#include "RFID_image.h"
+#include "RFID_value.h"
+#include "RFID_trace.h"
+#include "RFID_db.h"
+#include "RFID_cache.h"
+#include "RFID_log.h"
+#include "RFID_export.h"
 #include "lock.h"
 #include "rc522.h"
 #include "stm32f4xx_it.h"
@@ -19,7 +19,13 @@
 #define PIN_CS     	                    B,0,L,OUTPUT_PUSH_PULL,SPEED_2MHZ //выбор slave
 // управление датчиком
 #define PIN_RESET     	                C,4,L,OUTPUT_PUSH_PULL,SPEED_2MHZ //сброс датчика нулем
+#define PIN_IRQ     	                B,1,L,INPUT_PULL_UP,SPEED_2MHZ //прерывание датчика, активный ноль
+// второй считыватель на той же шине (RC522_READERS > 1)
+#define PIN_CS2     	                B,5,H,OUTPUT_PUSH_PULL,SPEED_2MHZ
+#define PIN_RESET2     	                C,5,L,OUTPUT_PUSH_PULL,SPEED_2MHZ
+#define PIN_IRQ2     	                B,4,L,INPUT_PULL_UP,SPEED_2MHZ
 
 void init_task(void);
+void switchToTx(void);
 
 #endif /* __LOW_LEVEL_H */
\ No newline at end of file
@@ -7,19 +7,161 @@
 #define PORT_RESET_HAL     	             GPIOC //сброс датчика нулем
 #define PIN_CS_HAL     	                 GPIO_PIN_0 //выбор slave
 #define PORT_CS_HAL     	             GPIOB      //выбор slave
+#define PIN_IRQ_HAL     	             GPIO_PIN_1 //линия IRQ датчика (EXTI1)
+#define PORT_IRQ_HAL     	             GPIOB      //линия IRQ датчика
+
+#define RC522_READERS                    1          //считывателей на общей шине SPI2 (2 - вход и выход)
+#define PIN_RESET2_HAL     	             GPIO_PIN_5 //второй считыватель: сброс
+#define PORT_RESET2_HAL     	         GPIOC
+#define PIN_CS2_HAL     	             GPIO_PIN_5 //второй считыватель: выбор slave
+#define PORT_CS2_HAL     	             GPIOB
+#define PIN_IRQ2_HAL     	             GPIO_PIN_4 //второй считыватель: линия IRQ (EXTI4)
+#define PORT_IRQ2_HAL     	             GPIOB
+
+#define RC522_CMD_TIMEOUT_US             30000      //граница ожидания команды, больше таймера RC522 (25 мс)
+#define RC522_CMD_MARGIN_US              5000       //запас границы команды к таймеру RC522 длиннее 25 мс (FWT ISO14443-4)
+#define RC522_CRC_TIMEOUT_US             1000       //граница ожидания сопроцессора CRC
+#define RC522_RESET_TIMEOUT_US           50000      //граница запуска генератора после SoftReset
+#define RC522_TIMER_RELOAD               1000       //таймер ответа карты: 25 мкс * 1000 = 25 мс
+#define RC522_TMO_LEARN                  8          //ответов до сужения границы по измеренному времени
+#define RC522_TMO_MARGIN                 2          //запас к удвоенному измеренному времени, тики 25 мкс
+#define RC522_MAX_ERRORS                 4          //сбоев обмена подряд до признания RC522 неисправным
+#define RC522_SHADOW_VERIFY              0          //1 - отладка: SetBitMask/ClearBitMask и MFRC522_Check сверяют тень с микросхемой
+#define RC522_SHADOW_REGS                13         //регистров настройки с теневой копией
 
 //Maximum length of the array
 #define MAX_LEN 16
+#define MAX_FRAME_LEN (MAX_LEN + 2)   //блок и CRC_A
+#define MFRC522_FIFO_SIZE 64
+#define MFRC522_PAGE_LEN 4            //страница Ultralight/NTAG
+#define MFRC522_FAST_READ_PAGES 15    //страниц FAST_READ за кадр: 60 байт и CRC_A в FIFO
 #define KEY_LEN 6
-#define UID_SIZE 5
-#define MAX_CARDS 100
-#define MAX_ATTEMPTS 100
+#define UID_SIZE 5                    //4 байта UID для аутентификации и BCC
+#define UID_MAX_LEN 10                //UID тройного размера (3 уровня каскада)
 
 #define SPI_READ_SIGN	                  ((uint8_t)0x80)		// Старший бит в адресе определяет режим обращения к регистру - чтение
 
 #define  uchar  unsigned char
 #define  uint   unsigned int
 
+/*!
+ * \brief UID карты после полного SELECT всех уровней каскада
+ */
+typedef struct
+{
+  uchar size;                   // 4, 7 или 10
+  uchar bytes[UID_MAX_LEN];     // без Cascade Tag и BCC
+  uchar sak;                    // SAK последнего уровня
+} rfid_uid_t;
+
+/*!
+ * \brief Результат проверки исправности RC522 (MFRC522_Check)
+ */
+typedef enum
+{
+  RC522_FAULT_NONE,
+  RC522_FAULT_VERSION,          // VersionReg не совпал с прочитанным при инициализации: нет связи по SPI
+  RC522_FAULT_REGISTERS,        // настройки не совпали с записанными: микросхема сбросилась
+  RC522_FAULT_ERRORS            // подряд RC522_MAX_ERRORS сбоев обмена или зависание команды
+} rc522_fault_t;
+
+/*!
+ * \brief Профили ожидания ответа карты, выбираются MFRC522_ToCardStart по кадру
+ */
+typedef enum
+{
+  RC522_TMO_REQA,               // REQA/WUPA
+  RC522_TMO_ANTICOLL,
+  RC522_TMO_SELECT,
+  RC522_TMO_AUTH,               // MFAuthent
+  RC522_TMO_READ,
+  RC522_TMO_WRITE,              // WRITE: ACK первой фазы
+  RC522_TMO_WRITE_DATA,         // WRITE: ACK после записи EEPROM
+  RC522_TMO_HALT,               // ответа нет, ждем 1 мс (ISO14443-3)
+  RC522_TMO_VALUE,              // INC/DEC/RESTORE: вторая фаза без ACK, молчание 1 мс - успех
+  RC522_TMO_TCL,                // блок ISO14443-4: граница - FWT карты (MFRC522_SetFwt), без обучения
+  RC522_TMO_DEFAULT,
+  RC522_TMO_COUNT
+} rc522_tmo_t;
+
+/*!
+ * \brief Стадии команды MFRC522_ToCardStart: FIFO загружается и выгружается DMA,
+ * пока MFRC522_ToCardPoll возвращает MI_BUSY
+ */
+typedef enum
+{
+  RC522_PHASE_IDLE,
+  RC522_PHASE_LOAD,             // кадр идет в FIFO, команда еще не запущена
+  RC522_PHASE_RUN,              // команда выполняется, ждем IRQ
+  RC522_PHASE_DRAIN             // ответ идет из FIFO в буфер вызывающего
+} rc522_phase_t;
+
+/*!
+ * \brief Считыватель RC522: шина SPI, выводы и состояние драйвера
+ * \details Функции MFRC522_* получают считыватель первым параметром. Экземпляры создает
+ * драйвер (по одному на RC522_READERS), снаружи - указатели из MFRC522_Reader.
+ */
+typedef struct
+{
+  uchar index;                  // номер в MFRC522_Reader
+  spi_dma_bus_t *bus;           // шина и ее очередь DMA, общая для считывателей на ней
+  GPIO_TypeDef *cs_port;
+  uint16_t cs_pin;
+  GPIO_TypeDef *rst_port;
+  uint16_t rst_pin;
+  volatile uint8_t irq;         // фронт на линии IRQ (MFRC522_IrqHandler)
+
+  // теневые значения регистров для MFRC522_Check и записи только при смене
+  uchar version;                // VersionReg после последней инициализации
+  uchar antenna;                // поле включено AntennaOn
+  uint16_t reload;              // текущее значение TReloadReg
+  uint16_t fwt;                 // граница профиля RC522_TMO_TCL, тики по 25 мкс
+  uchar crcMode;
+  uchar txCrc;                  // TxModeReg.TxCRCEn
+  uchar rxCrc;                  // RxModeReg.RxCRCEn
+  uchar shadow[RC522_SHADOW_REGS];  // последнее записанное значение регистров настройки
+  uint16_t shadowValid;         // биты shadow[], записанные после сброса
+  uint32_t shadowMiss;          // расхождений тени с микросхемой (RC522_SHADOW_VERIFY)
+
+  uchar errors;                 // сбоев обмена подряд
+  uint32_t answers;             // принято ответов карт
+
+  // команда, запущенная MFRC522_ToCardStart
+  struct
+  {
+    uchar phase;                // rc522_phase_t
+    uchar command;
+    uchar irqEn;
+    uchar waitIRq;
+    uchar profile;              // rc522_tmo_t
+    uchar next;                 // профиль следующей команды: данные после ACK на WRITE, INC/DEC/RESTORE
+    uint32_t start;
+    uint32_t ticks;
+    uchar status;               // итог команды, пока DMA выгружает FIFO
+    uint bits;
+    uchar errorReg;             // ErrorReg и CollReg итога - для трассировки
+    uchar collReg;
+  } toCard;
+
+  // измеренное время ответа по профилям (MFRC522_Timeout)
+  struct
+  {
+    uint16_t seen;              // наибольшее измеренное время ответа
+    uchar samples;
+  } tmo[RC522_TMO_COUNT];
+
+  // асинхронный обмен с FIFO (MFRC522_WriteFifoAsync/ReadFifoAsync): адресный байт + данные
+  struct
+  {
+    spi_dma_xfer_t xfer;        // xfer.ctx - сам считыватель
+    uint8_t tx[MFRC522_FIFO_SIZE + 1];
+    uint8_t rx[MFRC522_FIFO_SIZE + 1];
+    uchar *dst;
+    void (*done)(void *ctx);
+    void *ctx;
+  } fifo;
+} mfrc522_t;
+
 // MFRC522 commands. Described in chapter 10 of the datasheet.
 #define PCD_IDLE              0x00               // no action, cancels current command execution
 #define PCD_AUTHENT           0x0E               // performs the MIFARE standard authentication as a reader
@@ -33,7 +175,11 @@
 #define PICC_REQIDL           0x26               // REQuest command, Type A. Invites PICCs in state IDLE to go to READY and prepare for anticollision or selection. 7 bit frame.
 #define PICC_REQALL           0x52               // Wake-UP command, Type A. Invites PICCs in state IDLE and HALT to go to READY(*) and prepare for anticollision or selection. 7 bit frame.
 #define PICC_ANTICOLL         0x93               // Anti collision/Select, Cascade Level 1
-#define PICC_SElECTTAG        0x93               // Anti collision/Select, Cascade Level 2
+#define PICC_SElECTTAG        0x93               // Select, Cascade Level 1 (только UID из 4 байт)
+#define PICC_SEL_CL1          0x93               // Anti collision/Select, Cascade Level 1
+#define PICC_SEL_CL2          0x95               // Anti collision/Select, Cascade Level 2
+#define PICC_SEL_CL3          0x97               // Anti collision/Select, Cascade Level 3
+#define PICC_CASCADE_TAG      0x88               // Cascade Tag: первый байт UID уровня, за которым следует еще один уровень
 #define PICC_AUTHENT1A        0x60               // Perform authentication with Key A
 #define PICC_AUTHENT1B        0x61               // Perform authentication with Key B
 #define PICC_READ             0x30               // Reads one 16 byte block from the authenticated sector of the PICC. Also used for MIFARE Ultralight.
@@ -43,12 +189,28 @@
 #define PICC_RESTORE          0xC2               // Reads the contents of a block into the internal data register.
 #define PICC_TRANSFER         0xB0               // Writes the contents of the internal data register to a block.
 #define PICC_HALT             0x50               // HaLT command, Type A. Instructs an ACTIVE PICC to go to state HALT.
+#define PICC_UL_GET_VERSION   0x60               // Ultralight EV1/NTAG: производитель, тип и объем памяти (код PICC_AUTHENT1A, но Transceive)
+#define PICC_UL_FAST_READ     0x3A               // Ultralight EV1/NTAG: страницы с первой по последнюю одним ответом
+#define PICC_UL_WRITE         0xA2               // Ultralight/NTAG: запись одной страницы 4 байта
+#define PICC_UL_PWD_AUTH      0x1B               // Ultralight EV1/NTAG: проверка 32-битного пароля, ответ PACK
 
 
 // Success or error code is returned when communication
 #define MI_OK                 0
 #define MI_NOTAGERR           1
 #define MI_ERR                2
+#define MI_BUSY               3                  // команда еще выполняется (асинхронный режим)
+#define MI_COLLISION          4                  // коллизия битов в ответе нескольких карт (CollErr)
+
+// Скорости обмена с картой (TxModeReg/RxModeReg.Speed), 106 кбит/с - обязательная для ISO14443-3
+#define RC522_RATE_106        0
+#define RC522_RATE_212        1
+#define RC522_RATE_424        2
+#define RC522_RATE_848        3
+
+// CRC_A кадров ISO14443-3
+#define RC522_CRC_SOFTWARE    0                  // табличный расчет на STM32 (crc_a.c)
+#define RC522_CRC_HARDWARE    1                  // TxCRCEn/RxCRCEn: RC522 сам дописывает и проверяет CRC
 
 // MFRC522 registers. Described in chapter 9 of the datasheet.
 // Page 0: Command and Status
@@ -122,27 +284,63 @@
 
 
 uint8_t spiXmit (SPI_TypeDef *SPIx, uint8_t byte);
-void Write_MFRC522(uchar addr, uchar val);
-uchar Read_MFRC522(uchar addr);
-
-void SetBitMask(uchar reg, uchar mask);
-void ClearBitMask(uchar reg, uchar mask);
-void AntennaOn();
-void AntennaOff();
-void MFRC522_Reset();
-void MFRC522_Init(void);
-uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen);
-uchar MFRC522_Request(uchar reqMode, uchar *TagType);
-uchar MFRC522_Anticoll(uchar *serNum);
-void CalulateCRC(uchar *pIndata, uchar len, uchar *pOutData);
-uchar MFRC522_Read(uchar blockAddr, uchar *recvData);
-uchar MFRC522_Write(uchar blockAddr, uchar *writeData);
-uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum);
-uchar MFRC522_SelectTag(uchar *serNum);
-void MFRC522_Halt();
+void Write_MFRC522(mfrc522_t *dev, uchar addr, uchar val);
+uchar Read_MFRC522(mfrc522_t *dev, uchar addr);
+void MFRC522_WriteFifo(mfrc522_t *dev, uchar *data, uchar len);
+void MFRC522_ReadFifo(mfrc522_t *dev, uchar *data, uchar len);
+uchar MFRC522_WriteFifoAsync(mfrc522_t *dev, uchar *data, uchar len, void (*done)(void *ctx), void *ctx);
+uchar MFRC522_ReadFifoAsync(mfrc522_t *dev, uchar *data, uchar len, void (*done)(void *ctx), void *ctx);
+
+void SetBitMask(mfrc522_t *dev, uchar reg, uchar mask);
+void ClearBitMask(mfrc522_t *dev, uchar reg, uchar mask);
+void AntennaOn(mfrc522_t *dev);
+void AntennaOff(mfrc522_t *dev);
+void MFRC522_Reset(mfrc522_t *dev);
+void MFRC522_Init(mfrc522_t *dev);
+rc522_fault_t MFRC522_Check(mfrc522_t *dev);
+void MFRC522_SetTimer(mfrc522_t *dev, uint16_t reload);
+uint16_t MFRC522_Timeout(mfrc522_t *dev, rc522_tmo_t profile);
+uint32_t MFRC522_Answers(mfrc522_t *dev);
+uint32_t MFRC522_CyclesPerUs(void);
+uint32_t MFRC522_Cycles(void);
+void MFRC522_PowerDown(mfrc522_t *dev, uchar on);
+void MFRC522_SetBitRate(mfrc522_t *dev, uchar tx, uchar rx);
+void MFRC522_SetFwt(mfrc522_t *dev, uint32_t us);
+void MFRC522_NextProfile(mfrc522_t *dev, rc522_tmo_t profile);
+uchar MFRC522_ShadowVerify(mfrc522_t *dev);
+uchar MFRC522_ToCard(mfrc522_t *dev, uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen);
+void MFRC522_ToCardStart(mfrc522_t *dev, uchar command, uchar *sendData, uchar sendLen);
+uchar MFRC522_ToCardPoll(mfrc522_t *dev, uchar *backData, uchar backSize, uint *backLen);
+uchar MFRC522_Request(mfrc522_t *dev, uchar reqMode, uchar *TagType);
+uchar MFRC522_Anticoll(mfrc522_t *dev, uchar *serNum);
+uchar MFRC522_Select(mfrc522_t *dev, rfid_uid_t *uid);
+uchar MFRC522_AnticollFrame(mfrc522_t *dev, uchar *sel, uchar level, uchar known);
+uchar MFRC522_AnticollMerge(mfrc522_t *dev, uchar *sel, uchar *known, uchar status, const uchar *resp, uint bits);
+uchar MFRC522_SelectFrame(mfrc522_t *dev, uchar *sel);
+uchar MFRC522_SelectDone(rfid_uid_t *uid, const uchar *sel, uchar sak);
+void MFRC522_UidAuthBytes(const rfid_uid_t *uid, uchar *serNum);
+void CalulateCRC(mfrc522_t *dev, uchar *pIndata, uchar len, uchar *pOutData);
+void MFRC522_SetCRC(mfrc522_t *dev, uchar tx, uchar rx);
+void MFRC522_SetCRCMode(mfrc522_t *dev, uchar mode);
+uchar MFRC522_AppendCRC(mfrc522_t *dev, uchar *buf, uchar len, uchar rxCrc);
+uchar MFRC522_CheckCRC(mfrc522_t *dev, uchar *buf, uint bits, uchar *len);
+uchar MFRC522_Read(mfrc522_t *dev, uchar blockAddr, uchar *recvData);
+uchar MFRC522_Write(mfrc522_t *dev, uchar blockAddr, uchar *writeData);
+uchar MFRC522_FastRead(mfrc522_t *dev, uchar startPage, uchar endPage, uchar *recvData);
+uchar MFRC522_WritePage(mfrc522_t *dev, uchar page, const uchar *writeData);
+uchar MFRC522_GetVersion(mfrc522_t *dev, uchar *version);
+uchar MFRC522_PwdAuth(mfrc522_t *dev, const uchar *pwd, uchar *pack);
+uchar MFRC522_Value(mfrc522_t *dev, uchar command, uchar blockAddr, int32_t operand);
+uchar MFRC522_Transfer(mfrc522_t *dev, uchar blockAddr);
+uchar MFRC522_Auth(mfrc522_t *dev, uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum);
+uchar MFRC522_SelectTag(mfrc522_t *dev, uchar *serNum);
+void MFRC522_Halt(mfrc522_t *dev);
+void EXTI1_IRQHandler(void);
+void EXTI4_IRQHandler(void);
+mfrc522_t *MFRC522_Reader(uchar index);
+void MFRC522_IrqHandler(mfrc522_t *dev);
 
 uchar Read_Single_Card();
-void Read_Multiple_Cards();
 void Write_Content_Card(uchar authMode, uchar* myString, uchar block, uchar *Sectorkey);
 void Read_Content_Card(uchar authMode, uchar block, uchar *Sectorkey);
 
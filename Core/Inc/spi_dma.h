@@ -0,0 +1,82 @@
+#ifndef __SPI_DMA_H
+#define __SPI_DMA_H
+
+#include <stdint.h>
+#include "interface_modules/dma_buffer.h"
+
+// SPI2 на STM32F411: RX - DMA1 Stream3, TX - DMA1 Stream4, канал 0
+#define SPI_DMA_SPI                 SPI2
+#define SPI_DMA_RX_STREAM           DMA1_Stream3
+#define SPI_DMA_TX_STREAM           DMA1_Stream4
+#define SPI_DMA_CHANNEL             0
+#define SPI_DMA_RX_IRQ              DMA1_Stream3_IRQn
+#define SPI_DMA_IRQ_PRIORITY        5
+
+#define SPI_DMA_QUEUE_LEN           8           // Максимальное число транзакций в очереди (степень 2)
+#define SPI_DMA_MIN_LEN             4           // Более короткие транзакции выгоднее отправить без DMA
+#define SPI_DMA_POLL_TIMEOUT        0xFFFF      // Ожидание RXNE в опросном режиме и снятия EN потока, итераций
+#define SPI_DMA_TIMEOUT_US          5000        // Ожидание шины; полная очередь 8 x 65 байт при SPI/16 - около 2 мс
+
+typedef enum {
+    SPI_DMA_IDLE,
+    SPI_DMA_QUEUED,
+    SPI_DMA_BUSY,
+    SPI_DMA_DONE,
+    SPI_DMA_ERROR
+} spi_dma_status_t;
+
+typedef struct spi_dma_xfer_s spi_dma_xfer_t;
+
+/*!
+ * \brief Дескриптор одной транзакции на шине: CS опускается на время всей транзакции
+ * \details tx == NULL - передаются нули, rx == NULL - принятые байты отбрасываются.
+ * Буферы и сам дескриптор должны жить до вызова callback.
+ */
+struct spi_dma_xfer_s
+{
+    GPIO_TypeDef *cs_port;
+    uint16_t cs_pin;
+    const uint8_t *tx;
+    uint8_t *rx;
+    uint16_t len;
+    volatile spi_dma_status_t status;
+    void (*callback)(spi_dma_xfer_t *xfer);     // Вызывается из прерывания DMA
+    void *ctx;
+};
+
+/*!
+ * \brief Шина SPI с парой потоков DMA и очередью транзакций
+ * \details Одна шина обслуживает все устройства на ней, устройство выбирается CS транзакции.
+ * Флаги потоков задаются регистрами LIFCR/HIFCR контроллера DMA: у потоков 0-3 и 4-7 они разные.
+ */
+typedef struct
+{
+    SPI_TypeDef *spi;
+    dma_t rx;
+    dma_t tx;
+    volatile uint32_t *rx_isr;
+    volatile uint32_t *rx_ifcr;
+    volatile uint32_t *tx_ifcr;
+    uint32_t rx_flags;
+    uint32_t tx_flags;
+    uint32_t rx_teif;
+    IRQn_Type rx_irq;
+    spi_dma_xfer_t *volatile current;
+    spi_dma_xfer_t *queue[SPI_DMA_QUEUE_LEN];
+    volatile uint32_t queue_in;
+    volatile uint32_t queue_out;
+    uint32_t aborts;                            // Сбросов зависшей шины по SPI_DMA_TIMEOUT_US
+} spi_dma_bus_t;
+
+extern spi_dma_bus_t spi_dma_bus2;
+
+void spi_dma_init(spi_dma_bus_t *bus);
+uint8_t spi_dma_submit(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer);
+spi_dma_status_t spi_dma_wait(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer);
+spi_dma_status_t spi_dma_xmit(spi_dma_bus_t *bus, GPIO_TypeDef *cs_port, uint16_t cs_pin,
+                              const uint8_t *tx, uint8_t *rx, uint16_t len);
+uint8_t spi_dma_busy(spi_dma_bus_t *bus);
+
+void DMA1_Stream3_IRQHandler(void);
+
+#endif /* __SPI_DMA_H */
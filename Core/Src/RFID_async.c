@@ -0,0 +1,257 @@
+#include "include.h"
+
+typedef enum {
+    RFID_PHASE_START,       // формирование кадра и запуск команды
+    RFID_PHASE_WAIT,        // ожидание ответа
+    RFID_PHASE_DATA,        // вторая фаза записи: 16 байт данных
+    RFID_PHASE_DATA_WAIT,
+    RFID_PHASE_HALT,
+    RFID_PHASE_HALT_WAIT
+} rfid_phase_t;
+
+static rfid_request_t *rfid_active;
+
+static void RFID_async_start(rfid_request_t *req);
+static uint8_t RFID_async_check(rfid_request_t *req, uint8_t status, uint bits);
+static void RFID_async_finish(rfid_request_t *req, uint8_t status);
+
+/*!
+ * \brief Постановка цепочки обменов на выполнение
+ * \return MI_OK - принято, MI_ERR - считыватель занят другой цепочкой, ждет переинициализации
+ * или исчерпал цепочки своего хода (RFID_reader_task)
+ */
+uint8_t RFID_submit(rfid_request_t *req)
+{
+    if (rfid_active != NULL || req->count == 0 || RFID_reinit_pending() || !RFID_reader_may_submit())
+        return MI_ERR;
+
+    req->status = MI_ERR;
+    req->failed_step = 0;
+    req->step = 0;
+    req->phase = RFID_PHASE_START;
+    req->level = 0;
+    req->known = 0;
+    req->card.size = 0;
+    req->start = MFRC522_Cycles();
+    RFID_session_reset();                       //цепочка сама выбирает карту и аутентифицируется
+    rfid.reader->chains++;
+    rfid_active = req;
+    return MI_OK;
+}
+
+uint8_t RFID_busy(void)
+{
+    return rfid_active != NULL;
+}
+
+/*!
+ * \brief Один шаг автомата: запускает команду или забирает ее результат и сразу возвращается
+ * \details Вызывается из главного цикла. Время одного вызова ограничено обменом по SPI,
+ * ожидание ответа карты в нем не происходит.
+ */
+void RFID_poll(void)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    rfid_request_t *req = rfid_active;
+    uint8_t status;
+    uint bits = 0;
+    uint8_t len;
+
+    if (req == NULL)
+        return;
+
+    switch (req->phase) {
+        case RFID_PHASE_START:
+            if (req->steps[req->step].op == RFID_STEP_CHECK) {
+                //решение по UID без кадра: отказ или результат до аутентификации
+                status = req->check ? req->check(&req->card) : MI_ERR;
+                if (status == RFID_CHECK_DONE) {
+                    RFID_async_finish(req, MI_OK);
+                } else if (status != MI_OK) {
+                    req->failed_step = req->step;
+                    RFID_async_finish(req, MI_ERR);
+                } else if (++req->step >= req->count) {
+                    RFID_async_finish(req, MI_OK);
+                }
+                break;
+            }
+            RFID_async_start(req);
+            req->phase = RFID_PHASE_WAIT;
+            break;
+
+        case RFID_PHASE_WAIT:
+        case RFID_PHASE_DATA_WAIT:
+            status = MFRC522_ToCardPoll(dev, req->frame, sizeof(req->frame), &bits);
+            if (status == MI_BUSY)
+                break;
+
+            status = RFID_async_check(req, status, bits);
+            if (status == MI_BUSY) {
+                //антиколлизия продолжается или нужен следующий уровень каскада
+                req->phase = RFID_PHASE_START;
+                break;
+            }
+            if (status != MI_OK) {
+                req->failed_step = req->step;
+                RFID_async_finish(req, status);
+                break;
+            }
+
+            if (req->phase == RFID_PHASE_WAIT && req->steps[req->step].op == RFID_STEP_WRITE) {
+                req->phase = RFID_PHASE_DATA;
+                break;
+            }
+
+            if (++req->step >= req->count)
+                RFID_async_finish(req, MI_OK);
+            else
+                req->phase = RFID_PHASE_START;
+            break;
+
+        case RFID_PHASE_DATA:
+            memcpy(req->frame, req->steps[req->step].data, 16);
+            len = MFRC522_AppendCRC(dev, req->frame, 16, 0);
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->frame, len);
+            req->phase = RFID_PHASE_DATA_WAIT;
+            break;
+
+        case RFID_PHASE_HALT:
+            req->frame[0] = PICC_HALT;
+            req->frame[1] = 0;
+            len = MFRC522_AppendCRC(dev, req->frame, 2, 0);
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->frame, len);
+            req->phase = RFID_PHASE_HALT_WAIT;
+            break;
+
+        case RFID_PHASE_HALT_WAIT:
+            //на HALT карта не отвечает - ждем таймаута и завершаем
+            if (MFRC522_ToCardPoll(dev, req->frame, sizeof(req->frame), &bits) == MI_BUSY)
+                break;
+            ClearBitMask(dev, Status2Reg, 0x08);     //Crypto1 выключаем, иначе следующий REQA уйдет шифрованным
+            rfid_active = NULL;
+            if (req->callback)
+                req->callback(req);
+            break;
+    }
+}
+
+static void RFID_async_start(rfid_request_t *req)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    const rfid_step_t *step = &req->steps[req->step];
+    uint8_t len;
+
+    switch (step->op) {
+        case RFID_STEP_REQA:
+        case RFID_STEP_WUPA:
+            MFRC522_SetCRC(dev, 0, 0);
+            Write_MFRC522(dev, BitFramingReg, 0x07);
+            req->frame[0] = (step->op == RFID_STEP_WUPA) ? PICC_REQALL : PICC_REQIDL;
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->frame, 1);
+            break;
+
+        case RFID_STEP_ANTICOLL:
+            len = MFRC522_AnticollFrame(dev, req->sel, req->level, req->known);
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->sel, len);
+            break;
+
+        case RFID_STEP_SELECT:
+            len = MFRC522_SelectFrame(dev, req->sel);
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->sel, len);
+            break;
+
+        case RFID_STEP_AUTH:
+            req->frame[0] = PICC_AUTHENT1A;
+            req->frame[1] = step->block;
+            memcpy(&req->frame[2], step->key, KEY_LEN);
+            memcpy(&req->frame[8], req->uid, 4);
+            MFRC522_ToCardStart(dev, PCD_AUTHENT, req->frame, 12);
+            break;
+
+        case RFID_STEP_READ:
+        case RFID_STEP_WRITE:
+            req->frame[0] = (step->op == RFID_STEP_READ) ? PICC_READ : PICC_WRITE;
+            req->frame[1] = step->block;
+            len = MFRC522_AppendCRC(dev, req->frame, 2, step->op == RFID_STEP_READ);
+            MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, req->frame, len);
+            break;
+
+        case RFID_STEP_CHECK:
+            break;                              //без обмена, выполняется в RFID_poll
+    }
+}
+
+/*!
+ * \brief Проверка ответа карты на текущем шаге, те же критерии, что в блокирующих MFRC522_*
+ * \return MI_OK - шаг выполнен, MI_BUSY - шаг нужно повторить, иначе ошибка
+ */
+static uint8_t RFID_async_check(rfid_request_t *req, uint8_t status, uint bits)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    const rfid_step_t *step = &req->steps[req->step];
+    uint8_t len;
+
+    if (step->op == RFID_STEP_ANTICOLL)
+        return MFRC522_AnticollMerge(dev, req->sel, &req->known, status, req->frame, bits);
+
+    //ATQA нескольких карт приходит с коллизией - карты в поле есть
+    if ((step->op == RFID_STEP_REQA || step->op == RFID_STEP_WUPA) && status == MI_COLLISION)
+        return MI_OK;
+
+    if (status != MI_OK)
+        return (status == MI_NOTAGERR) ? MI_NOTAGERR : MI_ERR;
+
+    switch (step->op) {
+        case RFID_STEP_REQA:
+        case RFID_STEP_WUPA:
+            return (bits == 0x10) ? MI_OK : MI_ERR;
+
+        case RFID_STEP_ANTICOLL:
+            break;                              //разобран выше
+
+        case RFID_STEP_SELECT:
+            if ((MFRC522_CheckCRC(dev, req->frame, bits, &len) != MI_OK) || (len != 1))
+                return MI_ERR;
+            status = MFRC522_SelectDone(&req->card, req->sel, req->frame[0]);
+            if (status == MI_BUSY) {
+                //следующий уровень каскада - возврат к шагу ANTICOLL, без него в цепочке UID не получить
+                if (req->step == 0 || req->steps[req->step - 1].op != RFID_STEP_ANTICOLL)
+                    return MI_ERR;
+                req->level++;
+                req->known = 0;
+                req->step--;
+            } else if (status == MI_OK) {
+                MFRC522_UidAuthBytes(&req->card, req->uid);
+            }
+            return status;
+
+        case RFID_STEP_AUTH:
+            return (Read_MFRC522(dev, Status2Reg) & 0x08) ? MI_OK : MI_ERR;
+
+        case RFID_STEP_READ:
+            if ((MFRC522_CheckCRC(dev, req->frame, bits, &len) != MI_OK) || (len != 16))
+                return MI_ERR;
+            memcpy(step->data, req->frame, 16);
+            return MI_OK;
+
+        case RFID_STEP_WRITE:
+            return ((bits == 4) && ((req->frame[0] & 0x0F) == 0x0A)) ? MI_OK : MI_ERR;
+
+        case RFID_STEP_CHECK:
+            break;
+    }
+    return MI_ERR;
+}
+
+static void RFID_async_finish(rfid_request_t *req, uint8_t status)
+{
+    req->status = status;
+    //карта, не ответившая на REQA, не выбрана - HALT ей не нужен
+    if (req->halt && !(status != MI_OK && req->failed_step == 0)) {
+        req->phase = RFID_PHASE_HALT;
+        return;
+    }
+    rfid_active = NULL;
+    if (req->callback)
+        req->callback(req);
+}
@@ -0,0 +1,101 @@
+#include "include.h"
+
+static int8_t RFID_cache_find(const rfid_uid_t *card);
+
+/*!
+ * \brief Результат проверки одной карты
+ */
+static struct
+{
+    rfid_uid_t card;                            // size == 0 - запись свободна
+    uint8_t result;                             // MI_OK - допущена, иначе отказ
+    uint32_t expires;                           // HAL_GetTick, после которого запись недействительна
+    uint32_t used;                              // HAL_GetTick последнего обращения, для вытеснения
+} cache[RFID_CACHE_SIZE];
+
+static rfid_cache_stats_t cache_stats;
+
+void RFID_cache_clear(void)
+{
+    for (uint8_t i = 0; i < RFID_CACHE_SIZE; i++)
+        cache[i].card.size = 0;
+}
+
+/*!
+ * \brief Результат недавней проверки карты
+ * \param[out] result - сохраненный результат RFID_cache_put
+ * \return MI_OK - есть действующая запись, MI_ERR - карту нужно проверить заново
+ */
+uint8_t RFID_cache_get(const rfid_uid_t *card, uint8_t *result)
+{
+    uint32_t now = HAL_GetTick();
+    int8_t i = RFID_cache_find(card);
+
+    if (i < 0) {
+        cache_stats.misses++;
+        return MI_ERR;
+    }
+    if ((int32_t)(now - cache[i].expires) >= 0) {
+        cache[i].card.size = 0;
+        cache_stats.expired++;
+        cache_stats.misses++;
+        return MI_ERR;
+    }
+    cache[i].used = now;
+    *result = cache[i].result;
+    cache_stats.hits++;
+    return MI_OK;
+}
+
+/*!
+ * \brief Сохранение результата проверки на RFID_CACHE_TTL_MS
+ * \details Новая карта занимает свободную или просроченную запись, иначе - давно не предъявленную
+ */
+void RFID_cache_put(const rfid_uid_t *card, uint8_t result)
+{
+    uint32_t now = HAL_GetTick();
+    int8_t i = RFID_cache_find(card);
+
+    if (i < 0) {
+        i = 0;
+        for (uint8_t j = 0; j < RFID_CACHE_SIZE; j++) {
+            if (cache[j].card.size == 0 || (int32_t)(now - cache[j].expires) >= 0) {
+                i = j;
+                break;
+            }
+            if ((now - cache[j].used) > (now - cache[i].used))
+                i = j;
+        }
+        if (cache[i].card.size != 0 && (int32_t)(now - cache[i].expires) < 0)
+            cache_stats.evictions++;
+        cache[i].card = *card;
+    }
+    cache[i].result = result;
+    cache[i].expires = now + RFID_CACHE_TTL_MS;
+    cache[i].used = now;
+}
+
+/*!
+ * \brief Удаление карты из кэша: изъятие, перезапись пропуска на карте
+ */
+void RFID_cache_invalidate(const rfid_uid_t *card)
+{
+    int8_t i = RFID_cache_find(card);
+
+    if (i >= 0)
+        cache[i].card.size = 0;
+}
+
+const rfid_cache_stats_t *RFID_cache_stats(void)
+{
+    return &cache_stats;
+}
+
+static int8_t RFID_cache_find(const rfid_uid_t *card)
+{
+    for (uint8_t i = 0; i < RFID_CACHE_SIZE; i++) {
+        if (cache[i].card.size != 0 && cache[i].card.size == card->size && !memcmp(cache[i].card.bytes, card->bytes, card->size))
+            return i;
+    }
+    return -1;
+}
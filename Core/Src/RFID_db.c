@@ -0,0 +1,181 @@
+#include "include.h"
+#include "crc32_software.h"
+#include "flash_hal.h"
+
+#define db_header   ((const rfid_db_header_t *)(uintptr_t)RFID_DB_ADDR)
+#define db_recs     ((const rfid_db_rec_t *)(uintptr_t)(RFID_DB_ADDR + sizeof(rfid_db_header_t)))
+
+static uint8_t RFID_db_valid(const rfid_db_header_t *header);
+
+static struct
+{
+    uint32_t count;                             // записей действующей базы, 0 - база пуста или повреждена
+    uint32_t generation;
+    uint8_t writing;                            // идет загрузка RFID_db_write_*
+    rfid_db_header_t pending;                   // заголовок загружаемого образа, пишется в flash последним
+} db;
+
+/*!
+ * \brief Проверка базы в flash при запуске: заголовок, число записей и CRC32
+ * \details Пустая или поврежденная база - ни одной карты (RFID_db_count() == 0)
+ */
+void RFID_db_init(void)
+{
+    crc32sftwr_init();
+    db.writing = 0;
+    db.count = 0;
+    db.generation = 0;
+    if (RFID_db_valid(db_header)) {
+        db.count = db_header->count;
+        db.generation = db_header->generation;
+    }
+}
+
+uint32_t RFID_db_count(void)
+{
+    return db.count;
+}
+
+uint32_t RFID_db_generation(void)
+{
+    return db.generation;
+}
+
+/*!
+ * \brief Ключ сортировки записи: CRC32 длины UID и всех его байт
+ */
+uint32_t RFID_db_hash(const rfid_uid_t *card)
+{
+    uint8_t buf[1 + UID_MAX_LEN];
+
+    buf[0] = card->size;
+    memcpy(&buf[1], card->bytes, card->size);
+    return crc32_sftwr(0, buf, 1 + card->size);
+}
+
+/*!
+ * \brief Поиск карты по UID без обмена с картой
+ * \details Интерполяционный поиск по hash прямо в flash: ключи CRC32 распределены равномерно,
+ * позиция угадывается за 2-3 чтения. После RFID_DB_INTERP_PROBES шагов - деление пополам.
+ * \param[out] attr - атрибуты найденной карты (RFID_DB_ATTR_*)
+ * \return MI_OK - карта в базе, MI_ERR - нет
+ */
+uint8_t RFID_db_lookup(const rfid_uid_t *card, uint8_t *attr)
+{
+    const rfid_db_rec_t *rec = db_recs;
+    uint8_t uid[RFID_DB_UID_LEN] = {0};
+    int32_t lo = 0, hi = (int32_t)db.count - 1, pos;
+    uint32_t key;
+    uint8_t probes = 0;
+
+    if (db.count == 0 || db.writing)
+        return MI_ERR;
+
+    key = RFID_db_hash(card);
+    memcpy(uid, card->bytes, MIN(card->size, RFID_DB_UID_LEN));
+
+    while (lo <= hi) {
+        if (key < rec[lo].hash || key > rec[hi].hash)
+            return MI_ERR;
+        if (probes++ < RFID_DB_INTERP_PROBES && rec[hi].hash != rec[lo].hash)
+            pos = lo + (int32_t)((float)(key - rec[lo].hash) / (float)(rec[hi].hash - rec[lo].hash) * (hi - lo));
+        else
+            pos = lo + (hi - lo) / 2;
+        pos = MIN(MAX(pos, lo), hi);
+
+        if (rec[pos].hash < key) {
+            lo = pos + 1;
+        } else if (rec[pos].hash > key) {
+            hi = pos - 1;
+        } else {
+            //одинаковый hash у разных UID - соседние записи, сверяем UID
+            while (pos > 0 && rec[pos - 1].hash == key)
+                pos--;
+            for (; pos < (int32_t)db.count && rec[pos].hash == key; pos++) {
+                if (!memcmp(rec[pos].uid, uid, RFID_DB_UID_LEN)) {
+                    *attr = rec[pos].attr;
+                    return MI_OK;
+                }
+            }
+            return MI_ERR;
+        }
+    }
+    return MI_ERR;
+}
+
+/*!
+ * \brief Начало загрузки новой базы: сектор стирается, до RFID_db_write_end база пуста
+ * \details Стирание сектора 128 КБ занимает 1-2 с, главный цикл на это время стоит
+ */
+uint8_t RFID_db_write_begin(void)
+{
+    db.count = 0;
+    db.writing = 1;
+    memset(&db.pending, 0xFF, sizeof(db.pending));
+    if (flash_erase(RFID_DB_ADDR, 1) != 0xFFFFFFFFU) {
+        db.writing = 0;
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief Часть образа базы (формат - RFID_db.h) со смещения offset от начала образа
+ * \details offset и len кратны 4. Заголовок запоминается и пишется в RFID_db_write_end.
+ */
+uint8_t RFID_db_write(uint32_t offset, const void *data, uint32_t len)
+{
+    const uint8_t *src = data;
+    uint32_t addr, head;
+
+    if (!db.writing || (offset % 4) || (len % 4) || offset + len > RFID_DB_SIZE)
+        return MI_ERR;
+
+    if (offset < sizeof(rfid_db_header_t)) {
+        head = MIN(len, sizeof(rfid_db_header_t) - offset);
+        memcpy((uint8_t *)&db.pending + offset, src, head);
+        offset += head;
+        src += head;
+        len -= head;
+    }
+    if (len == 0)
+        return MI_OK;
+
+    addr = RFID_DB_ADDR + offset;
+    return (flash_write(&addr, (void *)src, len) == FLSH_ERROR_NONE) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Завершение загрузки: проверка записей в flash, запись заголовка, переход на новую базу
+ * \details Прерванная загрузка оставляет сектор без заголовка - база пуста, а не частична
+ */
+uint8_t RFID_db_write_end(void)
+{
+    uint32_t addr = RFID_DB_ADDR;
+
+    if (!db.writing)
+        return MI_ERR;
+    db.writing = 0;
+
+    if (!RFID_db_valid(&db.pending))
+        return MI_ERR;
+    for (uint32_t i = 1; i < db.pending.count; i++) {
+        if (db_recs[i - 1].hash > db_recs[i].hash)
+            return MI_ERR;
+    }
+    if (flash_write(&addr, &db.pending, sizeof(db.pending)) != FLSH_ERROR_NONE)
+        return MI_ERR;
+
+    RFID_db_init();
+    return (db.count == db.pending.count) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Заголовок header описывает записи, лежащие в flash: магическое число, размер, CRC32
+ */
+static uint8_t RFID_db_valid(const rfid_db_header_t *header)
+{
+    if (header->magic != RFID_DB_MAGIC || header->count == 0 || header->count > RFID_DB_MAX)
+        return 0;
+    return crc32_sftwr(0, (const uint8_t *)db_recs, header->count * sizeof(rfid_db_rec_t)) == header->crc;
+}
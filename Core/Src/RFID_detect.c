@@ -0,0 +1,253 @@
+#include "include.h"
+
+typedef enum {
+    RFID_DET_FULL,          // поле включено, цепочки разрешены
+    RFID_DET_CHECK,         // WUPA: нет ли в поле карт в HALT перед выключением
+    RFID_DET_SLEEP,         // RC522 в PowerDown, ждем следующего зонда
+    RFID_DET_BURST,         // поле включено, карта запускается
+    RFID_DET_PROBE          // REQA зонда
+} rfid_det_state_t;
+
+static void RFID_detect_done(rfid_request_t *req);
+static void RFID_detect_full(uint32_t now);
+static void RFID_detect_sleep(uint32_t now);
+static void RFID_detect_field(uint8_t probe);
+
+// Ответившая карта остается в READY, HALT возвращает ее в IDLE - ее сразу найдет REQA RFID_presence
+static const rfid_step_t det_probe_steps[] = {
+    {RFID_STEP_REQA, 0, NULL, NULL},
+};
+
+// Прочитанная замком карта в HALT на REQA не отвечает, WUPA будит ее, HALT возвращает обратно
+static const rfid_step_t det_check_steps[] = {
+    {RFID_STEP_WUPA, 0, NULL, NULL},
+};
+
+void RFID_detect_init(void)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    det->req.count = 1;
+    det->req.halt = 1;
+    det->req.callback = RFID_detect_done;
+    det->req.ctx = det;
+    det->policy.interval_ms = RFID_DET_INTERVAL_MS;
+    det->policy.burst_ms = RFID_DET_BURST_MS;
+    det->policy.gain = RFID_DET_GAIN;
+    det->policy.hold_ms = RFID_DET_HOLD_MS;
+    det->enabled = 1;
+    RFID_detect_full(HAL_GetTick());
+}
+
+/*!
+ * \brief Включение режима пониженного потребления, 0 - поле включено всегда
+ */
+void RFID_detect_enable(uint8_t enable)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    det->enabled = enable;
+    if (!enable)
+        RFID_detect_wake();
+}
+
+/*!
+ * \brief Новая политика, действует со следующего зонда
+ * \details interval_ms меньше burst_ms - зонд сразу за зондом
+ */
+void RFID_detect_set_policy(const rfid_detect_policy_t *policy)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    det->policy = *policy;
+    det->policy.gain &= 0x07;
+}
+
+const rfid_detect_policy_t *RFID_detect_policy(void)
+{
+    return &rfid.reader->detect.policy;
+}
+
+const rfid_detect_stats_t *RFID_detect_stats(void)
+{
+    return &rfid.reader->detect.stats;
+}
+
+/*!
+ * \brief Разрешены ли обмены с картой: поле включено и RC522 не в PowerDown
+ */
+uint8_t RFID_detect_active(void)
+{
+    return rfid.reader->detect.state == RFID_DET_FULL;
+}
+
+/*!
+ * \brief Немедленный переход в полный режим, например перед инвентаризацией или блокирующим чтением
+ * \return 1 - поле было выключено и карте нужно RFID_DET_BURST_MS на запуск
+ */
+uint8_t RFID_detect_wake(void)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+    uint32_t now = HAL_GetTick();
+
+    switch (det->state) {
+        case RFID_DET_FULL:
+            det->since = now;
+            return 0;
+
+        case RFID_DET_CHECK:
+        case RFID_DET_PROBE:
+            det->wake = 1;                      //своя цепочка еще идет - переход по ее завершении
+            return 0;
+
+        case RFID_DET_SLEEP:
+            MFRC522_PowerDown(rfid.reader->dev, 0);
+            RFID_detect_field(0);
+            RFID_detect_full(now);
+            return 1;
+
+        case RFID_DET_BURST:
+            RFID_detect_field(0);
+            RFID_detect_full(now);
+            return 0;
+    }
+    return 0;
+}
+
+/*!
+ * \brief Карта в поле успела запуститься: полный режим, поле включено не меньше burst_ms
+ * \details Срок проверяется при каждом вызове, вместо ожидания вызывающий повторяет обмен позже
+ */
+uint8_t RFID_detect_powered(void)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    return det->state == RFID_DET_FULL && (HAL_GetTick() - det->field_on) >= det->policy.burst_ms;
+}
+
+/*!
+ * \brief RC522 переинициализирован надзором: поле включено, таймер и усиление по умолчанию
+ */
+void RFID_detect_reinit(void)
+{
+    uint32_t now = HAL_GetTick();
+
+    rfid.reader->detect.field_on = now;         //MFRC522_Init включает поле
+    RFID_detect_full(now);
+}
+
+/*!
+ * \brief Задача обнаружения, вызывается из главного цикла до задач, запускающих цепочки
+ */
+void RFID_detect_task(void)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    rfid_detect_t *det = &rfid.reader->detect;
+    uint32_t now = HAL_GetTick();
+    uint32_t answers;
+    uint8_t ok;
+
+    switch (det->state) {
+        case RFID_DET_FULL:
+            answers = MFRC522_Answers(dev);
+            if (answers != det->answers || rfid.reader->session.selected || RFID_inventory_busy()) {
+                det->answers = answers;
+                det->since = now;
+                break;
+            }
+            if (!det->enabled || (now - det->since) < det->policy.hold_ms || RFID_busy())
+                break;
+            det->req.steps = det_check_steps;
+            det->ready = 0;
+            if (RFID_submit(&det->req) == MI_OK)
+                det->state = RFID_DET_CHECK;
+            break;
+
+        case RFID_DET_SLEEP:
+            if ((now - det->since) + det->policy.burst_ms < det->policy.interval_ms)
+                break;
+            MFRC522_PowerDown(dev, 0);
+            RFID_detect_field(1);
+            det->since = now;
+            det->state = RFID_DET_BURST;
+            break;
+
+        case RFID_DET_BURST:
+            if ((now - det->since) < det->policy.burst_ms)
+                break;
+            det->req.steps = det_probe_steps;
+            det->ready = 0;
+            if (RFID_submit(&det->req) == MI_OK) {
+                det->stats.probes++;
+                det->state = RFID_DET_PROBE;
+            }
+            break;
+
+        case RFID_DET_CHECK:
+        case RFID_DET_PROBE:
+            if (!det->ready)
+                break;
+            //коллизию ATQA цепочка считает успехом - в поле несколько карт
+            ok = (det->req.status == MI_OK) || det->wake;
+            if (det->state == RFID_DET_PROBE) {
+                RFID_detect_field(0);
+                if (ok)
+                    det->stats.wakes++;
+            }
+            if (ok)
+                RFID_detect_full(now);
+            else
+                RFID_detect_sleep(now);
+            break;
+    }
+}
+
+static void RFID_detect_done(rfid_request_t *req)
+{
+    ((rfid_detect_t *)req->ctx)->ready = 1;
+}
+
+static void RFID_detect_full(uint32_t now)
+{
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    det->state = RFID_DET_FULL;
+    det->wake = 0;
+    det->since = now;
+    det->answers = MFRC522_Answers(rfid.reader->dev);
+}
+
+static void RFID_detect_sleep(uint32_t now)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    if (det->state != RFID_DET_PROBE)
+        det->stats.sleeps++;
+    AntennaOff(dev);
+    MFRC522_PowerDown(dev, 1);
+    det->state = RFID_DET_SLEEP;
+    det->since = now;
+}
+
+/*!
+ * \brief Поле на зонд: включение с усилением политики, 0 - режим по умолчанию
+ * \details Граница ожидания ATQA короткая и так - профиль RC522_TMO_REQA
+ */
+static void RFID_detect_field(uint8_t probe)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    rfid_detect_t *det = &rfid.reader->detect;
+
+    if (probe) {
+        Write_MFRC522(dev, RFCfgReg, (det->policy.gain << 4) | 0x08);
+        AntennaOn(dev);
+        det->field_on = HAL_GetTick();
+    } else {
+        Write_MFRC522(dev, RFCfgReg, 0x48);     //RxGain 33 дБ, как после сброса
+        if (det->state == RFID_DET_SLEEP) {
+            AntennaOn(dev);
+            det->field_on = HAL_GetTick();
+        }
+    }
+}
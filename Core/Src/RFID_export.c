@@ -0,0 +1,231 @@
+#include "include.h"
+#include "tl_protocol.h"
+
+#define EXPORT_HEADER           16
+#define EXPORT_REC_MAX          (1 + 5 + 5 + 5 + 5 + 1 + UID_MAX_LEN)
+#define EXPORT_LAST             0x01
+#define EXPORT_SEQ_GAP          0x01
+#define EXPORT_NEW_BOOT         0x02
+
+static void RFID_export_seek(uint32_t seq);
+static uint16_t RFID_export_fill(void);
+static uint8_t *RFID_export_rec(uint8_t *p, const rfid_log_rec_t *rec);
+static uint8_t *RFID_export_var(uint8_t *p, uint32_t v);
+static uint8_t *RFID_export_put32(uint8_t *p, uint32_t v);
+
+static tl_object_t export_tl;
+static uint8_t export_rx[8];
+static uint8_t export_chunk[RFID_EXPORT_CHUNK];
+
+static struct
+{
+    uint8_t start;                              // принят запрос, выгрузка начнется вне цепочки обмена
+    uint32_t since;                             // seq из запроса
+    uint8_t more;                               // выгрузка идет: после передачи - следующая
+    uint8_t sending;                            // tl_send передает export_chunk
+    uint8_t result;                             // итог последней передачи: MI_OK или MI_ERR - потеря связи
+    uint8_t have;                               // в rec - следующая запись для передачи
+    rfid_log_iter_t it;
+    rfid_log_rec_t rec;
+    uint32_t seq;                               // поля предыдущей записи в передаче
+    uint16_t boot;
+    uint32_t time;
+    uint8_t recent[RFID_EXPORT_RECENT][1 + UID_MAX_LEN];  // длина и UID, 0 - пусто
+} export_state;
+
+/*!
+ * \brief Служба выгрузки журнала на интерфейсе socket (UART2)
+ */
+void RFID_export_init(int socket)
+{
+    tl_init(&export_tl, socket, RFID_EXPORT_REPEAT_MS, RFID_EXPORT_RESET_MS);
+    tl_set_rx_file(&export_tl, export_rx, sizeof(export_rx));
+    memset(&export_state, 0, sizeof(export_state));
+    export_state.result = MI_OK;
+}
+
+/*!
+ * \brief Прием запросов и выгрузка журнала, вызывается из главного цикла
+ * \details Передачи идут одна за другой без запросов: скорость ограничена линией и подтверждениями
+ * пакетов tl, а не обменом на каждую запись. Потеря связи завершает выгрузку, продолжение -
+ * новым запросом с seq, следующим за последней полученной записью. Запрос во время цепочки
+ * обмена с картой ждет ее конца: запись в flash и стирание сектора остановили бы цепочку.
+ */
+void RFID_export_task(void)
+{
+    tl_process_t status = tl_task(&export_tl);
+
+    if (export_state.sending) {
+        if (status == TL_PROCESS_END) {
+            export_state.sending = 0;
+            export_state.result = MI_OK;
+        } else if (status == TL_LOST_CONNECT || status == TL_PROCESS_END_MEM) {
+            export_state.sending = 0;
+            export_state.more = 0;
+            export_state.result = MI_ERR;
+        }
+    } else if (status == TL_PROCESS_END) {
+        if (tl_get_rx_msg_size(&export_tl) >= 5 && export_rx[0] == RFID_EXPORT_CMD_LOG) {
+            export_state.since = export_rx[1] | (export_rx[2] << 8) | (export_rx[3] << 16) | ((uint32_t)export_rx[4] << 24);
+            export_state.start = 1;
+        }
+        tl_reset_rx_msg_size(&export_tl);
+    }
+
+    if (export_state.start && !export_state.sending && !RFID_busy()) {
+        //выгружается и то, что еще ждет записи в RAM
+        RFID_log_flush();
+        RFID_export_seek(export_state.since);
+        export_state.start = 0;
+        export_state.more = 1;
+    }
+
+    if (export_state.more && !export_state.sending && !tl_busy_status(&export_tl)) {
+        tl_send(&export_tl, export_chunk, RFID_export_fill());
+        export_state.sending = 1;
+        export_state.more = export_state.have;
+    }
+}
+
+/*!
+ * \brief Передача части данных другой службы (образ карты, трассировка) тем же каналом tl
+ * \details Данные копируются, буфер вызывающего свободен сразу. Следующую часть имеет смысл
+ * готовить, когда RFID_export_sent перестанет возвращать MI_BUSY: так в буфер UART попадает
+ * только то, что приемник подтвердил пакетами tl, и темп задает линия.
+ * \param[in] magic - тип данных, первый байт передачи
+ * \param[in] last - последняя часть: флаг в заголовке передачи
+ * \return MI_OK - передача начата, MI_BUSY - канал занят выгрузкой журнала или предыдущей частью,
+ * MI_ERR - часть длиннее RFID_EXPORT_PART
+ */
+uint8_t RFID_export_send(uint8_t magic, uint8_t last, const uint8_t *data, uint16_t len)
+{
+    if (len > RFID_EXPORT_PART)
+        return MI_ERR;
+    if (export_state.start || export_state.more || export_state.sending || tl_busy_status(&export_tl))
+        return MI_BUSY;
+
+    export_chunk[0] = magic;
+    export_chunk[1] = last ? EXPORT_LAST : 0;
+    memcpy(&export_chunk[2], data, len);
+    tl_send(&export_tl, export_chunk, len + 2);
+    export_state.sending = 1;
+    return MI_OK;
+}
+
+/*!
+ * \brief Итог последней передачи канала
+ * \return MI_BUSY - передача идет, MI_OK - приемник подтвердил передачу, MI_ERR - связь потеряна
+ */
+uint8_t RFID_export_sent(void)
+{
+    return export_state.sending ? MI_BUSY : export_state.result;
+}
+
+/*!
+ * \brief Переход к первой записи с номером не меньше seq
+ */
+static void RFID_export_seek(uint32_t seq)
+{
+    RFID_log_rewind(&export_state.it);
+    do {
+        export_state.have = (RFID_log_next(&export_state.it, &export_state.rec) == MI_OK);
+    } while (export_state.have && export_state.rec.seq < seq);
+}
+
+/*!
+ * \brief Следующая передача: заголовок и записи, пока в буфере есть место на запись наибольшей длины
+ * \return длина передачи
+ */
+static uint16_t RFID_export_fill(void)
+{
+    uint8_t *p = &export_chunk[EXPORT_HEADER];
+    uint16_t count = 0;
+
+    memset(export_chunk, 0, EXPORT_HEADER);
+    memset(export_state.recent, 0, sizeof(export_state.recent));
+    if (export_state.have) {
+        export_state.seq = export_state.rec.seq - 1;
+        export_state.boot = export_state.rec.boot;
+        export_state.time = export_state.rec.time;
+        export_chunk[6] = export_state.boot;
+        export_chunk[7] = export_state.boot >> 8;
+        RFID_export_put32(&export_chunk[8], export_state.rec.seq);
+        RFID_export_put32(&export_chunk[12], export_state.rec.time);
+    }
+    while (export_state.have && (p - export_chunk) <= RFID_EXPORT_CHUNK - EXPORT_REC_MAX) {
+        p = RFID_export_rec(p, &export_state.rec);
+        count++;
+        export_state.have = (RFID_log_next(&export_state.it, &export_state.rec) == MI_OK);
+    }
+
+    export_chunk[0] = RFID_EXPORT_MAGIC;
+    export_chunk[1] = RFID_EXPORT_VERSION;
+    export_chunk[2] = export_state.have ? 0 : EXPORT_LAST;
+    export_chunk[4] = count;
+    export_chunk[5] = count >> 8;
+    return p - export_chunk;
+}
+
+/*!
+ * \brief Запись разностью с предыдущей, формат - RFID_export.h
+ */
+static uint8_t *RFID_export_rec(uint8_t *p, const rfid_log_rec_t *rec)
+{
+    uint8_t *head = p++;
+    uint8_t uid[1 + UID_MAX_LEN] = {0};
+    uint8_t i;
+
+    *head = ((rec->decision & 0x03) << 2) | ((rec->source & 0x03) << 4) | ((rec->reader & 0x03) << 6);
+    if (rec->seq != export_state.seq + 1) {
+        *head |= EXPORT_SEQ_GAP;
+        p = RFID_export_var(p, rec->seq - export_state.seq - 1);
+    }
+    if (rec->boot != export_state.boot) {
+        *head |= EXPORT_NEW_BOOT;
+        p = RFID_export_var(p, rec->boot);
+        p = RFID_export_var(p, rec->time);
+    } else {
+        p = RFID_export_var(p, rec->time - export_state.time);
+    }
+    p = RFID_export_var(p, rec->latency_us);
+
+    //недавний UID - одним байтом, найденный или новый переносится в начало списка
+    uid[0] = MIN(rec->uid_size, UID_MAX_LEN);
+    memcpy(&uid[1], rec->uid, uid[0]);
+    for (i = 0; i < RFID_EXPORT_RECENT - 1; i++) {
+        if (!memcmp(export_state.recent[i], uid, sizeof(uid)))
+            break;
+    }
+    if (!memcmp(export_state.recent[i], uid, sizeof(uid))) {
+        *p++ = 0x80 | i;
+    } else {
+        memcpy(p, uid, 1 + uid[0]);
+        p += 1 + uid[0];
+    }
+    memmove(export_state.recent[1], export_state.recent[0], i * sizeof(uid));
+    memcpy(export_state.recent[0], uid, sizeof(uid));
+
+    export_state.seq = rec->seq;
+    export_state.boot = rec->boot;
+    export_state.time = rec->time;
+    return p;
+}
+
+static uint8_t *RFID_export_var(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static uint8_t *RFID_export_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
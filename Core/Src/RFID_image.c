@@ -0,0 +1,364 @@
+#include "include.h"
+#include "crc32_software.h"
+
+static uint8_t RFID_image_auth(uint8_t sector, rfid_key_table_t *table);
+static uint8_t RFID_image_reselect(void);
+static uint8_t RFID_image_wait(uint8_t *frame, uint *bits);
+static uint8_t RFID_image_ack(uint8_t *frame);
+static uint8_t RFID_image_write_block(uint8_t block, const uint8_t *src, uint8_t *cmd, uint8_t *data);
+static uint8_t RFID_image_header(void);
+static uint8_t RFID_image_sector(uint8_t s);
+static void RFID_image_emit(const void *buf, uint16_t len);
+
+// Чтение образа: часть - заголовок или сектор, у последнего сектора с битовой картой и CRC32
+static struct
+{
+    rfid_key_table_t *table;
+    uint8_t result;                             // MI_BUSY - чтение идет
+    uint8_t reader;
+    uint8_t sectors;                            // 0 - карта еще не выбрана
+    uint8_t sector;                             // следующий сектор
+    uint8_t sent;                               // часть уже уходила: RFID_export_sent относится к ней
+    uint8_t done[(RFID_IMAGE_MAX_SECTORS + 7) / 8];
+    uint32_t crc;
+    uint16_t len;                               // ждет передачи, 0 - буфер свободен
+    uint8_t buf[RFID_IMAGE_PART];
+} image = {.result = MI_OK};
+
+void RFID_image_init(void)
+{
+    crc32sftwr_init();
+}
+
+/*!
+ * \brief Таблица с ключом по умолчанию 0xFFFFFFFFFFFF, ключи секторов не известны
+ */
+void RFID_key_table_init(rfid_key_table_t *table)
+{
+    memset(table->keys[0], 0xFF, KEY_LEN);
+    table->count = 1;
+    memset(table->sector_key, RFID_IMAGE_KEY_UNKNOWN, sizeof(table->sector_key));
+}
+
+/*!
+ * \brief Число секторов карты по SAK, 0 - не MIFARE Classic
+ */
+uint8_t RFID_image_sectors(uint8_t sak)
+{
+    switch (sak & 0x7F) {
+        case 0x09: return 5;                    // MIFARE Mini
+        case 0x08:
+        case 0x88: return 16;                   // MIFARE Classic 1K
+        case 0x18: return 40;                   // MIFARE Classic 4K
+    }
+    return 0;
+}
+
+/*!
+ * \brief Запуск чтения всей карты на текущем считывателе с передачей образа каналом RFID_export
+ * \details Чтение идет в RFID_image_task по сектору за вызов. Таблица ключей должна жить
+ * до конца чтения: подошедшие ключи запоминаются в ней.
+ * \return MI_OK - чтение начато, MI_ERR - предыдущее чтение еще идет
+ */
+uint8_t RFID_image_read(rfid_key_table_t *table)
+{
+    if (image.result == MI_BUSY)
+        return MI_ERR;
+
+    memset(&image, 0, sizeof(image));
+    image.table = table;
+    image.reader = rfid.reader->index;
+    image.result = MI_BUSY;
+    return MI_OK;
+}
+
+/*!
+ * \brief Итог чтения образа
+ * \return MI_BUSY - чтение идет, MI_OK - образ передан полностью, MI_NOTAGERR - карта потеряна,
+ * MI_ERR - ошибка обмена с картой или потеря связи с приемником (образ передан не полностью)
+ */
+uint8_t RFID_image_result(void)
+{
+    return image.result;
+}
+
+/*!
+ * \brief Шаг чтения образа, вызывается из главного цикла
+ * \details За вызов читается один сектор (до 16 блоков на 4K). Следующий сектор читается только
+ * после того, как приемник подтвердил предыдущую часть: в буфер UART не уходит больше, чем
+ * передает линия. Между секторами работают цепочки других задач, шаг ждет их конца,
+ * а сессию с картой после них восстанавливает RFID_session_auth.
+ */
+void RFID_image_task(void)
+{
+    uint8_t status;
+
+    if (image.result != MI_BUSY)
+        return;
+
+    if (image.len) {
+        status = RFID_export_send(RFID_IMAGE_MAGIC, image.sector == image.sectors, image.buf, image.len);
+        if (status == MI_OK)
+            image.len = 0;
+        else if (status == MI_ERR)
+            image.result = MI_ERR;
+        return;
+    }
+
+    status = RFID_export_sent();
+    if (status == MI_BUSY)
+        return;
+    if (image.sent && status != MI_OK) {
+        image.result = MI_ERR;
+        return;
+    }
+    if (image.sectors && image.sector == image.sectors) {
+        image.result = MI_OK;                   //последняя часть подтверждена
+        return;
+    }
+
+    if (RFID_busy() || RFID_inventory_busy() || RFID_reader_use(image.reader) != MI_OK)
+        return;
+
+    if (image.sectors == 0)
+        status = RFID_image_header();
+    else
+        status = RFID_image_sector(image.sector++);
+    if (status != MI_OK) {
+        image.result = status;
+        return;
+    }
+
+    if (image.sector == image.sectors) {
+        RFID_image_emit(image.done, sizeof(image.done));
+        image.buf[image.len++] = BYTE0(image.crc);
+        image.buf[image.len++] = BYTE1(image.crc);
+        image.buf[image.len++] = BYTE2(image.crc);
+        image.buf[image.len++] = BYTE3(image.crc);
+        RFID_close();
+    }
+    image.sent = 1;
+}
+
+/*!
+ * \brief Выбор карты и заголовок образа
+ */
+static uint8_t RFID_image_header(void)
+{
+    uint8_t header[4];
+
+    if (RFID_getUID(rfid.uid) != MI_OK)
+        return MI_NOTAGERR;
+
+    image.sectors = RFID_image_sectors(rfid.reader->card.sak);
+    if (image.sectors == 0) {
+        RFID_close();
+        return MI_ERR;
+    }
+
+    header[0] = 'M';
+    header[1] = 'F';
+    header[2] = image.sectors;
+    header[3] = rfid.reader->card.size;
+    RFID_image_emit(header, sizeof(header));
+    RFID_image_emit(rfid.reader->card.bytes, rfid.reader->card.size);
+    return MI_OK;
+}
+
+/*!
+ * \brief Чтение сектора в буфер части
+ * \details Кадр READ следующего блока уходит в эфир до обработки предыдущего:
+ * CRC32 и копирование в буфер выполняются, пока карта отвечает.
+ */
+static uint8_t RFID_image_sector(uint8_t s)
+{
+    static const uint8_t zero[MAX_LEN] = {0};
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t frame[MAX_FRAME_LEN];
+    uint8_t block[MAX_LEN];
+    uint8_t first = RFID_sector_first_block(s);
+    uint8_t count = RFID_sector_blocks(s);
+    uint8_t pending = 0;
+    uint8_t len, status;
+    uint bits;
+
+    status = RFID_image_auth(s, image.table);
+    if (status == MI_NOTAGERR)
+        return MI_NOTAGERR;
+    if (status != MI_OK) {
+        for (uint8_t i = 0; i < count; i++)
+            RFID_image_emit(zero, MAX_LEN);
+        return MI_OK;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        frame[0] = PICC_READ;
+        frame[1] = first + i;
+        len = MFRC522_AppendCRC(dev, frame, 2, 1);
+        MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, frame, len);
+
+        if (pending)
+            RFID_image_emit(block, MAX_LEN);
+
+        status = RFID_image_wait(frame, &bits);
+        if ((status != MI_OK) || (MFRC522_CheckCRC(dev, frame, bits, &len) != MI_OK) || (len != MAX_LEN)) {
+            RFID_session_reset();
+            return MI_ERR;
+        }
+        memcpy(block, frame, MAX_LEN);
+        pending = 1;
+    }
+    RFID_image_emit(block, MAX_LEN);
+    image.done[s / 8] |= 1 << (s % 8);
+    return MI_OK;
+}
+
+/*!
+ * \brief Запись образа на карту
+ * \param[in] image - блоки 0..N-1 по 16 байт в порядке адресов, блок 0 не записывается
+ * \param[in] flags - RFID_IMAGE_WRITE_TRAILERS: трейлер пишется последним в секторе
+ * \return MI_OK - записаны все сектора, MI_ERR - часть секторов пропущена или ошибка обмена,
+ * MI_NOTAGERR - карта потеряна
+ */
+uint8_t RFID_image_write(const uint8_t *image, uint8_t sectors, rfid_key_table_t *table, uint8_t flags)
+{
+    uint8_t cmd[MAX_FRAME_LEN];
+    uint8_t data[MAX_FRAME_LEN];
+    uint8_t result = MI_OK;
+    uint8_t first, last, status;
+
+    if (RFID_getUID(rfid.uid) != MI_OK)
+        return MI_NOTAGERR;
+
+    if (sectors > RFID_image_sectors(rfid.reader->card.sak)) {
+        RFID_close();
+        return MI_ERR;
+    }
+
+    for (uint8_t s = 0; s < sectors; s++) {
+        first = RFID_sector_first_block(s);
+        last = first + RFID_sector_blocks(s) - 1;
+
+        status = RFID_image_auth(s, table);
+        if (status == MI_NOTAGERR)
+            return MI_NOTAGERR;
+        if (status != MI_OK) {
+            result = MI_ERR;
+            continue;
+        }
+
+        for (uint8_t b = first; b <= last; b++) {
+            if (b == 0)
+                continue;                       // блок производителя
+            if (b == last && !(flags & RFID_IMAGE_WRITE_TRAILERS))
+                continue;
+            if (RFID_image_write_block(b, image + (uint16_t)b * MAX_LEN, cmd, data) != MI_OK) {
+                RFID_session_reset();
+                return MI_ERR;
+            }
+        }
+
+        if (flags & RFID_IMAGE_WRITE_TRAILERS) {
+            //ключи сектора сменились - при следующей аутентификации ключ ищется заново
+            rfid.reader->session.sector = RFID_NO_SECTOR;
+            table->sector_key[s] = RFID_IMAGE_KEY_UNKNOWN;
+        }
+    }
+
+    RFID_close();
+    return result;
+}
+
+/*!
+ * \brief Аутентификация сектора ключом из таблицы
+ * \details Сначала пробуется запомненный ключ сектора, затем остальные. После неудачной
+ * аутентификации карта уходит в IDLE и выбирается заново.
+ * \return MI_OK, MI_ERR - ключ не найден, MI_NOTAGERR - карта потеряна
+ */
+static uint8_t RFID_image_auth(uint8_t sector, rfid_key_table_t *table)
+{
+    uint8_t block = RFID_sector_first_block(sector);
+    uint8_t known = table->sector_key[sector];
+
+    if (known < table->count) {
+        if (RFID_session_auth(block, table->keys[known], rfid.uid) == MI_OK)
+            return MI_OK;
+        if (RFID_image_reselect() != MI_OK)
+            return MI_NOTAGERR;
+    }
+
+    for (uint8_t k = 0; k < table->count; k++) {
+        if (k == known)
+            continue;
+        if (RFID_session_auth(block, table->keys[k], rfid.uid) == MI_OK) {
+            table->sector_key[sector] = k;
+            return MI_OK;
+        }
+        if (RFID_image_reselect() != MI_OK)
+            return MI_NOTAGERR;
+    }
+    return MI_ERR;
+}
+
+/*!
+ * \brief Повторный выбор той же карты
+ */
+static uint8_t RFID_image_reselect(void)
+{
+    rfid_uid_t card = rfid.reader->card;
+
+    if (RFID_getUID(rfid.uid) != MI_OK)
+        return MI_NOTAGERR;
+    if (card.size != rfid.reader->card.size || memcmp(card.bytes, rfid.reader->card.bytes, card.size))
+        return MI_NOTAGERR;                     // в поле уже другая карта
+    return MI_OK;
+}
+
+static uint8_t RFID_image_wait(uint8_t *frame, uint *bits)
+{
+    uint8_t status;
+
+    while ((status = MFRC522_ToCardPoll(rfid.reader->dev, frame, MAX_FRAME_LEN, bits)) == MI_BUSY)
+    {
+    }
+    return status;
+}
+
+static uint8_t RFID_image_ack(uint8_t *frame)
+{
+    uint bits;
+
+    if (RFID_image_wait(frame, &bits) != MI_OK)
+        return MI_ERR;
+    return ((bits == 4) && ((frame[0] & 0x0F) == 0x0A)) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Двухфазная запись блока: кадр данных готовится, пока в эфире команда WRITE
+ */
+static uint8_t RFID_image_write_block(uint8_t block, const uint8_t *src, uint8_t *cmd, uint8_t *data)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t len;
+
+    cmd[0] = PICC_WRITE;
+    cmd[1] = block;
+    len = MFRC522_AppendCRC(dev, cmd, 2, 0);
+    MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, cmd, len);
+
+    memcpy(data, src, MAX_LEN);
+    len = MFRC522_AppendCRC(dev, data, MAX_LEN, 0);
+
+    if (RFID_image_ack(cmd) != MI_OK)
+        return MI_ERR;
+
+    MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, data, len);
+    return RFID_image_ack(data);
+}
+
+static void RFID_image_emit(const void *buf, uint16_t len)
+{
+    image.crc = crc32_sftwr(image.crc, buf, len);
+    memcpy(&image.buf[image.len], buf, len);
+    image.len += len;
+}
@@ -0,0 +1,202 @@
+#include "include.h"
+
+static void RFID_inventory_done(rfid_request_t *req);
+static uint8_t RFID_inventory_insert(const rfid_uid_t *uid);
+static uint8_t RFID_inventory_hash(const rfid_uid_t *uid);
+static void RFID_inventory_finish(void);
+
+// Первый обмен прохода будит и карты, оставшиеся в HALT, дальше REQA поднимает только
+// еще не прочитанные: каждая выбранная карта сразу переводится в HALT
+static const rfid_step_t inv_first_steps[] = {
+    {RFID_STEP_WUPA,     0, NULL, NULL},
+    {RFID_STEP_ANTICOLL, 0, NULL, NULL},
+    {RFID_STEP_SELECT,   0, NULL, NULL},
+};
+
+static const rfid_step_t inv_next_steps[] = {
+    {RFID_STEP_REQA,     0, NULL, NULL},
+    {RFID_STEP_ANTICOLL, 0, NULL, NULL},
+    {RFID_STEP_SELECT,   0, NULL, NULL},
+};
+
+static rfid_request_t inv_req = {
+    .halt = 1,
+    .callback = RFID_inventory_done,
+};
+
+static struct
+{
+    rfid_inv_sink_t sink;
+    void *ctx;
+    uint8_t active;
+    uint8_t first;                              // следующий обмен - WUPA
+    uint8_t submitted;
+    volatile uint8_t ready;
+    uint8_t errors;
+    uint8_t count;
+    uint8_t overflow;                           // встречена карта сверх RFID_INV_MAX_CARDS
+    rfid_uid_t cards[RFID_INV_MAX_CARDS];
+    uint8_t slots[RFID_INV_SLOTS];              // номер карты + 1, 0 - свободно
+} inv;
+
+/*!
+ * \brief Запуск прохода инвентаризации
+ * \return MI_OK - запущен, MI_ERR - предыдущий проход еще идет
+ */
+uint8_t RFID_inventory_start(rfid_inv_sink_t sink, void *ctx)
+{
+    if (inv.active)
+        return MI_ERR;
+
+    inv.sink = sink;
+    inv.ctx = ctx;
+    inv.first = 1;
+    inv.submitted = 0;
+    inv.ready = 0;
+    inv.errors = 0;
+    inv.count = 0;
+    inv.overflow = 0;
+    memset(inv.slots, 0, sizeof(inv.slots));
+    inv.active = 1;
+    RFID_detect_wake();
+    return MI_OK;
+}
+
+uint8_t RFID_inventory_busy(void)
+{
+    return inv.active;
+}
+
+uint8_t RFID_inventory_count(void)
+{
+    return inv.count;
+}
+
+const rfid_uid_t *RFID_inventory_card(uint8_t index)
+{
+    return (index < inv.count) ? &inv.cards[index] : NULL;
+}
+
+/*!
+ * \brief Последний проход остановлен: в поле больше RFID_INV_MAX_CARDS карт
+ */
+uint8_t RFID_inventory_overflow(void)
+{
+    return inv.overflow;
+}
+
+/*!
+ * \brief Задача инвентаризации: по одной цепочке WUPA/REQA -> ANTICOLL -> SELECT -> HALT на карту
+ * \details Число обменов ограничено: карт + RFID_INV_MAX_ERRORS + 1 цепочка,
+ * на цепочку - не больше 33 кадров антиколлизии на уровень каскада.
+ */
+void RFID_inventory_task(void)
+{
+    if (!inv.active)
+        return;
+
+    if (inv.ready) {
+        inv.ready = 0;
+        inv.submitted = 0;
+
+        if (inv_req.status == MI_OK) {
+            inv.errors = 0;
+            if (RFID_inventory_insert(&inv_req.card) && inv.sink)
+                inv.sink(&inv.cards[inv.count - 1], inv.ctx);
+            if (inv.overflow) {
+                //повторы новой карты уже не проверить - проход завершается
+                RFID_inventory_finish();
+                return;
+            }
+        } else if (inv_req.failed_step == 0 && inv_req.status == MI_NOTAGERR) {
+            //на WUPA/REQA никто не ответил - все карты в поле уже прочитаны
+            RFID_inventory_finish();
+            return;
+        } else if (++inv.errors >= RFID_INV_MAX_ERRORS) {
+            RFID_inventory_finish();
+            return;
+        }
+    }
+
+    if (inv.submitted || RFID_busy())
+        return;
+
+    if (inv.first) {
+        inv_req.steps = inv_first_steps;
+        inv_req.count = ARRAY_SIZE(inv_first_steps);
+    } else {
+        inv_req.steps = inv_next_steps;
+        inv_req.count = ARRAY_SIZE(inv_next_steps);
+    }
+
+    if (RFID_submit(&inv_req) == MI_OK) {
+        inv.first = 0;
+        inv.submitted = 1;
+    }
+}
+
+/*!
+ * \brief Приемник по умолчанию: длина UID и сам UID в UART, по окончании - байт 0
+ * \details write только кладет данные в буфер передатчика и не ждет отправки
+ */
+void RFID_inventory_uart_sink(const rfid_uid_t *uid, void *ctx)
+{
+    uint8_t size = uid ? uid->size : 0;
+
+    (void)ctx;
+    write(sck_2, (char*)&size, 1);
+    if (uid)
+        write(sck_2, (char*)uid->bytes, uid->size);
+}
+
+static void RFID_inventory_done(rfid_request_t *req)
+{
+    (void)req;
+    inv.ready = 1;
+}
+
+static void RFID_inventory_finish(void)
+{
+    inv.active = 0;
+    if (inv.sink)
+        inv.sink(NULL, inv.ctx);
+}
+
+/*!
+ * \brief FNV-1a по байтам UID, свернутый до индекса ячейки
+ */
+static uint8_t RFID_inventory_hash(const rfid_uid_t *uid)
+{
+    uint32_t h = 2166136261u;
+
+    for (uint8_t i = 0; i < uid->size; i++) {
+        h ^= uid->bytes[i];
+        h *= 16777619u;
+    }
+    return (uint8_t)((h ^ (h >> 16)) & (RFID_INV_SLOTS - 1));
+}
+
+/*!
+ * \brief Добавление UID в множество прочитанных карт (открытая адресация, линейное пробирование)
+ * \return 1 - карта новая, 0 - уже была в этом проходе или множество заполнено (inv.overflow)
+ */
+static uint8_t RFID_inventory_insert(const rfid_uid_t *uid)
+{
+    uint8_t slot = RFID_inventory_hash(uid);
+    const rfid_uid_t *card;
+
+    while (inv.slots[slot]) {
+        card = &inv.cards[inv.slots[slot] - 1];
+        if (card->size == uid->size && !memcmp(card->bytes, uid->bytes, uid->size))
+            return 0;
+        slot = (slot + 1) & (RFID_INV_SLOTS - 1);
+    }
+    if (inv.count >= RFID_INV_MAX_CARDS) {
+        inv.overflow = 1;
+        return 0;
+    }
+
+    inv.cards[inv.count] = *uid;
+    inv.slots[slot] = ++inv.count;
+    return 1;
+}
@@ -0,0 +1,303 @@
+#include "include.h"
+#include "crc32_software.h"
+#include "flash_hal.h"
+
+#define log_addr(i)         ((uint32_t)(RFID_LOG_ADDR + (i) * RFID_LOG_SECTOR_SIZE))
+#define log_sector(i)       ((const rfid_log_sector_t *)(uintptr_t)log_addr(i))
+#define log_slot(i, slot)   ((const rfid_log_rec_t *)(uintptr_t)log_addr(i) + (slot))
+
+static uint8_t RFID_log_write(uint8_t n);
+static uint8_t RFID_log_rotate(void);
+static uint8_t RFID_log_last(uint8_t sector, rfid_log_rec_t *rec);
+static int8_t RFID_log_sector_after(uint32_t gen);
+static uint16_t RFID_log_first_blank(uint8_t sector);
+static uint8_t RFID_log_sector_valid(uint8_t sector);
+static uint8_t RFID_log_rec_valid(const rfid_log_rec_t *rec);
+static uint8_t RFID_log_blank(const rfid_log_rec_t *rec);
+
+static struct
+{
+    rfid_log_rec_t ram[RFID_LOG_RAM];           // кольцо записей, ждущих записи в flash
+    uint8_t head;                               // самая старая запись кольца
+    uint32_t last_event;                        // HAL_GetTick последнего события
+    int8_t active;                              // сектор записи
+    uint16_t slot;                              // первый свободный слот в нем
+    uint32_t gen;                               // gen сектора записи
+    rfid_log_stats_t stats;
+} rlog;
+
+/*!
+ * \brief Поиск места записи после запуска
+ * \details Текущий сектор - с наибольшим gen, место записи - первый стертый слот: записи идут
+ * подряд, и его находит деление пополам. Номера seq и boot продолжаются от последней целой записи.
+ */
+void RFID_log_init(void)
+{
+    rfid_log_rec_t last;
+    int8_t prev = -1;
+
+    crc32sftwr_init();
+    memset(&rlog, 0, sizeof(rlog));
+    rlog.active = -1;
+    for (uint8_t i = 0; i < RFID_LOG_SECTORS; i++) {
+        if (RFID_log_sector_valid(i) && (rlog.active < 0 || log_sector(i)->gen > rlog.gen)) {
+            rlog.active = i;
+            rlog.gen = log_sector(i)->gen;
+        }
+    }
+    if (rlog.active < 0) {
+        //журнала нет: первый запуск, стирание при загрузке допустимо
+        RFID_log_rotate();
+        return;
+    }
+    rlog.slot = RFID_log_first_blank(rlog.active);
+
+    for (uint8_t i = 0; i < RFID_LOG_SECTORS; i++) {
+        if (i != rlog.active && RFID_log_sector_valid(i) && log_sector(i)->gen < rlog.gen &&
+            (prev < 0 || log_sector(i)->gen > log_sector(prev)->gen))
+            prev = i;
+    }
+    if (RFID_log_last(rlog.active, &last) == MI_OK || (prev >= 0 && RFID_log_last(prev, &last) == MI_OK)) {
+        rlog.stats.seq = last.seq + 1;
+        rlog.stats.boot = last.boot + 1;
+    }
+}
+
+/*!
+ * \brief Событие в журнал: только копия в RAM, flash пишет RFID_log_task
+ * \details При переполнении RAM теряется самая старая запись (stats.dropped)
+ */
+void RFID_log_event(const rfid_uid_t *card, uint8_t decision, uint8_t source, uint8_t reader, uint32_t latency_us)
+{
+    rfid_log_rec_t *rec;
+
+    if (rlog.stats.pending == RFID_LOG_RAM) {
+        rlog.head = (rlog.head + 1) % RFID_LOG_RAM;
+        rlog.stats.pending--;
+        rlog.stats.dropped++;
+    }
+    rec = &rlog.ram[(rlog.head + rlog.stats.pending) % RFID_LOG_RAM];
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = rlog.stats.seq++;
+    rec->time = HAL_GetTick();
+    rec->uid_size = MIN(card->size, UID_MAX_LEN);
+    memcpy(rec->uid, card->bytes, rec->uid_size);
+    rec->decision = decision;
+    rec->reader = reader;
+    rec->source = source;
+    rec->boot = rlog.stats.boot;
+    rec->latency_us = latency_us;
+    rlog.stats.pending++;
+    rlog.last_event = rec->time;
+}
+
+/*!
+ * \brief Запись журнала в flash из главного цикла, между цепочками обменов с картами
+ * \details Полный пакет RFID_LOG_BATCH пишется сразу, неполный - после RFID_LOG_FLUSH_MS без событий.
+ * Сектор заполнен на 7/8 - следующий по кругу стирается в паузе RFID_LOG_IDLE_MS без карт,
+ * заполнен целиком и RAM почти полна - стирается сразу: потерять события хуже, чем задержать проход.
+ */
+void RFID_log_task(void)
+{
+    uint32_t idle = HAL_GetTick() - rlog.last_event;
+    uint8_t n;
+
+    if (RFID_busy())
+        return;
+
+    if ((rlog.slot >= RFID_LOG_SLOTS - RFID_LOG_SLOTS / 8 && idle >= RFID_LOG_IDLE_MS) ||
+        (rlog.slot >= RFID_LOG_SLOTS && rlog.stats.pending > RFID_LOG_RAM - RFID_LOG_BATCH)) {
+        RFID_log_rotate();
+        return;
+    }
+
+    if (rlog.stats.pending >= RFID_LOG_BATCH || (rlog.stats.pending && idle >= RFID_LOG_FLUSH_MS)) {
+        //хвост сектора короче пакета дописывается тоже, иначе сектор не заполнится и не сменится
+        n = MIN(rlog.stats.pending, MIN(RFID_LOG_BATCH, RFID_LOG_SLOTS - rlog.slot));
+        if (n)
+            RFID_log_write(n);
+    }
+}
+
+/*!
+ * \brief Запись всего, что ждет в RAM, без ожидания паузы (перед выгрузкой журнала)
+ */
+uint8_t RFID_log_flush(void)
+{
+    uint8_t n;
+
+    while (rlog.stats.pending) {
+        if (rlog.slot >= RFID_LOG_SLOTS && RFID_log_rotate() != MI_OK)
+            return MI_ERR;
+        n = MIN(rlog.stats.pending, MIN(RFID_LOG_BATCH, RFID_LOG_SLOTS - rlog.slot));
+        if (RFID_log_write(n) != MI_OK)
+            return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief Чтение журнала с самой старой записи в flash
+ */
+void RFID_log_rewind(rfid_log_iter_t *it)
+{
+    it->sector = RFID_log_sector_after(0);
+    it->gen = (it->sector >= 0) ? log_sector(it->sector)->gen : 0;
+    it->slot = 1;
+}
+
+/*!
+ * \brief Следующая целая запись, записи с неверной CRC пропускаются
+ * \return MI_OK - запись в rec, MI_ERR - записи кончились
+ */
+uint8_t RFID_log_next(rfid_log_iter_t *it, rfid_log_rec_t *rec)
+{
+    const rfid_log_rec_t *slot;
+
+    while (it->sector >= 0) {
+        if (it->slot < RFID_LOG_SLOTS && !RFID_log_blank(slot = log_slot(it->sector, it->slot))) {
+            it->slot++;
+            if (RFID_log_rec_valid(slot)) {
+                *rec = *slot;
+                return MI_OK;
+            }
+            rlog.stats.torn++;
+            continue;
+        }
+        //сектор кончился - следующий по gen
+        it->sector = RFID_log_sector_after(it->gen);
+        if (it->sector >= 0)
+            it->gen = log_sector(it->sector)->gen;
+        it->slot = 1;
+    }
+    return MI_ERR;
+}
+
+const rfid_log_stats_t *RFID_log_stats(void)
+{
+    return &rlog.stats;
+}
+
+/*!
+ * \brief Запись n старейших записей RAM в слоты подряд, CRC считается здесь, а не в RFID_log_event
+ */
+static uint8_t RFID_log_write(uint8_t n)
+{
+    rfid_log_rec_t batch[RFID_LOG_BATCH];
+    uint32_t addr = log_addr(rlog.active) + rlog.slot * sizeof(rfid_log_rec_t);
+
+    for (uint8_t i = 0; i < n; i++) {
+        batch[i] = rlog.ram[(rlog.head + i) % RFID_LOG_RAM];
+        batch[i].crc = crc32_sftwr(0, (const uint8_t *)&batch[i], offsetof(rfid_log_rec_t, crc));
+    }
+    //слоты после ошибки не стерты и не целы - следующая попытка пишет дальше
+    rlog.slot += n;
+    if (flash_write(&addr, batch, n * sizeof(rfid_log_rec_t)) != FLSH_ERROR_NONE) {
+        rlog.stats.errors++;
+        return MI_ERR;
+    }
+    rlog.head = (rlog.head + n) % RFID_LOG_RAM;
+    rlog.stats.pending -= n;
+    rlog.stats.written += n;
+    return MI_OK;
+}
+
+/*!
+ * \brief Переход на следующий сектор по кругу: стирание и заголовок с gen + 1
+ * \details Сектора стираются по очереди - износ равномерный. Стирание останавливает
+ * выполнение из flash на 1-2 с, поэтому RFID_log_task откладывает его до паузы без карт.
+ */
+static uint8_t RFID_log_rotate(void)
+{
+    rfid_log_sector_t header;
+    uint8_t sector = (rlog.active < 0) ? 0 : (rlog.active + 1) % RFID_LOG_SECTORS;
+    uint32_t addr = log_addr(sector);
+
+    rlog.stats.erases++;
+    rlog.active = sector;
+    rlog.slot = RFID_LOG_SLOTS;                 //без заголовка сектор не пишется
+    if (flash_erase(addr, 1) != 0xFFFFFFFFU) {
+        rlog.stats.errors++;
+        return MI_ERR;
+    }
+
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = RFID_LOG_MAGIC;
+    header.gen = rlog.gen + 1;
+    header.crc = crc32_sftwr(0, (const uint8_t *)&header, offsetof(rfid_log_sector_t, crc));
+    if (flash_write(&addr, &header, sizeof(header)) != FLSH_ERROR_NONE) {
+        rlog.stats.errors++;
+        return MI_ERR;
+    }
+    rlog.gen = header.gen;
+    rlog.slot = 1;
+    return MI_OK;
+}
+
+/*!
+ * \brief Последняя целая запись сектора
+ */
+static uint8_t RFID_log_last(uint8_t sector, rfid_log_rec_t *rec)
+{
+    for (uint16_t slot = RFID_log_first_blank(sector); slot > 1; slot--) {
+        if (RFID_log_rec_valid(log_slot(sector, slot - 1))) {
+            *rec = *log_slot(sector, slot - 1);
+            return MI_OK;
+        }
+        rlog.stats.torn++;
+    }
+    return MI_ERR;
+}
+
+/*!
+ * \brief Сектор журнала с наименьшим gen больше заданного, -1 - нет
+ */
+static int8_t RFID_log_sector_after(uint32_t gen)
+{
+    int8_t found = -1;
+
+    for (uint8_t i = 0; i < RFID_LOG_SECTORS; i++) {
+        if (RFID_log_sector_valid(i) && log_sector(i)->gen > gen &&
+            (found < 0 || log_sector(i)->gen < log_sector(found)->gen))
+            found = i;
+    }
+    return found;
+}
+
+static uint16_t RFID_log_first_blank(uint8_t sector)
+{
+    uint16_t lo = 1, hi = RFID_LOG_SLOTS, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (RFID_log_blank(log_slot(sector, mid)))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+static uint8_t RFID_log_sector_valid(uint8_t sector)
+{
+    const rfid_log_sector_t *header = log_sector(sector);
+
+    return header->magic == RFID_LOG_MAGIC &&
+           header->crc == crc32_sftwr(0, (const uint8_t *)header, offsetof(rfid_log_sector_t, crc));
+}
+
+static uint8_t RFID_log_rec_valid(const rfid_log_rec_t *rec)
+{
+    return rec->crc == crc32_sftwr(0, (const uint8_t *)rec, offsetof(rfid_log_rec_t, crc));
+}
+
+static uint8_t RFID_log_blank(const rfid_log_rec_t *rec)
+{
+    const uint32_t *word = (const uint32_t *)rec;
+
+    for (uint8_t i = 0; i < sizeof(*rec) / 4; i++) {
+        if (word[i] != 0xFFFFFFFFU)
+            return 0;
+    }
+    return 1;
+}
@@ -4,86 +4,266 @@ static void RFID_defaultKey(uint8_t *key);
 
 void RFID_init(void)
 {
-    MFRC522_Init();
-    software_timer_start(&rfid.timer, 500);
+    uint8_t i;
+
+    RFID_reader_init();
+    for (i = 0; i < RC522_READERS; i++) {
+        RFID_reader_use(i);
+        MFRC522_Init(rfid.reader->dev);
+        software_timer_start(&rfid.reader->timer, RFID_CHECK_MS);
+        rfid.reader->session.sector = RFID_NO_SECTOR;
+        RFID_detect_init();
+    }
+    RFID_reader_use(0);
     RFID_defaultKey(rfid.defkey);
+    RFID_image_init();
 }
 
+/*!
+ * \brief Надзор за RC522, вызывается из главного цикла
+ * \details Раз в RFID_CHECK_MS регистры RC522 сверяются с настройками (MFRC522_Check).
+ * Переинициализация - только при сбое или по RFID_WATCHDOG_MS, и только между цепочками:
+ * пока она ожидается, RFID_submit новые цепочки не принимает.
+ */
 void RFID_reinit(void)
 {
-    if(software_timer(&rfid.timer))
-        MFRC522_Init();
+    mfrc522_t *dev = rfid.reader->dev;
+    RFID_health_t *health = &rfid.reader->health;
+    uint32_t answers;
+    uint8_t activity;
+
+    if(health->pending == RFID_REINIT_NONE && software_timer(&rfid.reader->timer)) {
+        health->checks++;
+        health->since_reinit++;
+        answers = MFRC522_Answers(dev);
+        activity = (answers != health->answers) || rfid.reader->session.selected;
+        health->answers = answers;
+        health->pending = MFRC522_Check(dev);
+        //плановая - только при пустом поле, иначе оборвется чтение только что поднесенной карты,
+        //а сброс поля во время инвентаризации вернул бы карты из HALT
+        if(health->pending == RFID_REINIT_NONE && RFID_WATCHDOG_MS && !activity && !RFID_inventory_busy() &&
+           health->since_reinit >= RFID_WATCHDOG_MS / RFID_CHECK_MS)
+            health->pending = RFID_REINIT_WATCHDOG;
+    }
+
+    //переинициализация посреди асинхронного обмена оборвала бы его
+    if(health->pending != RFID_REINIT_NONE && !RFID_busy()) {
+        MFRC522_Init(dev);
+        RFID_session_reset();                   //после сброса RC522 поле было выключено
+        RFID_detect_reinit();
+        health->reinits[health->pending]++;
+        health->last_cause = health->pending;
+        health->pending = RFID_REINIT_NONE;
+        health->since_reinit = 0;
+    }
+}
+
+uint8_t RFID_reinit_pending(void)
+{
+    return rfid.reader->health.pending != RFID_REINIT_NONE;
 }
 
 void RFID_close(void)
 {
-    MFRC522_Halt();
+    MFRC522_Halt(rfid.reader->dev);
+    RFID_session_reset();
+}
+
+/*!
+ * \brief Сброс сессии: выключение Crypto1 и ISO14443-4, следующий обмен начнется с REQA и SELECT
+ */
+void RFID_session_reset(void)
+{
+    ClearBitMask(rfid.reader->dev, Status2Reg, 0x08);
+    RFID_tcl_reset();
+    rfid.reader->session.selected = 0;
+    rfid.reader->session.sector = RFID_NO_SECTOR;
 }
 
+/*!
+ * \brief Поиск и выбор карты. После успешного вызова карта в состоянии ACTIVE,
+ * полный UID в rfid.reader->card, в uid_buff - 4 байта UID для аутентификации и BCC.
+ */
 uint8_t RFID_getUID(uint8_t *uid_buff)
 {
-    if (MFRC522_Request(PICC_REQIDL, uid_buff) == MI_OK) {
-      if(MFRC522_Anticoll(uid_buff) == MI_OK)
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t atqa[2];
+
+    if (RFID_detect_wake())
+        delay_ms(RFID_detect_policy()->burst_ms);   //карте нужно время на запуск после включения поля
+    RFID_session_reset();
+    rfid.reader->ntag.type = RFID_NTAG_NONE;    //тип Ultralight/NTAG определяется для новой карты заново
+    if (MFRC522_Request(dev, PICC_REQIDL, atqa) == MI_OK) {
+      if(MFRC522_Select(dev, &rfid.reader->card) == MI_OK) {
+        MFRC522_UidAuthBytes(&rfid.reader->card, uid_buff);
+        rfid.reader->session.selected = 1;
         return MI_OK;
+      }
     }
     return MI_ERR;
 }
 
+/*!
+ * \brief Повторный выбор карты rfid.reader->card после сброса сессии
+ * \details После отказа в аутентификации, ошибки обмена или цепочки с HALT карта в IDLE/HALT:
+ * WUPA будит ее, выбор антиколлизией должен вернуть тот же UID.
+ * Если поле только что включено из режима пониженного потребления, карта еще запускается:
+ * функция не ждет burst_ms, а возвращает MI_BUSY - обмен повторяется со следующего прохода цикла.
+ * \return MI_ERR - карта не выбиралась, ушла из поля или выбрана другая; MI_BUSY - повторить позже
+ */
+uint8_t RFID_session_select(void)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    rfid_uid_t card = rfid.reader->card;
+    uint8_t atqa[2];
+
+    if (rfid.reader->session.selected)
+        return MI_OK;
+    if (card.size == 0)
+        return MI_ERR;
+
+    RFID_detect_wake();
+    if (!RFID_detect_powered())
+        return MI_BUSY;
+    RFID_session_reset();
+    if (MFRC522_Request(dev, PICC_REQALL, atqa) != MI_OK || MFRC522_Select(dev, &rfid.reader->card) != MI_OK ||
+        rfid.reader->card.size != card.size || memcmp(rfid.reader->card.bytes, card.bytes, card.size)) {
+        rfid.reader->card = card;               //UID той карты нужен для следующей попытки
+        return MI_ERR;
+    }
+    rfid.reader->session.selected = 1;
+    return MI_OK;
+}
+
+/*!
+ * \brief Номер сектора блока: MIFARE Classic 4K после 32 секторов по 4 блока имеет 8 секторов по 16
+ */
+uint8_t RFID_sector(uint8_t block)
+{
+    if (block < 128)
+        return block / 4;
+    return 32 + (block - 128) / 16;
+}
+
+uint8_t RFID_sector_first_block(uint8_t sector)
+{
+    if (sector < 32)
+        return sector * 4;
+    return 128 + (sector - 32) * 16;
+}
+
+uint8_t RFID_sector_blocks(uint8_t sector)
+{
+    return (sector < 32) ? 4 : 16;
+}
+
+/*!
+ * \brief Аутентификация сектора блока block
+ * \details Если Crypto1 уже включен для этого сектора тем же ключом - обмена с картой нет.
+ * При смене сектора выполняется вложенная аутентификация без повторного SELECT.
+ * После сброса сессии карта сначала выбирается заново (RFID_session_select).
+ * \return MI_OK, MI_ERR, MI_BUSY - карта еще запускается после включения поля
+ */
+uint8_t RFID_session_auth(uint8_t block, uint8_t *key, uint8_t *uid)
+{
+    RFID_session_t *session = &rfid.reader->session;
+    uint8_t sector = RFID_sector(block);
+    uint8_t trailer = RFID_sector_first_block(sector) + RFID_sector_blocks(sector) - 1;
+    uint8_t status;
+
+    if (session->selected && session->sector == sector && !memcmp(session->key, key, KEY_LEN) &&
+        !memcmp(session->uid, uid, 4))
+        return MI_OK;
+    status = RFID_session_select();
+    if (status != MI_OK)
+        return status;
+
+    if (MFRC522_Auth(rfid.reader->dev, PICC_AUTHENT1A, trailer, key, uid) != MI_OK) {
+        //после отказа в аутентификации карта уходит в IDLE - нужен новый SELECT
+        RFID_session_reset();
+        return MI_ERR;
+    }
+
+    session->sector = sector;
+    memcpy(session->key, key, KEY_LEN);
+    memcpy(session->uid, uid, 4);
+    return MI_OK;
+}
+
+/*!
+ * \brief Ошибка чтения/записи сбрасывает состояние карты - сессия больше не действительна
+ */
+static uint8_t RFID_session_check(uint8_t status)
+{
+    if (status != MI_OK)
+        RFID_session_reset();
+    return status;
+}
+
 uint8_t RFID_WriteReadBlock(uint8_t addrBlock,
                             uint8_t *dataTRANS, uint8_t *dataREC,
                             uint8_t *key, uint8_t *uid)
 {
-    uint8_t addrAuth = addrBlock + (3-addrBlock%4); //вычисляем блок аутентификации для конкретного сектора
-    MFRC522_SelectTag(rfid.uid);
-    if(MFRC522_Auth(PICC_AUTHENT1A, addrAuth, key, uid) == MI_OK)
-        if(MFRC522_Write(addrBlock, dataTRANS) == MI_OK)
-            if(MFRC522_Read(addrBlock, dataREC) == MI_OK)
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t status = RFID_session_auth(addrBlock, key, uid);
+
+    if(status == MI_OK)
+        if(RFID_session_check(MFRC522_Write(dev, addrBlock, dataTRANS)) == MI_OK)
+            if(RFID_session_check(MFRC522_Read(dev, addrBlock, dataREC)) == MI_OK)
                 return MI_OK;
-    return MI_ERR;
+    return (status == MI_BUSY) ? MI_BUSY : MI_ERR;
 }
 
 uint8_t RFID_WriteBlock(uint8_t addrBlock, uint8_t *data, uint8_t *key, uint8_t *uid)
 {
-    
-    uint8_t addrAuth = addrBlock + (3-addrBlock%4); //вычисляем блок аутентификации для конкретного сектора
-    if(MFRC522_Auth(PICC_AUTHENT1A, addrAuth, key, uid) == MI_OK)
-        if(MFRC522_Write(addrBlock, data) == MI_OK)
+    uint8_t status = RFID_session_auth(addrBlock, key, uid);
+
+    if(status == MI_OK)
+        if(RFID_session_check(MFRC522_Write(rfid.reader->dev, addrBlock, data)) == MI_OK)
             return MI_OK;
-    return MI_ERR;
+    return (status == MI_BUSY) ? MI_BUSY : MI_ERR;
 }
 
 uint8_t RFID_ReadBlock(uint8_t addrBlock, uint8_t *data, uint8_t *key, uint8_t *uid)
 {
-    uint8_t addrAuth = addrBlock + (3-addrBlock%4); //вычисляем блок аутентификации для конкретного сектора
-    if(MFRC522_Auth(PICC_AUTHENT1A, addrAuth, key, uid) == MI_OK)
-        if(MFRC522_Read(addrBlock, data) == MI_OK)
+    uint8_t status = RFID_session_auth(addrBlock, key, uid);
+
+    if(status == MI_OK)
+        if(RFID_session_check(MFRC522_Read(rfid.reader->dev, addrBlock, data)) == MI_OK)
             return MI_OK;
-    return MI_ERR;
+    return (status == MI_BUSY) ? MI_BUSY : MI_ERR;
 }
 
+/*!
+ * \brief Чтение блоков данных сектора (без трейлера): 3 блока, для старших секторов 4K - 15
+ */
 uint8_t RFID_ReadSector(uint8_t addrSector, uint8_t *data, uint8_t *key, uint8_t *uid)
 {
-    addrSector *= 4; //теперь тут конкретный адрес начального блока сектора
-    // uint8_t addrAuth = addrBlock + (3-addrBlock%4); //вычисляем блок аутентификации для конкретного сектора
-    uint8_t addrAuth = addrSector + 3;
-    MFRC522_SelectTag(rfid.uid);
-    if(MFRC522_Auth(PICC_AUTHENT1A, addrAuth, key, uid) == MI_OK) {
-        for(int i=0; i<3; i++) {
-            if(MFRC522_Read(addrSector+i, data+i*MAX_LEN) != MI_OK)
+    uint8_t first = RFID_sector_first_block(addrSector);
+    uint8_t count = RFID_sector_blocks(addrSector) - 1;
+    uint8_t status = RFID_session_auth(first, key, uid);
+
+    if(status == MI_OK) {
+        for(int i=0; i<count; i++) {
+            if(RFID_session_check(MFRC522_Read(rfid.reader->dev, first+i, data+i*MAX_LEN)) != MI_OK)
                 return MI_ERR;
         }
         return MI_OK;
     }
-    return MI_ERR;
+    return (status == MI_BUSY) ? MI_BUSY : MI_ERR;
 }
 
 uint8_t RFID_ChangeKey(uint8_t addrAuth, uint8_t *old_key, uint8_t *new_param, uint8_t *uid)
 {
-    MFRC522_SelectTag(rfid.uid);
-    if(MFRC522_Auth(PICC_AUTHENT1A, addrAuth, old_key, uid) == MI_OK)
-        if(MFRC522_Write(addrAuth, new_param) == MI_OK)
+    uint8_t status = RFID_session_auth(addrAuth, old_key, uid);
+
+    if(status == MI_OK)
+        if(RFID_session_check(MFRC522_Write(rfid.reader->dev, addrAuth, new_param)) == MI_OK) {
+            //Crypto1 остается включенным, но старый ключ больше не подходит к сектору
+            rfid.reader->session.sector = RFID_NO_SECTOR;
             return MI_OK;
-    return MI_ERR;
+        }
+    return (status == MI_BUSY) ? MI_BUSY : MI_ERR;
 }
 
 static void RFID_defaultKey(uint8_t *key)
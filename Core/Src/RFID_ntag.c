@@ -0,0 +1,162 @@
+#include "include.h"
+
+static uint8_t RFID_ntag_check(uint8_t status);
+
+// Карты по GET_VERSION: тип продукта (байт 2) и код объема памяти (байт 6)
+static const struct
+{
+    uint8_t product;
+    uint8_t storage;
+    uint8_t type;
+    uint8_t pages;
+    uint8_t user_last;
+    uint8_t pwd_page;
+} ntag_types[] = {
+    {0x03, 0x0B, RFID_NTAG_UL_EV1_48,  20,  0x0F, 0x12},
+    {0x03, 0x0E, RFID_NTAG_UL_EV1_128, 41,  0x23, 0x27},
+    {0x04, 0x0F, RFID_NTAG_213,        45,  0x27, 0x2B},
+    {0x04, 0x11, RFID_NTAG_215,        135, 0x81, 0x85},
+    {0x04, 0x13, RFID_NTAG_216,        231, 0xE1, 0xE5},
+};
+
+/*!
+ * \brief Определение типа выбранной карты Ultralight/NTAG по GET_VERSION
+ * \details Карта выбирается заранее RFID_getUID. Ultralight без GET_VERSION отвечает NAK
+ * и уходит в IDLE - она выбирается снова и считается Ultralight на 16 страниц.
+ * \return MI_OK - тип и границы памяти в rfid.reader->ntag
+ */
+uint8_t RFID_ntag_detect(void)
+{
+    RFID_ntag_t *ntag = &rfid.reader->ntag;
+
+    ntag->type = RFID_NTAG_NONE;
+    if (!rfid.reader->session.selected || rfid.reader->card.sak != 0x00)
+        return MI_ERR;
+
+    if (MFRC522_GetVersion(rfid.reader->dev, ntag->version) == MI_OK) {
+        for (uint8_t i = 0; i < sizeof(ntag_types) / sizeof(ntag_types[0]); i++) {
+            if (ntag->version[2] == ntag_types[i].product && ntag->version[6] == ntag_types[i].storage) {
+                ntag->type = ntag_types[i].type;
+                ntag->pages = ntag_types[i].pages;
+                ntag->user_last = ntag_types[i].user_last;
+                ntag->pwd_page = ntag_types[i].pwd_page;
+                return MI_OK;
+            }
+        }
+        return MI_ERR;
+    }
+
+    //после NAK выбираем ту же карту заново
+    rfid.reader->session.selected = 0;
+    if (RFID_session_select() != MI_OK)
+        return MI_ERR;
+
+    memset(ntag->version, 0, sizeof(ntag->version));
+    ntag->type = RFID_NTAG_ULTRALIGHT;
+    ntag->pages = 16;
+    ntag->user_last = 15;
+    ntag->pwd_page = 0;
+    return MI_OK;
+}
+
+/*!
+ * \brief Чтение count страниц начиная с page
+ * \details FAST_READ по MFRC522_FAST_READ_PAGES страниц за кадр: пользовательская память NTAG216
+ * (222 страницы) читается за 15 обменов вместо 56 READ. У Ultralight - READ по 4 страницы.
+ */
+uint8_t RFID_ntag_read(uint8_t page, uint8_t count, uint8_t *data)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    RFID_ntag_t *ntag = &rfid.reader->ntag;
+    uint8_t block[MAX_LEN];
+    uint8_t status, n;
+
+    if (ntag->type == RFID_NTAG_NONE || !rfid.reader->session.selected || count == 0 ||
+        (uint16_t)page + count > ntag->pages)
+        return MI_ERR;
+
+    while (count) {
+        if (ntag->type == RFID_NTAG_ULTRALIGHT) {
+            n = MIN(count, MAX_LEN / MFRC522_PAGE_LEN);
+            status = MFRC522_Read(dev, page, block);
+            memcpy(data, block, n * MFRC522_PAGE_LEN);
+        } else {
+            n = MIN(count, MFRC522_FAST_READ_PAGES);
+            status = MFRC522_FastRead(dev, page, page + n - 1, data);
+        }
+        if (RFID_ntag_check(status) != MI_OK)
+            return MI_ERR;
+        page += n;
+        count -= n;
+        data += n * MFRC522_PAGE_LEN;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief Чтение пользовательской памяти целиком, не больше size байт (целыми страницами)
+ * \param[out] len - прочитано байт
+ */
+uint8_t RFID_ntag_read_user(uint8_t *data, uint16_t size, uint16_t *len)
+{
+    RFID_ntag_t *ntag = &rfid.reader->ntag;
+    uint8_t count;
+
+    *len = 0;
+    if (ntag->type == RFID_NTAG_NONE)
+        return MI_ERR;
+
+    count = MIN(ntag->user_last - RFID_NTAG_USER_FIRST + 1, size / MFRC522_PAGE_LEN);
+    if (RFID_ntag_read(RFID_NTAG_USER_FIRST, count, data) != MI_OK)
+        return MI_ERR;
+    *len = count * MFRC522_PAGE_LEN;
+    return MI_OK;
+}
+
+/*!
+ * \brief Запись count страниц начиная с page командой WRITE на 4 байта
+ */
+uint8_t RFID_ntag_write(uint8_t page, const uint8_t *data, uint8_t count)
+{
+    RFID_ntag_t *ntag = &rfid.reader->ntag;
+
+    if (ntag->type == RFID_NTAG_NONE || !rfid.reader->session.selected || (uint16_t)page + count > ntag->pages)
+        return MI_ERR;
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (RFID_ntag_check(MFRC522_WritePage(rfid.reader->dev, page + i, data + i * MFRC522_PAGE_LEN)) != MI_OK)
+            return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief Снятие защиты паролем (PWD_AUTH) до выбора другой карты
+ * \param[in] pack - ожидаемое подтверждение карты, NULL - не проверять
+ * \return MI_ERR - пароль не подошел или PACK чужой: карта в IDLE, нужен новый RFID_getUID
+ */
+uint8_t RFID_ntag_auth(const uint8_t *pwd, const uint8_t *pack)
+{
+    RFID_ntag_t *ntag = &rfid.reader->ntag;
+    uint8_t resp[2];
+
+    if (ntag->pwd_page == 0 || !rfid.reader->session.selected)
+        return MI_ERR;
+    if (RFID_ntag_check(MFRC522_PwdAuth(rfid.reader->dev, pwd, resp)) != MI_OK)
+        return MI_ERR;
+    if (pack && memcmp(resp, pack, sizeof(resp))) {
+        RFID_session_reset();
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief После NAK карта уходит в IDLE - сессия больше не действительна
+ */
+static uint8_t RFID_ntag_check(uint8_t status)
+{
+    if (status != MI_OK)
+        RFID_session_reset();
+    return status;
+}
@@ -0,0 +1,160 @@
+#include "include.h"
+
+typedef enum {
+    RFID_PRES_ABSENT,       // поиск новой карты: REQA, SELECT и шаги появления
+    RFID_PRES_PRESENT       // карта в HALT, раз в RFID_PRES_PROBE_MS - проверка присутствия
+} rfid_pres_state_t;
+
+static void RFID_presence_done(rfid_request_t *req);
+static void RFID_presence_result(void);
+static void RFID_presence_miss(void);
+static uint8_t RFID_presence_same(const uint8_t *sel);
+
+// Выбранная карта в HALT отвечает только на WUPA, ANTICOLL первого уровня возвращает начало
+// ее UID, HALT из READY возвращает ее обратно в HALT. Новая карта из IDLE вернется в IDLE
+// и будет найдена REQA после CARD_LEFT.
+static const rfid_step_t pres_probe_steps[] = {
+    {RFID_STEP_WUPA,     0, NULL, NULL},
+    {RFID_STEP_ANTICOLL, 0, NULL, NULL},
+};
+
+static const rfid_step_t pres_select_steps[RFID_PRES_SELECT_STEPS] = {
+    {RFID_STEP_REQA,     0, NULL, NULL},
+    {RFID_STEP_ANTICOLL, 0, NULL, NULL},
+    {RFID_STEP_SELECT,   0, NULL, NULL},
+};
+
+/*!
+ * \brief Запуск отслеживания карты
+ * \details steps (до RFID_PRES_MAX_STEPS) выполняются один раз при появлении карты сразу
+ * после ее SELECT: аутентификация, чтение пропуска. UID для аутентификации берется из SELECT.
+ */
+void RFID_presence_init(rfid_presence_cb_t cb, void *ctx, const rfid_step_t *steps, uint8_t count)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+
+    count = MIN(count, RFID_PRES_MAX_STEPS);
+    memcpy(pres->arrival, pres_select_steps, sizeof(pres_select_steps));
+    memcpy(&pres->arrival[RFID_PRES_SELECT_STEPS], steps, count * sizeof(rfid_step_t));
+    pres->req.halt = 1;
+    pres->req.check = NULL;
+    pres->req.callback = RFID_presence_done;
+    pres->req.ctx = pres;
+    pres->count = RFID_PRES_SELECT_STEPS + count;
+    pres->ctx = ctx;
+    pres->state = RFID_PRES_ABSENT;
+    pres->cb = cb;
+}
+
+/*!
+ * \brief Проверка UID для шага RFID_STEP_CHECK в цепочке появления, например поиск в базе карт
+ * \details Отклоненная карта приходит в RFID_CARD_ARRIVED с ошибкой и больше не опрашивается до ухода
+ */
+void RFID_presence_check(uint8_t (*check)(const rfid_uid_t *card))
+{
+    rfid.reader->presence.req.check = check;
+}
+
+/*!
+ * \brief Задача отслеживания, вызывается из главного цикла
+ * \details Без карты цепочка появления запускается непрерывно, как раньше проверка замка.
+ * С картой в поле - только короткая проверка присутствия раз в RFID_PRES_PROBE_MS.
+ */
+void RFID_presence_task(void)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+    uint32_t now = HAL_GetTick();
+
+    if (pres->ready) {
+        pres->ready = 0;
+        RFID_presence_result();
+    }
+
+    if (pres->cb == NULL || RFID_busy() || RFID_inventory_busy())
+        return;
+
+    if (pres->state == RFID_PRES_PRESENT) {
+        if ((now - pres->probe_time) < RFID_PRES_PROBE_MS)
+            return;
+        pres->probe_time = now;
+        //поле выключено обнаружением - карта обесточена, значит ее нет
+        if (!RFID_detect_active()) {
+            RFID_presence_miss();
+            return;
+        }
+        pres->req.steps = pres_probe_steps;
+        pres->req.count = ARRAY_SIZE(pres_probe_steps);
+    } else {
+        if (!RFID_detect_active())
+            return;
+        pres->req.steps = pres->arrival;
+        pres->req.count = pres->count;
+    }
+    RFID_submit(&pres->req);
+}
+
+uint8_t RFID_presence_present(void)
+{
+    return rfid.reader->presence.state == RFID_PRES_PRESENT;
+}
+
+/*!
+ * \brief UID отслеживаемой карты, NULL - карты нет
+ */
+const rfid_uid_t *RFID_presence_card(void)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+
+    return (pres->state == RFID_PRES_PRESENT) ? &pres->card : NULL;
+}
+
+static void RFID_presence_done(rfid_request_t *req)
+{
+    ((rfid_presence_t *)req->ctx)->ready = 1;
+}
+
+static void RFID_presence_result(void)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+
+    if (pres->state == RFID_PRES_ABSENT) {
+        //карта не выбрана - ее нет; ошибка в шагах появления передается обработчику
+        if (pres->req.status != MI_OK && pres->req.failed_step < RFID_PRES_SELECT_STEPS)
+            return;
+        pres->card = pres->req.card;
+        pres->state = RFID_PRES_PRESENT;
+        pres->misses = 0;
+        pres->probe_time = HAL_GetTick();
+        pres->cb(RFID_CARD_ARRIVED, &pres->card, pres->req.status, pres->ctx);
+        return;
+    }
+
+    if (pres->req.status == MI_OK && RFID_presence_same(pres->req.sel)) {
+        pres->misses = 0;
+        pres->cb(RFID_CARD_PRESENT, &pres->card, MI_OK, pres->ctx);
+        return;
+    }
+    RFID_presence_miss();
+}
+
+static void RFID_presence_miss(void)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+
+    if (++pres->misses < RFID_PRES_MISSES)
+        return;
+    pres->state = RFID_PRES_ABSENT;
+    pres->cb(RFID_CARD_LEFT, &pres->card, MI_OK, pres->ctx);
+}
+
+/*!
+ * \brief Совпадает ли UID первого уровня каскада из ANTICOLL с отслеживаемой картой
+ */
+static uint8_t RFID_presence_same(const uint8_t *sel)
+{
+    rfid_presence_t *pres = &rfid.reader->presence;
+
+    if (pres->card.size == 4)
+        return !memcmp(&sel[2], pres->card.bytes, 4);
+    return (sel[2] == PICC_CASCADE_TAG) && !memcmp(&sel[3], pres->card.bytes, 3);
+}
@@ -0,0 +1,61 @@
+#include "include.h"
+
+static RFID_reader_t rfid_readers[RC522_READERS];
+
+/*!
+ * \brief Привязка состояния к считывателям RC522, выбран первый
+ */
+void RFID_reader_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < RC522_READERS; i++) {
+        rfid_readers[i].dev = MFRC522_Reader(i);
+        rfid_readers[i].index = i;
+    }
+    rfid.reader = &rfid_readers[0];
+}
+
+/*!
+ * \brief Выбор считывателя для следующих вызовов RFID_*, MFRC522_* получают его rfid.reader->dev
+ * \return MI_ERR - идет цепочка на текущем считывателе, переключаться нельзя
+ */
+uint8_t RFID_reader_use(uint8_t index)
+{
+    if (index >= RC522_READERS || RFID_busy())
+        return MI_ERR;
+    rfid.reader = &rfid_readers[index];
+    return MI_OK;
+}
+
+RFID_reader_t *RFID_reader(uint8_t index)
+{
+    return (index < RC522_READERS) ? &rfid_readers[index] : NULL;
+}
+
+/*!
+ * \brief Остались ли у текущего считывателя цепочки на этот ход, вызывается из RFID_submit
+ * \details Инвентаризация - серия цепочек на одном считывателе, ход на время нее не ограничен
+ */
+uint8_t RFID_reader_may_submit(void)
+{
+    return (rfid.reader->chains < RFID_READER_CHAINS) || RFID_inventory_busy();
+}
+
+/*!
+ * \brief Планировщик считывателей, вызывается из главного цикла после всех задач RFID
+ * \details Ход передается следующему считывателю, как только на текущем нет цепочки:
+ * задачи текущего уже забрали ее результат в этом проходе цикла. С одним считывателем
+ * просто начинается новый ход.
+ */
+void RFID_reader_task(void)
+{
+    RFID_reader_t *next;
+
+    if (RFID_busy() || RFID_inventory_busy())
+        return;
+    next = &rfid_readers[(rfid.reader->index + 1) % RC522_READERS];
+    next->chains = 0;
+    next->turns++;
+    RFID_reader_use(next->index);
+}
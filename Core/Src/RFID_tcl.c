@@ -0,0 +1,272 @@
+#include "include.h"
+
+#define TCL_RATS            0xE0
+#define TCL_PPS             0xD0
+#define TCL_I_BLOCK         0x02
+#define TCL_R_ACK           0xA2
+#define TCL_R_NAK           0xB2
+#define TCL_S_DESELECT      0xC2
+#define TCL_S_WTX           0xF2
+#define TCL_CHAINING        0x10
+
+#define TCL_IS_I(pcb)       (((pcb) & 0xE2) == 0x02)
+#define TCL_IS_R(pcb)       (((pcb) & 0xE6) == 0xA2)
+#define TCL_IS_WTX(pcb)     (((pcb) & 0xF7) == 0xF2)
+
+static uint8_t RFID_tcl_frame(const uint8_t *tx, uint8_t len, uint32_t fwt_us, uint8_t *rx, uint8_t *rlen);
+static uint8_t RFID_tcl_rate(uint8_t bits, uint8_t max_rate);
+static void RFID_tcl_sfgt(uint8_t sfgi);
+static uint8_t RFID_tcl_busy(void);
+
+// FSC по FSCI из T0 (ISO14443-4, 5.2.3), FSCI больше 8 - 256 байт
+static const uint16_t tcl_fsc[9] = {16, 24, 32, 40, 48, 64, 96, 128, 256};
+
+/*!
+ * \brief Сброс сессии: скорость 106 кбит/с, следующий обмен только после RFID_tcl_activate
+ * \details Вызывается из RFID_session_reset - REQA и ANTICOLL идут только на 106 кбит/с
+ */
+void RFID_tcl_reset(void)
+{
+    RFID_tcl_t *tcl = &rfid.reader->tcl;
+
+    tcl->active = 0;
+    if (tcl->tx_rate != RC522_RATE_106 || tcl->rx_rate != RC522_RATE_106) {
+        MFRC522_SetBitRate(rfid.reader->dev, RC522_RATE_106, RC522_RATE_106);
+        tcl->tx_rate = RC522_RATE_106;
+        tcl->rx_rate = RC522_RATE_106;
+    }
+}
+
+/*!
+ * \brief Перевод выбранной карты в ISO14443-4: RATS, разбор ATS, PPS на наибольшую общую скорость
+ * \details Карта выбирается заранее RFID_getUID, SAK должен сообщать о поддержке ISO14443-4.
+ * \param[in] max_rate - наибольшая скорость RC522_RATE_*, которую допускает антенна считывателя
+ * \return MI_OK - карта в протоколе T=CL, ATS в rfid.reader->tcl.ats; MI_ERR - в том числе пока
+ * считыватель занят RFID_submit или инвентаризацией
+ */
+uint8_t RFID_tcl_activate(uint8_t max_rate)
+{
+    RFID_tcl_t *tcl = &rfid.reader->tcl;
+    uint8_t frame[RFID_TCL_FSD + 2];
+    uint8_t len, t0, ta = 0, tb = 0x40, pos = 2;
+    uint8_t ds, dr, fwi;
+
+    if (RFID_tcl_busy() || !rfid.reader->session.selected || !(rfid.reader->card.sak & 0x20))
+        return MI_ERR;
+
+    RFID_tcl_reset();
+    frame[0] = TCL_RATS;
+    frame[1] = RFID_TCL_FSDI << 4;              //CID = 0
+    if (RFID_tcl_frame(frame, 2, RFID_TCL_FWT_ACT_US, frame, &len) != MI_OK || len < 1 || frame[0] != len)
+        return MI_ERR;
+
+    //по умолчанию: FSCI = 2, только 106 кбит/с, FWI = 4, SFGI = 0
+    t0 = (len > 1) ? frame[1] : 0x02;
+    if ((t0 & 0x10) && pos < len)
+        ta = frame[pos++];
+    if ((t0 & 0x20) && pos < len)
+        tb = frame[pos++];
+    tcl->ats_len = MIN(len, RFID_TCL_ATS_MAX);
+    memcpy(tcl->ats, frame, tcl->ats_len);
+    tcl->fsc = MIN(tcl_fsc[MIN(t0 & 0x0F, 8)], RFID_TCL_FSD);
+    //FWI = 15 - RFU (ISO14443-4, 5.2.5), считаем его значением по умолчанию
+    fwi = tb >> 4;
+    if (fwi == 15)
+        fwi = 4;
+    tcl->fwt_us = (302u << fwi) + RFID_TCL_DFWT_US;
+    tcl->block = 0;
+    RFID_tcl_sfgt(tb & 0x0F);
+
+    //TA: b8 - только одинаковые скорости, b7..b5 - от карты (DS), b3..b1 - к карте (DR)
+    if (ta & 0x80) {
+        ds = dr = RFID_tcl_rate((ta >> 4) & ta & 0x07, max_rate);
+    } else {
+        ds = RFID_tcl_rate((ta >> 4) & 0x07, max_rate);
+        dr = RFID_tcl_rate(ta & 0x07, max_rate);
+    }
+    if (ds != RC522_RATE_106 || dr != RC522_RATE_106) {
+        frame[0] = TCL_PPS;
+        frame[1] = 0x11;                        //PPS0: передается PPS1
+        frame[2] = (ds << 2) | dr;
+        //без ответа на PPS карта остается на 106 кбит/с - работаем на ней
+        if (RFID_tcl_frame(frame, 3, RFID_TCL_FWT_ACT_US, frame, &len) == MI_OK && len == 1 && frame[0] == TCL_PPS) {
+            MFRC522_SetBitRate(rfid.reader->dev, dr, ds);
+            tcl->tx_rate = dr;
+            tcl->rx_rate = ds;
+        }
+    }
+    tcl->active = 1;
+    return MI_OK;
+}
+
+/*!
+ * \brief Обмен APDU: команда цепочкой I-блоков по FSC, ответ цепочкой по FSD
+ * \details Запрос продления ожидания (S(WTX)) подтверждается, следующий кадр ждем FWT * WTXM.
+ * После таймаута или ошибки кадра - R(NAK) или повтор R(ACK), до RFID_TCL_RETRIES раз подряд.
+ * \param[out] resp_len - длина ответа, включая SW1 SW2
+ * \return MI_OK, MI_ERR - ошибка протокола, ответ больше size или считыватель занят
+ */
+uint8_t RFID_tcl_exchange(const uint8_t *apdu, uint16_t len, uint8_t *resp, uint16_t size, uint16_t *resp_len)
+{
+    RFID_tcl_t *tcl = &rfid.reader->tcl;
+    uint8_t iblock[RFID_TCL_FSD];               //последний I-блок - для повтора
+    uint8_t tx[RFID_TCL_FSD];
+    uint8_t rx[RFID_TCL_FSD + 2];
+    uint8_t ilen, tlen, rlen, pcb;
+    uint8_t retries = 0;
+    uint8_t wtxm = 1;
+    uint8_t sending = 1;
+    uint16_t chunk;
+
+    *resp_len = 0;
+    if (!tcl->active || RFID_tcl_busy())
+        return MI_ERR;
+
+    chunk = MIN(len, tcl->fsc - 3);
+    iblock[0] = TCL_I_BLOCK | tcl->block | ((chunk < len) ? TCL_CHAINING : 0);
+    memcpy(&iblock[1], apdu, chunk);
+    ilen = chunk + 1;
+    memcpy(tx, iblock, ilen);
+    tlen = ilen;
+
+    while (1) {
+        if (RFID_tcl_frame(tx, tlen, tcl->fwt_us * wtxm, rx, &rlen) != MI_OK || rlen == 0) {
+            if (++retries > RFID_TCL_RETRIES)
+                return MI_ERR;
+            //I-блок не дошел или ответ потерян - R(NAK); потерянный R(ACK) повторяется как есть
+            if (TCL_IS_I(tx[0])) {
+                tx[0] = TCL_R_NAK | tcl->block;
+                tlen = 1;
+            }
+            wtxm = 1;
+            continue;
+        }
+        wtxm = 1;
+        pcb = rx[0];
+
+        if (TCL_IS_WTX(pcb) && rlen == 2) {
+            wtxm = MAX(rx[1] & 0x3F, 1);
+            tx[0] = TCL_S_WTX;
+            tx[1] = rx[1] & 0x3F;
+            tlen = 2;
+            continue;
+        }
+        retries = 0;
+
+        if (TCL_IS_R(pcb) && !(pcb & 0x10)) {
+            if (!sending)
+                return MI_ERR;
+            //R(ACK) с чужим номером - последний I-блок не принят, повторяем его
+            if ((pcb & 0x01) != tcl->block || !(iblock[0] & TCL_CHAINING)) {
+                memcpy(tx, iblock, ilen);
+                tlen = ilen;
+                continue;
+            }
+            //следующее звено цепочки команды
+            tcl->block ^= 1;
+            apdu += chunk;
+            len -= chunk;
+            chunk = MIN(len, tcl->fsc - 3);
+            iblock[0] = TCL_I_BLOCK | tcl->block | ((chunk < len) ? TCL_CHAINING : 0);
+            memcpy(&iblock[1], apdu, chunk);
+            ilen = chunk + 1;
+            memcpy(tx, iblock, ilen);
+            tlen = ilen;
+            continue;
+        }
+
+        if (!TCL_IS_I(pcb) || (pcb & 0x01) != tcl->block || (sending && (iblock[0] & TCL_CHAINING)))
+            return MI_ERR;
+
+        sending = 0;
+        tcl->block ^= 1;
+        if (*resp_len + rlen - 1 > size)
+            return MI_ERR;
+        memcpy(&resp[*resp_len], &rx[1], rlen - 1);
+        *resp_len += rlen - 1;
+        if (!(pcb & TCL_CHAINING))
+            return MI_OK;
+
+        //карта продолжает цепочку ответа - R(ACK) с нашим номером блока
+        tx[0] = TCL_R_ACK | tcl->block;
+        tlen = 1;
+    }
+}
+
+/*!
+ * \brief Завершение сессии: S(DESELECT), карта уходит в HALT, скорость возвращается на 106 кбит/с
+ */
+uint8_t RFID_tcl_deselect(void)
+{
+    RFID_tcl_t *tcl = &rfid.reader->tcl;
+    uint8_t frame[RFID_TCL_FSD + 2];
+    uint8_t status = MI_ERR;
+    uint8_t len;
+
+    if (RFID_tcl_busy())
+        return MI_ERR;
+    if (tcl->active) {
+        frame[0] = TCL_S_DESELECT;
+        if (RFID_tcl_frame(frame, 1, tcl->fwt_us, frame, &len) == MI_OK && len == 1 && frame[0] == TCL_S_DESELECT)
+            status = MI_OK;
+    }
+    RFID_tcl_reset();
+    rfid.reader->session.selected = 0;
+    return status;
+}
+
+/*!
+ * \brief Один кадр T=CL: CRC_A, граница ожидания fwt_us профилем RC522_TMO_TCL
+ * \param[out] rlen - длина ответа без CRC
+ */
+static uint8_t RFID_tcl_frame(const uint8_t *tx, uint8_t len, uint32_t fwt_us, uint8_t *rx, uint8_t *rlen)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t frame[RFID_TCL_FSD + 2];
+    uint8_t status;
+    uint bits;
+
+    memcpy(frame, tx, len);
+    len = MFRC522_AppendCRC(dev, frame, len, 1);
+    MFRC522_SetFwt(dev, fwt_us);
+    MFRC522_NextProfile(dev, RC522_TMO_TCL);
+    MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, frame, len);
+    while ((status = MFRC522_ToCardPoll(dev, rx, RFID_TCL_FSD + 2, &bits)) == MI_BUSY) {
+    }
+    if (status != MI_OK)
+        return status;
+    return MFRC522_CheckCRC(dev, rx, bits, rlen);
+}
+
+/*!
+ * \brief Считыватель занят цепочкой RFID_submit или инвентаризацией
+ * \details Синхронный кадр T=CL в это время перезаписал бы FIFO и таймер чужой команды
+ */
+static uint8_t RFID_tcl_busy(void)
+{
+    return RFID_busy() || RFID_inventory_busy();
+}
+
+/*!
+ * \brief Наибольшая скорость не выше max_rate из битов поддержки: b1 - 212, b2 - 424, b3 - 848 кбит/с
+ */
+static uint8_t RFID_tcl_rate(uint8_t bits, uint8_t max_rate)
+{
+    uint8_t rate;
+
+    for (rate = MIN(max_rate, RC522_RATE_848); rate > RC522_RATE_106; rate--) {
+        if (bits & (1 << (rate - 1)))
+            return rate;
+    }
+    return RC522_RATE_106;
+}
+
+/*!
+ * \brief Пауза после ATS до первого кадра (SFGT = 302 мкс * 2^SFGI)
+ */
+static void RFID_tcl_sfgt(uint8_t sfgi)
+{
+    if (sfgi == 0 || sfgi == 15)
+        return;
+    delay_us(302u << sfgi);
+}
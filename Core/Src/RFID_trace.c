@@ -0,0 +1,258 @@
+#include "include.h"
+#include "crc32_software.h"
+
+#if RFID_TRACE
+
+static void RFID_trace_fill(void);
+static void RFID_trace_emit(const void *buf, uint16_t len);
+
+static struct
+{
+    rfid_trace_rec_t rec[RFID_TRACE_RECORDS];
+    uint16_t head;                              // запись текущего обмена
+    uint16_t count;                             // завершенных записей в буфере
+    uint32_t lost;                              // перезаписано до выгрузки
+    uint8_t enabled;
+    uint8_t open;                               // RFID_trace_start без RFID_trace_done
+
+    // выгрузка частями RFID_export_send, запись на время выгрузки остановлена
+    struct
+    {
+        uint8_t result;                         // MI_BUSY - выгрузка идет
+        uint8_t enabled;                        // запись до выгрузки
+        uint8_t sent;                           // часть уже уходила: RFID_export_sent относится к ней
+        uint16_t index;                         // следующая запись
+        uint16_t left;                          // записей осталось
+        uint32_t crc;
+        uint16_t len;                           // ждет передачи, 0 - буфер свободен
+        uint8_t buf[RFID_TRACE_PART];
+    } dump;
+} trace = {.enabled = 1, .dump.result = MI_OK};
+
+/*!
+ * \brief Запуск команды: кадр передачи в текущую запись (вызывается из MFRC522_ToCardStart)
+ */
+void RFID_trace_start(uint8_t reader, uint8_t command, const uint8_t *tx, uint8_t len, uint32_t start)
+{
+    rfid_trace_rec_t *rec = &trace.rec[trace.head];
+
+    if (!trace.enabled)
+        return;
+    rec->start = start;
+    rec->reader = reader;
+    rec->command = command;
+    rec->tx_len = len;
+    memcpy(rec->tx, tx, MIN(len, RFID_TRACE_DATA));
+    trace.open = 1;
+}
+
+/*!
+ * \brief Результат команды: ответ, ErrorReg, CollReg и длительность, запись закрывается
+ */
+void RFID_trace_done(uint8_t status, uint8_t error, uint8_t coll, const uint8_t *rx, uint16_t bits, uint32_t now)
+{
+    rfid_trace_rec_t *rec = &trace.rec[trace.head];
+
+    if (!trace.open)
+        return;
+    trace.open = 0;
+    rec->cycles = now - rec->start;
+    rec->status = status;
+    rec->error = error;
+    rec->coll = coll;
+    rec->rx_bits = bits;
+    memcpy(rec->rx, rx, MIN((bits + 7) / 8, RFID_TRACE_DATA));
+
+    trace.head = (trace.head + 1) % RFID_TRACE_RECORDS;
+    if (trace.count < RFID_TRACE_RECORDS)
+        trace.count++;
+    else
+        trace.lost++;
+}
+
+/*!
+ * \brief Включение и остановка записи: после сбоя запись останавливают, чтобы сохранить его окрестность
+ */
+void RFID_trace_enable(uint8_t on)
+{
+    if (trace.dump.result == MI_BUSY) {
+        trace.dump.enabled = on;                //вступит в силу после выгрузки
+        return;
+    }
+    trace.enabled = on;
+    trace.open = 0;
+}
+
+uint16_t RFID_trace_count(void)
+{
+    return trace.count;
+}
+
+/*!
+ * \brief Запуск выгрузки буфера каналом RFID_export (формат - RFID_trace.h)
+ * \details Части уходят из RFID_trace_task, следующая - после подтверждения предыдущей.
+ * Буфер очищается, когда приемник подтвердил последнюю часть.
+ * \return MI_OK - выгрузка начата, MI_ERR - предыдущая выгрузка еще идет
+ */
+uint8_t RFID_trace_dump(void)
+{
+    if (trace.dump.result == MI_BUSY)
+        return MI_ERR;
+
+    trace.dump.result = MI_BUSY;
+    trace.dump.enabled = trace.enabled;
+    trace.dump.sent = 0;
+    trace.dump.index = (trace.head + RFID_TRACE_RECORDS - trace.count) % RFID_TRACE_RECORDS;
+    trace.dump.left = trace.count;
+    trace.dump.crc = 0;                         //таблица CRC32 готовится в RFID_image_init
+    trace.dump.len = 0;
+    trace.enabled = 0;
+    trace.open = 0;
+    return MI_OK;
+}
+
+/*!
+ * \brief Итог выгрузки
+ * \return MI_BUSY - выгрузка идет, MI_OK - буфер передан и очищен, MI_ERR - связь потеряна, буфер сохранен
+ */
+uint8_t RFID_trace_result(void)
+{
+    return trace.dump.result;
+}
+
+/*!
+ * \brief Шаг выгрузки, вызывается из главного цикла
+ */
+void RFID_trace_task(void)
+{
+    uint8_t status;
+
+    if (trace.dump.result != MI_BUSY)
+        return;
+
+    if (trace.dump.len) {
+        status = RFID_export_send(RFID_TRACE_MAGIC, trace.dump.left == 0, trace.dump.buf, trace.dump.len);
+        if (status == MI_OK)
+            trace.dump.len = 0;
+        else if (status == MI_ERR)
+            trace.dump.result = MI_ERR;
+        return;
+    }
+
+    status = RFID_export_sent();
+    if (status == MI_BUSY)
+        return;
+    if (trace.dump.sent && (status != MI_OK || trace.dump.left == 0)) {
+        if (status == MI_OK)
+            RFID_trace_clear();
+        trace.enabled = trace.dump.enabled;
+        trace.dump.result = status;
+        return;
+    }
+
+    RFID_trace_fill();
+    trace.dump.sent = 1;
+}
+
+/*!
+ * \brief Следующая часть: заголовок в первой, записи целиком, пока есть место на наибольшую, CRC32 в последней
+ */
+static void RFID_trace_fill(void)
+{
+    uint8_t header[10];
+
+    if (!trace.dump.sent) {
+        header[0] = 'R';
+        header[1] = 'T';
+        header[2] = RFID_TRACE_VERSION;
+        header[3] = MFRC522_CyclesPerUs();
+        header[4] = BYTE0(trace.count);
+        header[5] = BYTE1(trace.count);
+        header[6] = BYTE0(trace.lost);
+        header[7] = BYTE1(trace.lost);
+        header[8] = BYTE2(trace.lost);
+        header[9] = BYTE3(trace.lost);
+        RFID_trace_emit(header, sizeof(header));
+    }
+
+    while (trace.dump.left && trace.dump.len + 16 + 2 * RFID_TRACE_DATA + 4 <= RFID_TRACE_PART) {
+        const rfid_trace_rec_t *rec = &trace.rec[trace.dump.index];
+        uint8_t fixed[16];
+
+        fixed[0] = BYTE0(rec->start);
+        fixed[1] = BYTE1(rec->start);
+        fixed[2] = BYTE2(rec->start);
+        fixed[3] = BYTE3(rec->start);
+        fixed[4] = BYTE0(rec->cycles);
+        fixed[5] = BYTE1(rec->cycles);
+        fixed[6] = BYTE2(rec->cycles);
+        fixed[7] = BYTE3(rec->cycles);
+        fixed[8] = BYTE0(rec->rx_bits);
+        fixed[9] = BYTE1(rec->rx_bits);
+        fixed[10] = rec->reader;
+        fixed[11] = rec->command;
+        fixed[12] = rec->status;
+        fixed[13] = rec->error;
+        fixed[14] = rec->coll;
+        fixed[15] = rec->tx_len;
+        RFID_trace_emit(fixed, sizeof(fixed));
+        RFID_trace_emit(rec->tx, MIN(rec->tx_len, RFID_TRACE_DATA));
+        RFID_trace_emit(rec->rx, MIN((rec->rx_bits + 7) / 8, RFID_TRACE_DATA));
+
+        trace.dump.index = (trace.dump.index + 1) % RFID_TRACE_RECORDS;
+        trace.dump.left--;
+    }
+
+    if (trace.dump.left == 0) {
+        trace.dump.buf[trace.dump.len++] = BYTE0(trace.dump.crc);
+        trace.dump.buf[trace.dump.len++] = BYTE1(trace.dump.crc);
+        trace.dump.buf[trace.dump.len++] = BYTE2(trace.dump.crc);
+        trace.dump.buf[trace.dump.len++] = BYTE3(trace.dump.crc);
+    }
+}
+
+void RFID_trace_clear(void)
+{
+    trace.count = 0;
+    trace.lost = 0;
+    trace.open = 0;
+}
+
+static void RFID_trace_emit(const void *buf, uint16_t len)
+{
+    trace.dump.crc = crc32_sftwr(trace.dump.crc, buf, len);
+    memcpy(&trace.dump.buf[trace.dump.len], buf, len);
+    trace.dump.len += len;
+}
+
+#else
+
+void RFID_trace_enable(uint8_t on)
+{
+    (void)on;
+}
+
+uint16_t RFID_trace_count(void)
+{
+    return 0;
+}
+
+uint8_t RFID_trace_dump(void)
+{
+    return MI_ERR;
+}
+
+uint8_t RFID_trace_result(void)
+{
+    return MI_ERR;
+}
+
+void RFID_trace_task(void)
+{
+}
+
+void RFID_trace_clear(void)
+{
+}
+
+#endif /* RFID_TRACE */
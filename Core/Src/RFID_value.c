@@ -0,0 +1,131 @@
+#include "include.h"
+
+static uint8_t RFID_value_op(uint8_t command, uint8_t src, uint8_t dst, int32_t operand, uint8_t *key, uint8_t *uid);
+static uint8_t RFID_value_block(uint8_t addrBlock);
+
+/*!
+ * \brief Блок значения value с адресом addr
+ */
+void RFID_value_encode(int32_t value, uint8_t addr, uint8_t *block)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        block[i] = (uint8_t)(value >> (8 * i));
+        block[4 + i] = ~block[i];
+        block[8 + i] = block[i];
+    }
+    block[12] = addr;
+    block[13] = ~addr;
+    block[14] = addr;
+    block[15] = ~addr;
+}
+
+/*!
+ * \brief Разбор блока значения с проверкой инверсных копий
+ * \return MI_ERR - блок не в формате значения или поврежден
+ */
+uint8_t RFID_value_decode(const uint8_t *block, int32_t *value, uint8_t *addr)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        if ((uint8_t)~block[4 + i] != block[i] || block[8 + i] != block[i])
+            return MI_ERR;
+    }
+    if ((uint8_t)~block[13] != block[12] || block[14] != block[12] || (uint8_t)~block[15] != block[12])
+        return MI_ERR;
+
+    *value = (int32_t)((uint32_t)block[0] | ((uint32_t)block[1] << 8) |
+                       ((uint32_t)block[2] << 16) | ((uint32_t)block[3] << 24));
+    if (addr)
+        *addr = block[12];
+    return MI_OK;
+}
+
+/*!
+ * \brief Запись блока значения: начальный счетчик перед выдачей карты
+ */
+uint8_t RFID_value_format(uint8_t addrBlock, int32_t value, uint8_t *key, uint8_t *uid)
+{
+    uint8_t block[MAX_LEN];
+
+    if (!RFID_value_block(addrBlock))
+        return MI_ERR;
+    RFID_value_encode(value, addrBlock, block);
+    return RFID_WriteBlock(addrBlock, block, key, uid);
+}
+
+/*!
+ * \brief Чтение блока значения с проверкой формата
+ */
+uint8_t RFID_value_read(uint8_t addrBlock, int32_t *value, uint8_t *key, uint8_t *uid)
+{
+    uint8_t block[MAX_LEN];
+    uint8_t status = RFID_ReadBlock(addrBlock, block, key, uid);
+
+    if (status != MI_OK)
+        return status;
+    return RFID_value_decode(block, value, NULL);
+}
+
+/*!
+ * \brief Увеличение счетчика на карте: INCREMENT и TRANSFER, без чтения и записи блока
+ */
+uint8_t RFID_value_increment(uint8_t addrBlock, int32_t delta, uint8_t *key, uint8_t *uid)
+{
+    if (delta < 0)
+        return MI_ERR;
+    return RFID_value_op(PICC_INCREMENT, addrBlock, addrBlock, delta, key, uid);
+}
+
+/*!
+ * \brief Уменьшение счетчика на карте: DECREMENT и TRANSFER
+ * \details Карта не ограничивает значение снизу: остаток проверяется до списания
+ */
+uint8_t RFID_value_decrement(uint8_t addrBlock, int32_t delta, uint8_t *key, uint8_t *uid)
+{
+    if (delta < 0)
+        return MI_ERR;
+    return RFID_value_op(PICC_DECREMENT, addrBlock, addrBlock, delta, key, uid);
+}
+
+/*!
+ * \brief Копия блока значения в другой блок того же сектора: RESTORE и TRANSFER
+ * \details Резервная копия счетчика или восстановление из нее после сбоя
+ */
+uint8_t RFID_value_copy(uint8_t srcBlock, uint8_t dstBlock, uint8_t *key, uint8_t *uid)
+{
+    if (RFID_sector(srcBlock) != RFID_sector(dstBlock))
+        return MI_ERR;
+    return RFID_value_op(PICC_RESTORE, srcBlock, dstBlock, 0, key, uid);
+}
+
+/*!
+ * \brief Операция над src во внутреннем регистре карты и запись результата в dst
+ * \details Блок dst меняется только по TRANSFER - одной записью EEPROM: при снятии карты
+ * посреди операции счетчик остается прежним.
+ */
+static uint8_t RFID_value_op(uint8_t command, uint8_t src, uint8_t dst, int32_t operand, uint8_t *key, uint8_t *uid)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t status;
+
+    if (!RFID_value_block(src) || !RFID_value_block(dst))
+        return MI_ERR;
+    status = RFID_session_auth(src, key, uid);
+    if (status != MI_OK)
+        return status;
+    //после NAK карта уходит в IDLE - сессия больше не действительна
+    if (MFRC522_Value(dev, command, src, operand) != MI_OK || MFRC522_Transfer(dev, dst) != MI_OK) {
+        RFID_session_reset();
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/*!
+ * \brief Блок данных: не блок производителя и не трейлер сектора
+ */
+static uint8_t RFID_value_block(uint8_t addrBlock)
+{
+    uint8_t sector = RFID_sector(addrBlock);
+
+    return addrBlock != 0 && addrBlock != RFID_sector_first_block(sector) + RFID_sector_blocks(sector) - 1;
+}
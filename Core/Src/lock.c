@@ -2,11 +2,37 @@
 
 static void HAL_TIM_MspPostInit(TIM_HandleTypeDef* htim);
 static void MX_TIM3_Init(void);
-static uint8_t Lock_check_password(void);
+static uint8_t Lock_check_password(const uint8_t *block);
+static uint8_t Lock_check_card(uint8_t *source);
+static uint8_t Lock_check_cache(const rfid_uid_t *card);
+static uint8_t Lock_check_db(const rfid_uid_t *card);
+static void Lock_card_event(rfid_card_event_t event, const rfid_uid_t *card, uint8_t status, void *ctx);
 static void Lock_close(void);
 static void Lock_open(void);
 static void Lock_led(void);
 
+static uint8_t lock_key[KEY_LEN] = {0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF};
+
+// При появлении карты после SELECT: кэш проверенных карт -> аутентификация сектора 0 -> чтение блока 1
+static const rfid_step_t lock_check_steps[] = {
+    {RFID_STEP_CHECK,    0,    NULL,     NULL},
+    {RFID_STEP_AUTH,     0x03, lock_key, NULL},
+    {RFID_STEP_READ,     0x01, NULL,     rfid.buff},
+};
+
+// С базой карт: после SELECT только поиск UID в базе, незнакомая карта отклоняется без обмена
+static const rfid_step_t lock_db_steps[] = {
+    {RFID_STEP_CHECK,    0,    NULL,     NULL},
+};
+
+static volatile uint8_t lock_check_ready;
+static uint8_t lock_check_status;
+static rfid_uid_t lock_check_card;
+static uint8_t lock_check_reader;
+static uint32_t lock_check_start;               //MFRC522_Cycles начала цепочки появления - для задержки решения
+static uint8_t lock_check_cached;
+static uint8_t lock_cached[RC522_READERS];      //результат шага CHECK взят из кэша, блок 1 не читался
+
 void Lock_init(void)
 {
     pin_init(PIN_R_EN);
@@ -14,6 +40,21 @@ void Lock_init(void)
     pin_init(PIN_POWER);
 
     MX_TIM3_Init();
+    RFID_log_init();
+    RFID_db_init();
+    //вход и выход одной двери: карта на любом считывателе переключает замок.
+    //С базой карт достаточно UID - сектор с паролем не читается
+    for(uint8_t i = 0; i < RC522_READERS; i++) {
+        RFID_reader_use(i);
+        if(RFID_db_count()) {
+            RFID_presence_init(Lock_card_event, RFID_reader(i), lock_db_steps, ARRAY_SIZE(lock_db_steps));
+            RFID_presence_check(Lock_check_db);
+        } else {
+            RFID_presence_init(Lock_card_event, RFID_reader(i), lock_check_steps, ARRAY_SIZE(lock_check_steps));
+            RFID_presence_check(Lock_check_cache);
+        }
+    }
+    RFID_reader_use(0);
 }
 
 static void MX_TIM3_Init(void)
@@ -90,25 +131,88 @@ static void Lock_close(void)
     HAL_TIM_PWM_Stop(&htim3, TIM_CHANNEL_2); //остановка 3ого таймера в режиме ШИМ на канал 2
 }
 
-static uint8_t Lock_check_password(void)
+static uint8_t Lock_check_password(const uint8_t *block)
 {
-  uint8_t key[6] = {0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF};
   uint8_t password[16] = {
     0x11, 0x22, 0x33, 0x44,
     0x55, 0x66, 0x77, 0x88,
     0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00
   };
-  if(RFID_getUID(rfid.uid) == MI_OK) {
-    MFRC522_SelectTag(rfid.uid);
-    if(RFID_ReadBlock(0x01, rfid.buff, key, rfid.uid) == MI_OK) {
-      if(!memcmp(rfid.buff, password, 16)) //если пароль совпал - возвращаем ок
-        return MI_OK;
-    }
-  } 
+  if(!memcmp(block, password, 16)) //если пароль совпал - возвращаем ок
+    return MI_OK;
   return MI_ERR;
 }
 
+/*!
+ * \brief События карты: пароль проверяется один раз при появлении, карта на считывателе
+ * замок больше не переключает. ctx - считыватель (RFID_reader_t)
+ */
+static void Lock_card_event(rfid_card_event_t event, const rfid_uid_t *card, uint8_t status, void *ctx)
+{
+  if(event == RFID_CARD_ARRIVED) {
+    lock_check_card = *card;
+    lock_check_reader = ((RFID_reader_t *)ctx)->index;
+    lock_check_start = ((RFID_reader_t *)ctx)->presence.req.start;
+    lock_check_cached = lock_cached[lock_check_reader];
+    lock_cached[lock_check_reader] = 0;
+    lock_check_status = status;
+    lock_check_ready = 1;
+  }
+}
+
+/*!
+ * \brief Допуск карты: по базе RFID_db, если она загружена, иначе по паролю в блоке 1
+ * \param[out] source - чем принято решение, rfid_log_source_t
+ */
+static uint8_t Lock_check_card(uint8_t *source)
+{
+  uint8_t result;
+
+  if(RFID_db_count() == 0) {
+    if(lock_check_cached) {
+      *source = RFID_LOG_SRC_CACHE;
+      return lock_check_status;
+    }
+    *source = RFID_LOG_SRC_PASSWORD;
+    if(lock_check_status != MI_OK)
+      return MI_ERR;
+    //в кэш - только прочитанный пароль: сбой обмена не должен закрывать карте проход
+    result = Lock_check_password(rfid.buff);
+    RFID_cache_put(&lock_check_card, result);
+    return result;
+  }
+  //решение уже принято шагом CHECK (Lock_check_db) сразу после SELECT
+  *source = RFID_LOG_SRC_DB;
+  return (lock_check_status == MI_OK) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Шаг RFID_STEP_CHECK с базой: карта не из базы, изъятая или без права на этот
+ * считыватель отклоняется до любого обмена после SELECT. Поиск в RAM/flash - единицы мкс.
+ */
+static uint8_t Lock_check_db(const rfid_uid_t *card)
+{
+  uint8_t attr;
+
+  if(RFID_db_lookup(card, &attr) != MI_OK || (attr & RFID_DB_ATTR_BLOCKED))
+    return MI_ERR;
+  return (attr & (1 << rfid.reader->index)) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Шаг RFID_STEP_CHECK без базы: недавно проверенная карта обходится без Crypto1 и чтения блока
+ */
+static uint8_t Lock_check_cache(const rfid_uid_t *card)
+{
+  uint8_t result;
+
+  if(RFID_cache_get(card, &result) != MI_OK)
+    return MI_OK;
+  lock_cached[rfid.reader->index] = 1;
+  return (result == MI_OK) ? RFID_CHECK_DONE : MI_ERR;
+}
+
 static void Lock_led(void)
 {
     pin_set(PIN_BLINK_GREEN_LED);
@@ -128,6 +232,7 @@ void Lock_change_key(void)
     0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF    //Key B
   };
   if(RFID_getUID(rfid.uid) == MI_OK) {
+    RFID_cache_invalidate(&rfid.reader->card);
     if(RFID_ChangeKey(0x03, rfid.defkey, KeyData, rfid.uid) == MI_OK) //меняем ключ первого сектора
       Lock_led();
   }
@@ -149,7 +254,7 @@ void Lock_write_password(void)
   };
 
   if(RFID_getUID(rfid.uid) == MI_OK) {
-    MFRC522_SelectTag(rfid.uid);
+    RFID_cache_invalidate(&rfid.reader->card);
     if(RFID_WriteBlock(0x01, password, key, rfid.uid) == MI_OK)
       Lock_led();
   } 
@@ -157,22 +262,36 @@ void Lock_write_password(void)
 }
 
 
+/*!
+ * \brief Задача замка: обрабатывает результат проверки карты при ее появлении.
+ * \details Обмен с картой идет в фоне через RFID_presence_task и RFID_poll, функция не блокирует главный цикл.
+ */
 void Lock_task(void)
 {
-    if(Lock_check_password() == MI_OK) {
-        switch(lock_state) {   
-            case state_close:
-                //если было закрыто - открываем
-                Lock_open();
-                lock_state = state_open;
-                break;
-            case state_open:
-                //если было открыто - закрываем
-                Lock_close();
-                lock_state = state_close;
-                break;
+    uint8_t source, decision = RFID_LOG_DENIED;
+
+    if(lock_check_ready) {
+        lock_check_ready = 0;
+        if(Lock_check_card(&source) == MI_OK) {
+            switch(lock_state) {
+                case state_close:
+                    //если было закрыто - открываем
+                    Lock_open();
+                    lock_state = state_open;
+                    decision = RFID_LOG_OPENED;
+                    break;
+                case state_open:
+                    //если было открыто - закрываем
+                    Lock_close();
+                    lock_state = state_close;
+                    decision = RFID_LOG_CLOSED;
+                    break;
+            }
         }
-        Lock_led();
+        //в журнале только копия в RAM, flash пишет RFID_log_task между обменами
+        RFID_log_event(&lock_check_card, decision, source, lock_check_reader,
+                       (MFRC522_Cycles() - lock_check_start) / MFRC522_CyclesPerUs());
+        if(decision != RFID_LOG_DENIED)
+            Lock_led();
     }
-    RFID_close();
-}
\ No newline at end of file
+}
@@ -4,6 +4,8 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_SPI2_Init(void);
 static void initUart2 (void);
+static void MX_EXTI_Init(void);
+static void MX_DWT_Init(void);
 
 void init_task(void)
 {
@@ -11,7 +13,10 @@ void init_task(void)
 
     SystemClock_Config();
     MX_GPIO_Init();
+    MX_EXTI_Init();
+    MX_DWT_Init();
     MX_SPI2_Init();
+    spi_dma_init(&spi_dma_bus2);
     interface_init();
     initUart2();
 }
@@ -101,13 +106,57 @@ void init_task(void)
   pin_init_af(PIN_SPI_MOSI, GPIO_AF5_SPI2);
  
   pin_init(PIN_RESET);
+  pin_init(PIN_IRQ);
   pin_init(PIN_CS);
   pin_clr(PIN_CS); //выбираем slave
+#if RC522_READERS > 1
+  pin_init(PIN_RESET2);
+  pin_init(PIN_IRQ2);
+  pin_init(PIN_CS2); //H: на общей шине выбран только один считыватель
+#endif
 
   pin_init(PIN_BLINK_GREEN_LED);
   pin_init(PIN_BUTTON);
  }
  
+ /**
+  * @brief Линия IRQ RC522 (PB1) на EXTI1, второго считывателя (PB4) на EXTI4, спадающий фронт
+  */
+ static void MX_EXTI_Init(void)
+ {
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+
+  SYSCFG->EXTICR[0] = (SYSCFG->EXTICR[0] & ~SYSCFG_EXTICR1_EXTI1) | SYSCFG_EXTICR1_EXTI1_PB;
+  EXTI->RTSR &= ~EXTI_RTSR_TR1;
+  EXTI->FTSR |= EXTI_FTSR_TR1;
+  EXTI->PR = EXTI_PR_PR1;
+  EXTI->IMR |= EXTI_IMR_MR1;
+
+  NVIC_SetPriority(EXTI1_IRQn, 5);
+  NVIC_EnableIRQ(EXTI1_IRQn);
+
+#if RC522_READERS > 1
+  SYSCFG->EXTICR[1] = (SYSCFG->EXTICR[1] & ~SYSCFG_EXTICR2_EXTI4) | SYSCFG_EXTICR2_EXTI4_PB;
+  EXTI->RTSR &= ~EXTI_RTSR_TR4;
+  EXTI->FTSR |= EXTI_FTSR_TR4;
+  EXTI->PR = EXTI_PR_PR4;
+  EXTI->IMR |= EXTI_IMR_MR4;
+
+  NVIC_SetPriority(EXTI4_IRQn, 5);
+  NVIC_EnableIRQ(EXTI4_IRQn);
+#endif
+ }
+
+ /**
+  * @brief Счетчик тактов DWT - для таймаутов в микросекундах
+  */
+ static void MX_DWT_Init(void)
+ {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+ }
+
  static void initUart2 (void)
  {
      // Инитим сам уарт
@@ -118,6 +167,13 @@ void init_task(void)
  
      struct termios settings;
      tcgetattr(sck_2, &settings);
-     tcsetiospeed(&settings, B9600); //скорость 115200 бит/c
+     tcsetiospeed(&settings, B115200); //скорость 115200 бит/c
      tcsetattr(sck_2, 0, &settings);
+ }
+
+ /*!
+  * \brief Переключение линии на передачу перед tl_send: UART2 полнодуплексный, переключать нечего
+  */
+ void switchToTx(void)
+ {
  }
\ No newline at end of file
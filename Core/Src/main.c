@@ -7,12 +7,22 @@ int main(void)
   init_task();
   RFID_init();
   Lock_init();
+  RFID_export_init(sck_2);
 
   while (1)
   {
     RFID_reinit();
-    
+    RFID_poll();
+    RFID_log_task();
+    RFID_export_task();
+    RFID_image_task();
+    RFID_trace_task();
+    RFID_inventory_task();
+    RFID_detect_task();
+    RFID_presence_task();
+
     Lock_task();
+    RFID_reader_task();
     // MY_change_key();
     // MY_write_password();
   }
@@ -1,178 +1,907 @@
 #include "include.h"
 
+#ifdef RC522_SIM
+#include "rc522_sim.h"
+// Сборка на ПК: вместо SPI2 - модель микросхемы, вместо DWT - виртуальное время модели
+#define RC522_CYCCNT()              rc522_sim_cycles()
+#define RC522_CYCLES_PER_US         RC522_SIM_CPU_MHZ
+#define RC522_SPI_BUS               NULL
+#else
+#define RC522_CYCCNT()              (DWT->CYCCNT)
+#define RC522_CYCLES_PER_US         (SystemCoreClock / 1000000)
+#define RC522_SPI_BUS               (&spi_dma_bus2)
+#endif
+
+static void MFRC522_FifoAsyncDone(spi_dma_xfer_t *xfer);
+static void MFRC522_Xmit(mfrc522_t *dev, const uint8_t *tx, uint8_t *rx, uint16_t len);
+static uchar MFRC522_Submit(mfrc522_t *dev);
+static void MFRC522_WaitPowerUp(mfrc522_t *dev);
+static void MFRC522_Learn(mfrc522_t *dev, uchar irq, uint16_t counter);
+static uchar MFRC522_FifoBusy(mfrc522_t *dev);
+static void MFRC522_ToCardRun(mfrc522_t *dev);
+static uchar MFRC522_ToCardDone(mfrc522_t *dev, uchar *backData, uchar backSize, uint *backLen);
+
+// Настройки, записываемые при инициализации. По ним же MFRC522_Check сверяет
+// регистры: mask - биты, которые драйвер не меняет между инициализациями
+static const struct
+{
+  uchar reg;
+  uchar val;
+  uchar mask;
+} rc522Config[] = {
+  {CommIEnReg,    0x80, 0x80},        // IRqInv: линия IRQ активна нулем
+  {DivlEnReg,     0x80, 0x80},        // IRQPushPull: без внешней подтяжки
+  {TModeReg,      0x80, 0xFF},
+  {TPrescalerReg, 0xA9, 0xFF},        // 13,56 МГц / (2 * 169 + 1) = 40 кГц, 25 мкс
+  {TxAutoReg,     0x40, 0x40},
+  {ModeReg,       0x3D, 0xAB},
+  {CollReg,       0x00, 0x80},        // ValuesAfterColl = 0: биты после коллизии принимаются нулями
+};
+
+// Границы ожидания ответа по профилям, тики таймера RC522 по 25 мкс. Таймер (TAuto)
+// запускается в конце передачи и останавливается на первых битах ответа: граница -
+// время до начала ответа, а не до конца кадра. До RC522_TMO_LEARN ответов и после
+// таймаута посреди обмена действует max, затем удвоенное наибольшее измеренное время
+// (mfrc522_t.tmo, у каждого считывателя свое).
+static const struct
+{
+  uint16_t min;
+  uint16_t max;
+} rc522Tmo[RC522_TMO_COUNT] = {
+  [RC522_TMO_REQA]       = {8,   40},   // ATQA через 86 мкс (FDT, n = 9)
+  [RC522_TMO_ANTICOLL]   = {8,   40},
+  [RC522_TMO_SELECT]     = {8,   40},
+  [RC522_TMO_AUTH]       = {20,  200},  // три прохода Crypto1 внутри MFAuthent
+  [RC522_TMO_READ]       = {8,   200},
+  [RC522_TMO_WRITE]      = {8,   200},
+  [RC522_TMO_WRITE_DATA] = {200, 800},  // запись EEPROM карты 2,5..10 мс
+  [RC522_TMO_HALT]       = {40,  40},
+  [RC522_TMO_VALUE]      = {40,  40},   // NAK приходит в пределах 1 мс, ACK нет
+  [RC522_TMO_TCL]        = {1,   0xFFFF},
+  [RC522_TMO_DEFAULT]    = {RC522_TIMER_RELOAD, RC522_TIMER_RELOAD},
+};
+
+// Регистры настройки, которые меняет только драйвер: их значение хранится в mfrc522_t.shadow,
+// и SetBitMask/ClearBitMask пишут без предварительного чтения. mask - биты, которые микросхема
+// возвращает так, как они записаны (без зарезервированных и StartSend). Регистры, которые
+// меняет сама микросхема (CommandReg, Status2Reg, флаги и счетчики), всегда читаются.
+static const struct
+{
+  uchar reg;
+  uchar mask;
+} rc522Shadow[RC522_SHADOW_REGS] = {
+  {CommIEnReg,    0xFF},
+  {DivlEnReg,     0x94},
+  {BitFramingReg, 0x77},
+  {ModeReg,       0xAB},
+  {TxModeReg,     0xF8},
+  {RxModeReg,     0xFC},
+  {TxControlReg,  0xFB},
+  {TxAutoReg,     0x40},
+  {RFCfgReg,      0x70},
+  {TModeReg,      0xFF},
+  {TPrescalerReg, 0xFF},
+  {TReloadRegH,   0xFF},
+  {TReloadRegL,   0xFF},
+};
+
+// Считыватели на общей шине SPI2: очередь DMA у них одна, считыватель выбирается своим CS
+#define MFRC522_READER(idx, csPort, csPin, rstPort, rstPin) \
+  {.index = idx, .bus = RC522_SPI_BUS, .cs_port = csPort, .cs_pin = csPin, .rst_port = rstPort, .rst_pin = rstPin, \
+   .crcMode = RC522_CRC_SOFTWARE, .toCard.next = RC522_TMO_COUNT, .fwt = RC522_TIMER_RELOAD, \
+   .fifo.xfer.callback = MFRC522_FifoAsyncDone}
+
+static mfrc522_t rc522Readers[RC522_READERS] = {
+  MFRC522_READER(0, PORT_CS_HAL, PIN_CS_HAL, PORT_RESET_HAL, PIN_RESET_HAL),
+#if RC522_READERS > 1
+  MFRC522_READER(1, PORT_CS2_HAL, PIN_CS2_HAL, PORT_RESET2_HAL, PIN_RESET2_HAL),
+#endif
+};
+
 /* ======================================================================	*/
 /* Функция обмена байтами по SPI    										*/
 /* ======================================================================	*/
 uint8_t spiXmit (SPI_TypeDef *SPIx, uint8_t byte)
 {
     SPIx->DR = byte;
-    for (int i = 0; i<0xFFFFFF; i++) {
+    for (int i = 0; i<SPI_DMA_POLL_TIMEOUT; i++) {
         if(SPIx->SR & SPI_SR_RXNE) {
             return SPIx->DR;
         }
     }
+    return 0;
 }
 
-void Write_MFRC522(uchar addr, uchar val)
+/* ======================================================================	*/
+/* Все обращения к RC522 проходят через одну транзакцию на шине			*/
+/* ======================================================================	*/
+static void MFRC522_Xmit(mfrc522_t *dev, const uint8_t *tx, uint8_t *rx, uint16_t len)
 {
-  PORT_CS_HAL->ODR &=~ PIN_CS_HAL;
-  spiXmit (hspi2.Instance, addr<<1);
-  spiXmit (hspi2.Instance, val);
-  PORT_CS_HAL->ODR |= PIN_CS_HAL;
+#ifdef RC522_SIM
+  rc522_sim_xmit(tx, rx, len);
+#else
+  spi_dma_xmit(dev->bus, dev->cs_port, dev->cs_pin, tx, rx, len);
+#endif
 }
 
-uchar Read_MFRC522(uchar addr)
+/*!
+ * \brief Номер регистра в rc522Shadow, RC522_SHADOW_REGS - регистр без тени
+ */
+static uchar MFRC522_ShadowIndex(uchar addr)
 {
-  uint8_t tmp;
-  uint8_t addr_new = SPI_READ_SIGN | (addr<<1);
+  uchar i;
+
+  for (i = 0; i < RC522_SHADOW_REGS; i++)
+  {
+    if (rc522Shadow[i].reg == addr)
+    {
+      break;
+    }
+  }
+  return i;
+}
 
-  PORT_CS_HAL->ODR &=~ PIN_CS_HAL;
-  spiXmit (hspi2.Instance, addr_new);
-  tmp = spiXmit (hspi2.Instance, 0);
-  PORT_CS_HAL->ODR |= PIN_CS_HAL;
+void Write_MFRC522(mfrc522_t *dev, uchar addr, uchar val)
+{
+  uint8_t frame[2] = {addr<<1, val};
+  uchar i = MFRC522_ShadowIndex(addr);
 
-  return tmp;
+  MFRC522_Xmit(dev, frame, NULL, sizeof(frame));
+  if (i < RC522_SHADOW_REGS)
+  {
+    dev->shadow[i] = val;
+    dev->shadowValid |= 1u << i;
+  }
 }
 
-void SetBitMask(uchar reg, uchar mask)
+uchar Read_MFRC522(mfrc522_t *dev, uchar addr)
 {
-  uchar tmp;
-  tmp = Read_MFRC522(reg);
-  Write_MFRC522(reg, tmp | mask);
+  uint8_t tx[2] = {SPI_READ_SIGN | (addr<<1), 0};
+  uint8_t rx[2];
+
+  MFRC522_Xmit(dev, tx, rx, sizeof(tx));
+
+  return rx[1];
+}
+
+/* ======================================================================	*/
+/* Пакетная запись в FIFO: адрес FIFODataReg и len байт данных за один CS	*/
+/* ======================================================================	*/
+void MFRC522_WriteFifo(mfrc522_t *dev, uchar *data, uchar len)
+{
+  uint8_t frame[MFRC522_FIFO_SIZE + 1];
+
+  len = MIN(len, MFRC522_FIFO_SIZE);
+  frame[0] = FIFODataReg<<1;
+  memcpy(&frame[1], data, len);
+  MFRC522_Xmit(dev, frame, NULL, len + 1);
+}
+
+/* ======================================================================	*/
+/* Пакетное чтение FIFO: адрес чтения повторяется len раз, данные каждого	*/
+/* байта приходят в ответ на следующий адрес (datasheet 8.1.2.1)			*/
+/* ======================================================================	*/
+void MFRC522_ReadFifo(mfrc522_t *dev, uchar *data, uchar len)
+{
+  uint8_t tx[MFRC522_FIFO_SIZE + 1];
+  uint8_t rx[MFRC522_FIFO_SIZE + 1];
+
+  len = MIN(len, MFRC522_FIFO_SIZE);
+  if (len == 0)
+  {
+    return;
+  }
+
+  memset(tx, SPI_READ_SIGN | (FIFODataReg<<1), len);
+  tx[len] = 0;
+  MFRC522_Xmit(dev, tx, rx, len + 1);
+  memcpy(data, &rx[1], len);
 }
 
-void ClearBitMask(uchar reg, uchar mask)
+/* ======================================================================	*/
+/* Асинхронные варианты: транзакция уходит в очередь DMA, done(ctx)			*/
+/* вызывается из прерывания по завершении. Одновременно - одна операция.	*/
+/* ======================================================================	*/
+uchar MFRC522_WriteFifoAsync(mfrc522_t *dev, uchar *data, uchar len, void (*done)(void *ctx), void *ctx)
 {
-  uchar tmp;
-  tmp = Read_MFRC522(reg);
-  Write_MFRC522(reg, tmp & (~mask));
+  if (MFRC522_FifoBusy(dev))
+  {
+    return MI_ERR;
+  }
+
+  len = MIN(len, MFRC522_FIFO_SIZE);
+  dev->fifo.tx[0] = FIFODataReg<<1;
+  memcpy(&dev->fifo.tx[1], data, len);
+
+  dev->fifo.dst = NULL;
+  dev->fifo.done = done;
+  dev->fifo.ctx = ctx;
+  dev->fifo.xfer.tx = dev->fifo.tx;
+  dev->fifo.xfer.rx = NULL;
+  dev->fifo.xfer.len = len + 1;
+
+  return MFRC522_Submit(dev);
 }
 
-void AntennaOn()
+uchar MFRC522_ReadFifoAsync(mfrc522_t *dev, uchar *data, uchar len, void (*done)(void *ctx), void *ctx)
 {
-  Read_MFRC522(TxControlReg);
-  SetBitMask(TxControlReg, 0x03);
+  if (MFRC522_FifoBusy(dev) || (len == 0))
+  {
+    return MI_ERR;
+  }
+
+  len = MIN(len, MFRC522_FIFO_SIZE);
+  memset(dev->fifo.tx, SPI_READ_SIGN | (FIFODataReg<<1), len);
+  dev->fifo.tx[len] = 0;
+
+  dev->fifo.dst = data;
+  dev->fifo.done = done;
+  dev->fifo.ctx = ctx;
+  dev->fifo.xfer.tx = dev->fifo.tx;
+  dev->fifo.xfer.rx = dev->fifo.rx;
+  dev->fifo.xfer.len = len + 1;
+
+  return MFRC522_Submit(dev);
 }
 
-void AntennaOff()
+static uchar MFRC522_FifoBusy(mfrc522_t *dev)
 {
-  ClearBitMask(TxControlReg, 0x03);
+  return (dev->fifo.xfer.status == SPI_DMA_QUEUED) || (dev->fifo.xfer.status == SPI_DMA_BUSY);
 }
 
-void MFRC522_Reset()
+static uchar MFRC522_Submit(mfrc522_t *dev)
 {
-  Write_MFRC522(CommandReg, PCD_RESETPHASE);
+  dev->fifo.xfer.cs_port = dev->cs_port;
+  dev->fifo.xfer.cs_pin = dev->cs_pin;
+  dev->fifo.xfer.ctx = dev;
+#ifdef RC522_SIM
+  // у модели нет DMA: транзакция выполняется сразу, callback - как из прерывания
+  rc522_sim_xmit(dev->fifo.xfer.tx, dev->fifo.xfer.rx, dev->fifo.xfer.len);
+  dev->fifo.xfer.status = SPI_DMA_DONE;
+  MFRC522_FifoAsyncDone(&dev->fifo.xfer);
+  return MI_OK;
+#else
+  return spi_dma_submit(dev->bus, &dev->fifo.xfer) ? MI_OK : MI_ERR;
+#endif
 }
 
-void MFRC522_Init(void)
+static void MFRC522_FifoAsyncDone(spi_dma_xfer_t *xfer)
 {
+  mfrc522_t *dev = xfer->ctx;
 
-  PORT_CS_HAL->BSRR = PIN_CS_HAL;
-  PORT_RESET_HAL->BSRR = PIN_RESET_HAL;
-  MFRC522_Reset();
+  if (dev->fifo.dst)
+  {
+    memcpy(dev->fifo.dst, &dev->fifo.rx[1], xfer->len - 1);
+  }
+  if (dev->fifo.done)
+  {
+    dev->fifo.done(dev->fifo.ctx);
+  }
+}
 
-  Write_MFRC522(TModeReg, 0x80);
-  Write_MFRC522(TPrescalerReg, 0xA9);
-  Write_MFRC522(TReloadRegH, 0x03);
-  Write_MFRC522(TReloadRegL, 0xE8);
+/* ======================================================================	*/
+/* Чтение нескольких произвольных регистров за один CS						*/
+/* ======================================================================	*/
+static void MFRC522_ReadRegs(mfrc522_t *dev, const uchar *addrs, uchar *vals, uchar count)
+{
+  uint8_t tx[16];
+  uint8_t rx[16];
+  uchar i;
 
-  Write_MFRC522(TxAutoReg, 0x40);
-  Write_MFRC522(ModeReg, 0x3D);
+  count = MIN(count, sizeof(tx) - 1);
+  for (i = 0; i < count; i++)
+  {
+    tx[i] = SPI_READ_SIGN | (addrs[i]<<1);
+  }
+  tx[count] = 0;
+  MFRC522_Xmit(dev, tx, rx, count + 1);
+  memcpy(vals, &rx[1], count);
+}
 
-  AntennaOn();
+/* ======================================================================	*/
+/* Линия IRQ микросхемы: активный ноль (IRqInv), push-pull (IRQPushPull)	*/
+/* ======================================================================	*/
+void EXTI1_IRQHandler(void)
+{
+#ifndef RC522_SIM
+  EXTI->PR = PIN_IRQ_HAL;
+#endif
+  MFRC522_IrqHandler(&rc522Readers[0]);
 }
 
-uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen)
+#if RC522_READERS > 1
+void EXTI4_IRQHandler(void)
+{
+#ifndef RC522_SIM
+  EXTI->PR = PIN_IRQ2_HAL;
+#endif
+  MFRC522_IrqHandler(&rc522Readers[1]);
+}
+#endif
+
+/*!
+ * \brief Фронт на линии IRQ считывателя, вызывается из его обработчика EXTI
+ * \details Флаг взводится, даже если шину сейчас занимает другой считыватель:
+ * MFRC522_IrqPending этого считывателя прочитает регистр при следующем опросе.
+ */
+void MFRC522_IrqHandler(mfrc522_t *dev)
+{
+  dev->irq = 1;
+}
+
+/* ======================================================================	*/
+/* Считыватели на общей шине												*/
+/* ======================================================================	*/
+mfrc522_t *MFRC522_Reader(uchar index)
+{
+  return (index < RC522_READERS) ? &rc522Readers[index] : NULL;
+}
+
+/*!
+ * \brief Проверка завершения команды RC522 без опроса по SPI
+ * \details Регистр reg читается только после фронта на линии IRQ. Граница ожидания задается
+ * в тактах DWT от момента start и не зависит от скорости SPI.
+ * \param[out] irq - значение регистра reg, если в нем выставлен один из битов mask, иначе 0
+ * \return MI_BUSY - событие еще не наступило, MI_OK - событие, MI_ERR - таймаут
+ */
+static uchar MFRC522_IrqPending(mfrc522_t *dev, uchar reg, uchar mask, uint32_t start, uint32_t ticks, uchar *irq)
 {
-  uchar status = MI_ERR;
-  uchar irqEn = 0x00;
-  uchar waitIRq = 0x00;
-  uchar lastBits;
   uchar n;
-  uint i;
+
+  *irq = 0;
+  if (dev->irq)
+  {
+    dev->irq = 0;
+    n = Read_MFRC522(dev, reg);
+    if (n & mask)
+    {
+      *irq = n;
+      return MI_OK;
+    }
+  }
+  if ((RC522_CYCCNT() - start) > ticks)
+  {
+    // фронт мог быть потерян - последняя проверка регистра
+    n = Read_MFRC522(dev, reg);
+    *irq = n & mask ? n : 0;
+    return *irq ? MI_OK : MI_ERR;
+  }
+  return MI_BUSY;
+}
+
+static uchar MFRC522_WaitIrq(mfrc522_t *dev, uchar reg, uchar mask, uint32_t timeout_us)
+{
+  uint32_t start = RC522_CYCCNT();
+  uint32_t ticks = timeout_us * RC522_CYCLES_PER_US;
+  uchar n;
+
+  while (MFRC522_IrqPending(dev, reg, mask, start, ticks, &n) == MI_BUSY)
+  {
+  }
+  return n;
+}
+
+/*!
+ * \brief Текущее значение регистра для изменения битов: из тени, если она есть, иначе с микросхемы
+ * \details В режиме RC522_SHADOW_VERIFY регистр читается всегда, расхождение считается в shadowMiss
+ */
+static uchar MFRC522_Modify(mfrc522_t *dev, uchar reg)
+{
+  uchar i = MFRC522_ShadowIndex(reg);
+
+  if ((i < RC522_SHADOW_REGS) && (dev->shadowValid & (1u << i)))
+  {
+#if RC522_SHADOW_VERIFY
+    if ((Read_MFRC522(dev, reg) ^ dev->shadow[i]) & rc522Shadow[i].mask)
+    {
+      dev->shadowMiss++;
+    }
+#endif
+    return dev->shadow[i];
+  }
+  return Read_MFRC522(dev, reg);
+}
+
+void SetBitMask(mfrc522_t *dev, uchar reg, uchar mask)
+{
+  Write_MFRC522(dev, reg, MFRC522_Modify(dev, reg) | mask);
+}
+
+void ClearBitMask(mfrc522_t *dev, uchar reg, uchar mask)
+{
+  Write_MFRC522(dev, reg, MFRC522_Modify(dev, reg) & (~mask));
+}
+
+void AntennaOn(mfrc522_t *dev)
+{
+  SetBitMask(dev, TxControlReg, 0x03);
+  dev->antenna = 1;
+}
+
+void AntennaOff(mfrc522_t *dev)
+{
+  ClearBitMask(dev, TxControlReg, 0x03);
+  dev->antenna = 0;
+}
+
+void MFRC522_Reset(mfrc522_t *dev)
+{
+  Write_MFRC522(dev, CommandReg, PCD_RESETPHASE);
+  MFRC522_WaitPowerUp(dev);
+  dev->shadowValid = 0;             // регистры вернулись к значениям после сброса
+}
+
+/*!
+ * \brief Ожидание запуска генератора: пока PowerDown = 1, записи в регистры теряются
+ */
+static void MFRC522_WaitPowerUp(mfrc522_t *dev)
+{
+  uint32_t start;
+
+  start = RC522_CYCCNT();
+  while ((Read_MFRC522(dev, CommandReg) & 0x10) &&
+         ((RC522_CYCCNT() - start) < RC522_RESET_TIMEOUT_US * RC522_CYCLES_PER_US))
+  {
+  }
+}
+
+void MFRC522_Init(mfrc522_t *dev)
+{
+  uchar i;
+
+#ifndef RC522_SIM
+  dev->cs_port->BSRR = dev->cs_pin;
+  dev->rst_port->BSRR = dev->rst_pin;
+#endif
+  MFRC522_Reset(dev);
+
+  dev->txCrc = dev->rxCrc = 0;       // после сброса TxModeReg/RxModeReg = 0x00
+  dev->errors = 0;
+  dev->version = Read_MFRC522(dev, VersionReg);
+
+  for (i = 0; i < ARRAY_SIZE(rc522Config); i++)
+  {
+    Write_MFRC522(dev, rc522Config[i].reg, rc522Config[i].val);
+  }
+  dev->reload = 0;                    // после сброса TReloadReg = 0
+  MFRC522_SetTimer(dev, RC522_TIMER_RELOAD);
+
+  AntennaOn(dev);
+}
+
+/*!
+ * \brief Граница ожидания ответа карты таймером RC522 в тиках по 25 мкс
+ * \details Регистры пишутся только при смене значения
+ */
+void MFRC522_SetTimer(mfrc522_t *dev, uint16_t reload)
+{
+  if (reload == dev->reload)
+  {
+    return;
+  }
+  Write_MFRC522(dev, TReloadRegH, reload >> 8);
+  Write_MFRC522(dev, TReloadRegL, reload & 0xFF);
+  dev->reload = reload;
+}
+
+/*!
+ * \brief Сверка теневых копий с регистрами микросхемы одной транзакцией
+ * \return число расхождений, они же добавляются в shadowMiss
+ */
+uchar MFRC522_ShadowVerify(mfrc522_t *dev)
+{
+  uchar addrs[RC522_SHADOW_REGS];
+  uchar vals[RC522_SHADOW_REGS];
+  uchar miss = 0;
+  uchar i;
+
+  for (i = 0; i < RC522_SHADOW_REGS; i++)
+  {
+    addrs[i] = rc522Shadow[i].reg;
+  }
+  MFRC522_ReadRegs(dev, addrs, vals, RC522_SHADOW_REGS);
+
+  for (i = 0; i < RC522_SHADOW_REGS; i++)
+  {
+    if ((dev->shadowValid & (1u << i)) && ((vals[i] ^ dev->shadow[i]) & rc522Shadow[i].mask))
+    {
+      miss++;
+    }
+  }
+  dev->shadowMiss += miss;
+  return miss;
+}
+
+/*!
+ * \brief Проверка исправности RC522 без вмешательства в обмен с картой
+ * \details VersionReg, TxControlReg, TReloadReg и настройки rc522Config читаются одной транзакцией.
+ * Можно вызывать и во время асинхронной команды - регистры только читаются.
+ */
+rc522_fault_t MFRC522_Check(mfrc522_t *dev)
+{
+  uchar addrs[ARRAY_SIZE(rc522Config) + 4];
+  uchar vals[ARRAY_SIZE(rc522Config) + 4];
+  uchar i;
+
+  addrs[0] = VersionReg;
+  addrs[1] = TxControlReg;
+  addrs[2] = TReloadRegH;
+  addrs[3] = TReloadRegL;
+  for (i = 0; i < ARRAY_SIZE(rc522Config); i++)
+  {
+    addrs[i + 4] = rc522Config[i].reg;
+  }
+  MFRC522_ReadRegs(dev, addrs, vals, sizeof(addrs));
+
+  // 0x00/0xFF - линия MISO без микросхемы
+  if ((vals[0] != dev->version) || (vals[0] == 0x00) || (vals[0] == 0xFF))
+  {
+    return RC522_FAULT_VERSION;
+  }
+  if ((vals[1] & 0x03) != (dev->antenna ? 0x03 : 0x00))
+  {
+    return RC522_FAULT_REGISTERS;     // поле выключено без AntennaOff: сброс или перегрев (TempErr)
+  }
+  if (((vals[2] << 8) | vals[3]) != dev->reload)
+  {
+    return RC522_FAULT_REGISTERS;
+  }
+  for (i = 0; i < ARRAY_SIZE(rc522Config); i++)
+  {
+    if ((vals[i + 4] ^ rc522Config[i].val) & rc522Config[i].mask)
+    {
+      return RC522_FAULT_REGISTERS;
+    }
+  }
+#if RC522_SHADOW_VERIFY
+  if (MFRC522_ShadowVerify(dev))
+  {
+    return RC522_FAULT_REGISTERS;
+  }
+#endif
+  if (dev->errors >= RC522_MAX_ERRORS)
+  {
+    return RC522_FAULT_ERRORS;
+  }
+  return RC522_FAULT_NONE;
+}
+
+/*!
+ * \brief Счетчик принятых ответов карт: изменился - в поле была карта
+ */
+uint32_t MFRC522_Answers(mfrc522_t *dev)
+{
+  return dev->answers;
+}
+
+/*!
+ * \brief Тактов счетчика времени обменов (DWT) в микросекунде
+ */
+uint32_t MFRC522_CyclesPerUs(void)
+{
+  return RC522_CYCLES_PER_US;
+}
+
+/*!
+ * \brief Текущее значение счетчика времени обменов (DWT), для замеров длительности
+ */
+uint32_t MFRC522_Cycles(void)
+{
+  return RC522_CYCCNT();
+}
+
+/*!
+ * \brief Мягкое выключение RC522 (PowerDown): генератор и поле выключены, регистры сохраняются
+ * \details При выходе ждем запуска генератора, как после SoftReset
+ */
+void MFRC522_PowerDown(mfrc522_t *dev, uchar on)
+{
+  if (on)
+  {
+    Write_MFRC522(dev, CommandReg, 0x10 | PCD_IDLE);
+    return;
+  }
+  Write_MFRC522(dev, CommandReg, PCD_IDLE);
+  MFRC522_WaitPowerUp(dev);
+}
+
+/*!
+ * \brief Скорости передачи к карте и приема от нее, RC522_RATE_*
+ * \details Регистры пишутся только при смене скорости. Ширина паузы модуляции (ModWidthReg)
+ * подбирается под скорость передачи: на 106 кбит/с - значение после сброса.
+ */
+void MFRC522_SetBitRate(mfrc522_t *dev, uchar tx, uchar rx)
+{
+  static const uchar modWidth[4] = {0x26, 0x15, 0x0A, 0x05};
+  uchar txMode = MFRC522_Modify(dev, TxModeReg);
+  uchar rxMode = MFRC522_Modify(dev, RxModeReg);
+
+  tx &= 0x03;
+  rx &= 0x03;
+  if (((txMode >> 4) & 0x07) != tx)
+  {
+    Write_MFRC522(dev, TxModeReg, (txMode & 0x8F) | (tx << 4));
+    Write_MFRC522(dev, ModWidthReg, modWidth[tx]);
+  }
+  if (((rxMode >> 4) & 0x07) != rx)
+  {
+    Write_MFRC522(dev, RxModeReg, (rxMode & 0x8F) | (rx << 4));
+  }
+}
+
+/*!
+ * \brief Время ожидания кадра карты ISO14443-4 (FWT) для профиля RC522_TMO_TCL
+ * \details Таймер RC522 считает до 0xFFFF тиков по 25 мкс: FWT больше 1,6 с ограничивается
+ */
+void MFRC522_SetFwt(mfrc522_t *dev, uint32_t us)
+{
+  uint32_t ticks = us / 25 + 1;
+
+  dev->fwt = MIN(ticks, 0xFFFF);
+}
+
+/*!
+ * \brief Профиль следующей команды MFRC522_ToCardStart вместо выбора по кадру
+ * \details Блоки ISO14443-4 по первому байту не отличить от команд MIFARE (R(ACK) 0xA2, DESELECT 0xC2)
+ */
+void MFRC522_NextProfile(mfrc522_t *dev, rc522_tmo_t profile)
+{
+  dev->toCard.next = profile;
+}
+
+/*!
+ * \brief Граница ожидания ответа профиля в тиках таймера по 25 мкс
+ */
+uint16_t MFRC522_Timeout(mfrc522_t *dev, rc522_tmo_t profile)
+{
+  uint16_t ticks;
+
+  if (profile == RC522_TMO_TCL)
+  {
+    return dev->fwt;
+  }
+  if (dev->tmo[profile].samples < RC522_TMO_LEARN)
+  {
+    return rc522Tmo[profile].max;
+  }
+  ticks = 2 * dev->tmo[profile].seen + RC522_TMO_MARGIN;
+  return MIN(MAX(ticks, rc522Tmo[profile].min), rc522Tmo[profile].max);
+}
+
+/*!
+ * \brief Профиль ожидания по команде RC522 и первому байту кадра
+ */
+static uchar MFRC522_Profile(mfrc522_t *dev, uchar command, const uchar *sendData, uchar sendLen)
+{
+  uchar next = dev->toCard.next;
+
+  dev->toCard.next = RC522_TMO_COUNT;
+  if (command == PCD_AUTHENT)
+  {
+    return RC522_TMO_AUTH;
+  }
+  if ((command != PCD_TRANSCEIVE) || (sendLen == 0))
+  {
+    return RC522_TMO_DEFAULT;
+  }
+  if (next != RC522_TMO_COUNT)
+  {
+    return next;
+  }
+
+  switch (sendData[0])
+  {
+  case PICC_REQIDL:
+  case PICC_REQALL:
+    return (sendLen == 1) ? RC522_TMO_REQA : RC522_TMO_DEFAULT;
+  case PICC_SEL_CL1:
+  case PICC_SEL_CL2:
+  case PICC_SEL_CL3:
+    return ((sendLen > 1) && (sendData[1] == 0x70)) ? RC522_TMO_SELECT : RC522_TMO_ANTICOLL;
+  case PICC_READ:
+  case PICC_UL_FAST_READ:
+  case PICC_UL_GET_VERSION:
+  case PICC_UL_PWD_AUTH:
+    return RC522_TMO_READ;
+  case PICC_UL_WRITE:
+    return RC522_TMO_WRITE_DATA;           // ACK после записи EEPROM
+  case PICC_WRITE:
+    dev->toCard.next = RC522_TMO_WRITE_DATA;
+    return RC522_TMO_WRITE;
+  case PICC_DECREMENT:
+  case PICC_INCREMENT:
+  case PICC_RESTORE:
+    dev->toCard.next = RC522_TMO_VALUE;
+    return RC522_TMO_WRITE;
+  case PICC_TRANSFER:
+    return RC522_TMO_WRITE_DATA;           // ACK после записи EEPROM
+  case PICC_HALT:
+    return RC522_TMO_HALT;
+  default:
+    return RC522_TMO_DEFAULT;
+  }
+}
+
+/*!
+ * \brief Запуск команды RC522 без ожидания результата
+ * \details Результат забирается MFRC522_ToCardPoll. Одновременно выполняется одна команда.
+ * Граница ожидания ответа выбирается по профилю команды, TReloadReg пишется только при смене.
+ * Кадр уходит в FIFO через DMA без ожидания, команду запускает MFRC522_ToCardPoll после загрузки.
+ */
+void MFRC522_ToCardStart(mfrc522_t *dev, uchar command, uchar *sendData, uchar sendLen)
+{
+  dev->toCard.profile = MFRC522_Profile(dev, command, sendData, sendLen);
+  MFRC522_SetTimer(dev, MFRC522_Timeout(dev, dev->toCard.profile));
+
+  dev->toCard.command = command;
+  dev->toCard.irqEn = 0x00;
+  dev->toCard.waitIRq = 0x00;
 
   switch (command)
   {
   case PCD_AUTHENT:
   {
-    irqEn = 0x12;
-    waitIRq = 0x10;
+    dev->toCard.irqEn = 0x12;
+    dev->toCard.waitIRq = 0x10;
     break;
   }
   case PCD_TRANSCEIVE:
   {
-    irqEn = 0x77;
-    waitIRq = 0x30;
+    dev->toCard.irqEn = 0x77;
+    dev->toCard.waitIRq = 0x30;
     break;
   }
   default:
     break;
   }
 
-  Write_MFRC522(CommIEnReg, irqEn | 0x80);
-  ClearBitMask(CommIrqReg, 0x80);
-  SetBitMask(FIFOLevelReg, 0x80);
+  // На линию IRQ выводим только завершающие события, иначе TxIRq/LoAlertIRq
+  // удержат линию в нуле и фронт по окончании приема не придет
+  Write_MFRC522(dev, CommIEnReg, dev->toCard.waitIRq | 0x01 | 0x80);
+  Write_MFRC522(dev, CommIrqReg, 0x7F);    // Set1 = 0: сбрасываем все флаги прерываний одной записью
+  Write_MFRC522(dev, FIFOLevelReg, 0x80);  // FlushBuffer
+  dev->irq = 0;
+
+  Write_MFRC522(dev, CommandReg, PCD_IDLE);
 
-  Write_MFRC522(CommandReg, PCD_IDLE);
+#if RFID_TRACE
+  RFID_trace_start(dev->index, command, sendData, sendLen, RC522_CYCCNT());
+#endif
+  // граница по DWT - с запасом больше таймера RC522, который для FWT карты бывает длиннее 25 мс
+  dev->toCard.ticks = MAX(RC522_CMD_TIMEOUT_US, dev->reload * 25u + RC522_CMD_MARGIN_US) * RC522_CYCLES_PER_US;
 
-  for (i = 0; i < sendLen; i++)
+  if (MFRC522_WriteFifoAsync(dev, sendData, sendLen, NULL, NULL) == MI_OK)
   {
-    Write_MFRC522(FIFODataReg, sendData[i]);
+    dev->toCard.phase = RC522_PHASE_LOAD;
+    return;
   }
+  // очередь DMA занята - загружаем без нее
+  MFRC522_WriteFifo(dev, sendData, sendLen);
+  MFRC522_ToCardRun(dev);
+}
 
-  Write_MFRC522(CommandReg, command);
-  if (command == PCD_TRANSCEIVE)
+/*!
+ * \brief Запуск команды после загрузки FIFO, отсчет границы ожидания - с этого момента
+ */
+static void MFRC522_ToCardRun(mfrc522_t *dev)
+{
+  dev->toCard.phase = RC522_PHASE_RUN;
+  dev->toCard.start = RC522_CYCCNT();
+  Write_MFRC522(dev, CommandReg, dev->toCard.command);
+  if (dev->toCard.command == PCD_TRANSCEIVE)
   {
-    SetBitMask(BitFramingReg, 0x80);
+    SetBitMask(dev, BitFramingReg, 0x80);
   }
+}
 
-  i = 2000;
-  do
+/*!
+ * \brief Проверка выполнения команды, запущенной MFRC522_ToCardStart
+ * \details Пока DMA загружает или выгружает FIFO, обращений к шине нет. Буфер backData
+ * должен жить до итога: ответ копируется в него по завершении выгрузки.
+ * \return MI_BUSY - команда выполняется, иначе итоговый статус как у MFRC522_ToCard
+ */
+uchar MFRC522_ToCardPoll(mfrc522_t *dev, uchar *backData, uchar backSize, uint *backLen)
+{
+  // ErrorReg, FIFOLevelReg, ControlReg и остановленный ответом таймер - одной транзакцией,
+  // для трассировки еще CollReg
+  static const uchar resultRegs[] = {ErrorReg, FIFOLevelReg, ControlReg, TCounterValueRegH, TCounterValueRegL,
+#if RFID_TRACE
+                                     CollReg,
+#endif
+                                    };
+  uchar result[sizeof(resultRegs)] = {0xFF};
+  uchar status = MI_ERR;
+  uchar lastBits;
+  uchar error;
+  uchar n;
+
+  if (dev->toCard.phase == RC522_PHASE_LOAD)
+  {
+    if (MFRC522_FifoBusy(dev))
+    {
+      return MI_BUSY;
+    }
+    MFRC522_ToCardRun(dev);
+  }
+  if (dev->toCard.phase == RC522_PHASE_DRAIN)
   {
+    return MFRC522_FifoBusy(dev) ? MI_BUSY : MFRC522_ToCardDone(dev, backData, backSize, backLen);
+  }
 
-    n = Read_MFRC522(CommIrqReg);
-    i--;
-  } while ((i != 0) && !(n & 0x01) && !(n & waitIRq));
+  if (MFRC522_IrqPending(dev, CommIrqReg, dev->toCard.waitIRq | 0x01, dev->toCard.start, dev->toCard.ticks, &n) == MI_BUSY)
+  {
+    return MI_BUSY;
+  }
 
-  ClearBitMask(BitFramingReg, 0x80);
+  ClearBitMask(dev, BitFramingReg, 0x80);
+  dev->toCard.bits = 0;
 
-  if (i != 0)
+  if (n != 0)
   {
-    if (!(Read_MFRC522(ErrorReg) & 0x1B))
+    MFRC522_ReadRegs(dev, resultRegs, result, sizeof(result));
+    MFRC522_Learn(dev, n, (result[3] << 8) | result[4]);
+
+    // CRCErr учитываем только когда CRC ответа проверяет сам RC522
+    error = result[0] & (dev->rxCrc ? 0x1F : 0x1B);
+
+    // BufferOvfl, ProtocolErr, WrErr, TempErr карта вызвать не может
+    if (result[0] & 0xD1)
     {
-      status = MI_OK;
-      if (n & irqEn & 0x01)
+      dev->errors += (dev->errors < 0xFF);
+    }
+    else
+    {
+      dev->errors = 0;
+    }
+
+    // При коллизии (CollErr) данные до позиции коллизии нужны антиколлизии
+    if (!(error & ~0x08))
+    {
+      status = error ? MI_COLLISION : MI_OK;
+      if (n & dev->toCard.irqEn & 0x01)
       {
         status = MI_NOTAGERR;
       }
 
-      if (command == PCD_TRANSCEIVE)
+      if (dev->toCard.command == PCD_TRANSCEIVE)
       {
-        n = Read_MFRC522(FIFOLevelReg);
-        lastBits = Read_MFRC522(ControlReg) & 0x07;
+        n = result[1];
+        lastBits = result[2] & 0x07;
         if (lastBits)
         {
-          *backLen = (n - 1) * 8 + lastBits;
+          dev->toCard.bits = (n - 1) * 8 + lastBits;
         }
         else
         {
-          *backLen = n * 8;
+          dev->toCard.bits = n * 8;
         }
 
         if (n == 0)
         {
           n = 1;
         }
-        if (n > MAX_LEN)
+        if (n > backSize)
+        {
+          n = backSize;
+        }
+
+        if (result[1])
         {
-          n = MAX_LEN;
+          dev->answers++;
         }
 
-        // Reading the received data in FIFO
-        for (i = 0; i < n; i++)
+        // ответ из FIFO выгружает DMA, итог - на следующем вызове после выгрузки
+        dev->toCard.status = status;
+#if RFID_TRACE
+        dev->toCard.errorReg = result[0];
+        dev->toCard.collReg = result[5];
+#endif
+        if (MFRC522_ReadFifoAsync(dev, backData, n, NULL, NULL) == MI_OK)
         {
-          backData[i] = Read_MFRC522(FIFODataReg);
+          dev->toCard.phase = RC522_PHASE_DRAIN;
+          return MI_BUSY;
         }
+        MFRC522_ReadFifo(dev, backData, n);
       }
     }
     else
@@ -180,90 +909,449 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
       status = MI_ERR;
     }
   }
+  else
+  {
+    // не сработал даже таймер RC522 - команда зависла
+    dev->errors += (dev->errors < 0xFF);
+  }
+
+  dev->toCard.status = status;
+#if RFID_TRACE
+  dev->toCard.errorReg = result[0];
+  dev->toCard.collReg = result[5];
+#endif
+  return MFRC522_ToCardDone(dev, backData, backSize, backLen);
+}
+
+/*!
+ * \brief Итог команды: длина ответа вызывающему, сброс второй фазы WRITE после ошибки
+ */
+static uchar MFRC522_ToCardDone(mfrc522_t *dev, uchar *backData, uchar backSize, uint *backLen)
+{
+  uchar status = dev->toCard.status;
+
+  dev->toCard.phase = RC522_PHASE_IDLE;
+  *backLen = dev->toCard.bits;
+  if (status != MI_OK)
+  {
+    dev->toCard.next = RC522_TMO_COUNT;    // вторая фаза WRITE не последует
+  }
+#if RFID_TRACE
+  // после таймаута FIFO пуст, длина по ControlReg.RxLastBits недействительна
+  RFID_trace_done(status, dev->toCard.errorReg, dev->toCard.collReg, backData,
+                  ((status == MI_OK) || (status == MI_COLLISION)) ? MIN(*backLen, backSize * 8u) : 0, RC522_CYCCNT());
+#else
+  (void)backData;
+  (void)backSize;
+#endif
+  return status;
+}
+
+/*!
+ * \brief Обучение границы профиля по времени ответа карты
+ */
+static void MFRC522_Learn(mfrc522_t *dev, uchar irq, uint16_t counter)
+{
+  uchar profile = dev->toCard.profile;
+  uint16_t elapsed;
+
+  if (irq & 0x01)
+  {
+    // REQA без карты, HALT и вторая фаза INC/DEC/RESTORE молчат штатно; посреди обмена - возможно, граница узка
+    if ((profile != RC522_TMO_REQA) && (profile != RC522_TMO_HALT) && (profile != RC522_TMO_VALUE))
+    {
+      dev->tmo[profile].samples = 0;
+      dev->tmo[profile].seen = 0;
+    }
+    return;
+  }
+
+  if (counter > dev->reload)
+  {
+    return;
+  }
+  elapsed = dev->reload - counter;
+  dev->tmo[profile].seen = MAX(dev->tmo[profile].seen, elapsed);
+  if (dev->tmo[profile].samples < RC522_TMO_LEARN)
+  {
+    dev->tmo[profile].samples++;
+  }
+}
+
+uchar MFRC522_ToCard(mfrc522_t *dev, uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen)
+{
+  uchar status;
+
+  MFRC522_ToCardStart(dev, command, sendData, sendLen);
+  while ((status = MFRC522_ToCardPoll(dev, backData, MAX_FRAME_LEN, backLen)) == MI_BUSY)
+  {
+  }
 
   return status;
 }
 
-uchar MFRC522_Request(uchar reqMode, uchar *TagType)
+/*!
+ * \brief Включение аппаратного расчета CRC передатчика/проверки CRC приемника
+ * \details Регистры пишутся только при смене состояния
+ */
+void MFRC522_SetCRC(mfrc522_t *dev, uchar tx, uchar rx)
+{
+  // биты скорости (MFRC522_SetBitRate) сохраняются: значение берется из тени регистра
+  if (tx != dev->txCrc)
+  {
+    if (tx)
+    {
+      SetBitMask(dev, TxModeReg, 0x80);
+    }
+    else
+    {
+      ClearBitMask(dev, TxModeReg, 0x80);
+    }
+    dev->txCrc = tx;
+  }
+  if (rx != dev->rxCrc)
+  {
+    if (rx)
+    {
+      SetBitMask(dev, RxModeReg, 0x80);
+    }
+    else
+    {
+      ClearBitMask(dev, RxModeReg, 0x80);
+    }
+    dev->rxCrc = rx;
+  }
+}
+
+void MFRC522_SetCRCMode(mfrc522_t *dev, uchar mode)
+{
+  dev->crcMode = mode;
+}
+
+/*!
+ * \brief Подготовка кадра с CRC_A к отправке
+ * \param[in,out] buf - кадр, для программного режима - с местом под 2 байта CRC
+ * \param[in] rxCrc - ответ карты на эту команду содержит CRC
+ * \return длина кадра, которую нужно передать в FIFO
+ */
+uchar MFRC522_AppendCRC(mfrc522_t *dev, uchar *buf, uchar len, uchar rxCrc)
+{
+  if (dev->crcMode == RC522_CRC_HARDWARE)
+  {
+    MFRC522_SetCRC(dev, 1, rxCrc);
+    return len;
+  }
+
+  MFRC522_SetCRC(dev, 0, 0);
+  crc_a_append(buf, len);
+  return len + 2;
+}
+
+/*!
+ * \brief Проверка CRC_A ответа карты
+ * \param[out] len - длина данных без CRC
+ */
+uchar MFRC522_CheckCRC(mfrc522_t *dev, uchar *buf, uint bits, uchar *len)
+{
+  if ((bits == 0) || (bits % 8))
+  {
+    return MI_ERR;
+  }
+
+  *len = bits / 8;
+  if (dev->rxCrc)
+  {
+    // CRC проверен RC522 (CRCErr в ErrorReg), в FIFO байты CRC не попадают
+    return MI_OK;
+  }
+
+  if ((*len < 3) || !crc_a_check(buf, *len))
+  {
+    return MI_ERR;
+  }
+  *len -= 2;
+  return MI_OK;
+}
+
+uchar MFRC522_Request(mfrc522_t *dev, uchar reqMode, uchar *TagType)
 {
   uchar status;
   uint backBits;
+  uchar buff[MAX_FRAME_LEN];
 
-  Write_MFRC522(BitFramingReg, 0x07);
+  MFRC522_SetCRC(dev, 0, 0);
+  Write_MFRC522(dev, BitFramingReg, 0x07);
 
-  TagType[0] = reqMode;
-  status = MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
+  buff[0] = reqMode;
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, 1, buff, &backBits);
 
-  if ((status != MI_OK) || (backBits != 0x10))
+  // ATQA нескольких карт приходит с коллизией - карты в поле есть
+  if (((status != MI_OK) && (status != MI_COLLISION)) || (backBits != 0x10))
   {
     status = MI_ERR;
   }
+  else
+  {
+    status = MI_OK;
+    TagType[0] = buff[0];
+    TagType[1] = buff[1];
+  }
 
   return status;
 }
 
-uchar MFRC522_Anticoll(uchar *serNum)
+uchar MFRC522_Anticoll(mfrc522_t *dev, uchar *serNum)
 {
   uchar status;
   uchar i;
   uchar serNumCheck = 0;
   uint unLen;
+  uchar buff[MAX_FRAME_LEN];
 
-  Write_MFRC522(BitFramingReg, 0x00);
+  MFRC522_SetCRC(dev, 0, 0);
+  Write_MFRC522(dev, BitFramingReg, 0x00);
 
-  serNum[0] = PICC_ANTICOLL;
-  serNum[1] = 0x20;
-  status = MFRC522_ToCard(PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
+  buff[0] = PICC_ANTICOLL;
+  buff[1] = 0x20;
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, 2, buff, &unLen);
 
   if (status == MI_OK)
   {
     for (i = 0; i < 4; i++)
     {
-      serNumCheck ^= serNum[i];
+      serNumCheck ^= buff[i];
     }
-    if (serNumCheck != serNum[i])
+    if (serNumCheck != buff[i])
     {
       status = MI_ERR;
     }
+    else
+    {
+      memcpy(serNum, buff, 5);
+    }
   }
   return status;
 }
 
-void CalulateCRC(uchar *pIndata, uchar len, uchar *pOutData)
+/*!
+ * \brief Кадр ANTICOLLISION уровня каскада level с known уже известными битами UID
+ * \param[in,out] sel - кадр SEL, NVB, UID уровня, BCC (не меньше 9 байт)
+ * \return число байт для передачи, последний байт неполный при known % 8
+ */
+uchar MFRC522_AnticollFrame(mfrc522_t *dev, uchar *sel, uchar level, uchar known)
 {
-  uchar i, n;
+  uchar index = 2 + known / 8;
+  uchar txLastBits = known % 8;
+
+  MFRC522_SetCRC(dev, 0, 0);
+  // RxAlign = TxLastBits: ответ карты продолжает неполный байт
+  Write_MFRC522(dev, BitFramingReg, (txLastBits << 4) | txLastBits);
+
+  sel[0] = PICC_SEL_CL1 + 2 * level;
+  sel[1] = (index << 4) | txLastBits;    // NVB
+
+  return index + (txLastBits ? 1 : 0);
+}
+
+/*!
+ * \brief Разбор ответа на ANTICOLLISION
+ * \details При коллизии выбирается ветвь с единицей в позиции коллизии, следующий
+ * запрос отсекает остальные карты. На одну карту уходит не больше 32 запросов на уровень.
+ * \return MI_OK - UID уровня и BCC получены, MI_BUSY - нужен следующий запрос, иначе ошибка
+ */
+uchar MFRC522_AnticollMerge(mfrc522_t *dev, uchar *sel, uchar *known, uchar status, const uchar *resp, uint bits)
+{
+  uchar index = 2 + *known / 8;
+  uchar mask = (1 << (*known % 8)) - 1;
+  uchar n = (bits + 7) / 8;
+  uchar coll;
+  uchar pos;
+  uchar i;
+
+  if ((status != MI_OK) && (status != MI_COLLISION))
+  {
+    return status;
+  }
+  if (n == 0)
+  {
+    return MI_ERR;
+  }
+  if (n > 7 - index)
+  {
+    n = 7 - index;
+  }
+
+  // Младшие биты первого байта отправлены нами, старшие приняты от карты
+  sel[index] = (sel[index] & mask) | (resp[0] & ~mask);
+  for (i = 1; i < n; i++)
+  {
+    sel[index + i] = resp[i];
+  }
+
+  if (status == MI_OK)
+  {
+    if ((sel[2] ^ sel[3] ^ sel[4] ^ sel[5]) != sel[6])
+    {
+      return MI_ERR;
+    }
+    *known = 32;
+    return MI_OK;
+  }
 
-  ClearBitMask(DivIrqReg, 0x04);
-  SetBitMask(FIFOLevelReg, 0x80);
+  coll = Read_MFRC522(dev, CollReg);
+  if (coll & 0x20)
+  {
+    return MI_ERR;                      // CollPosNotValid: коллизия вне данных
+  }
 
-  for (i = 0; i < len; i++)
+  // Datasheet MFRC522, 9.3.1.15 CollReg: CollPos - номер бита первой коллизии в принятом кадре,
+  // 01h - 1-й бит, 08h - 8-й, 00h - 32-й. 9.3.1.14 BitFramingReg: первый принятый бит ложится
+  // в позицию RxAlign байта FIFO, поэтому CollPos отсчитывается от бита 0 первого (неполного)
+  // байта FIFO. Полные байты UID до него (known & ~7) передали мы, карта их не повторяет.
+  pos = coll & 0x1F;
+  if (pos == 0)
+  {
+    pos = 32;
+  }
+  pos += *known & ~0x07;
+  if ((pos <= *known) || (pos > 32))
   {
-    Write_MFRC522(FIFODataReg, *(pIndata + i));
+    return MI_ERR;
   }
-  Write_MFRC522(CommandReg, PCD_CALCCRC);
 
-  i = 0xFF;
-  do
+  sel[2 + (pos - 1) / 8] |= 1 << ((pos - 1) % 8);
+  *known = pos;
+  return MI_BUSY;
+}
+
+/*!
+ * \brief Кадр SELECT по полностью известному UID уровня (sel[0] уже содержит SEL)
+ * \return число байт для передачи
+ */
+uchar MFRC522_SelectFrame(mfrc522_t *dev, uchar *sel)
+{
+  sel[1] = 0x70;
+  Write_MFRC522(dev, BitFramingReg, 0x00);
+  return MFRC522_AppendCRC(dev, sel, 7, 1);
+}
+
+/*!
+ * \brief Разбор SAK: добавляет байты UID уровня в uid
+ * \return MI_OK - UID полный, MI_BUSY - нужен следующий уровень каскада, MI_ERR - ошибка
+ */
+uchar MFRC522_SelectDone(rfid_uid_t *uid, const uchar *sel, uchar sak)
+{
+  if (sak & 0x04)
   {
-    n = Read_MFRC522(DivIrqReg);
-    i--;
-  } while ((i != 0) && !(n & 0x04));
+    if ((sel[2] != PICC_CASCADE_TAG) || (uid->size > 3))
+    {
+      return MI_ERR;
+    }
+    memcpy(&uid->bytes[uid->size], &sel[3], 3);
+    uid->size += 3;
+    return MI_BUSY;
+  }
 
-  pOutData[0] = Read_MFRC522(CRCResultRegL);
-  pOutData[1] = Read_MFRC522(CRCResultRegH);
+  memcpy(&uid->bytes[uid->size], &sel[2], 4);
+  uid->size += 4;
+  uid->sak = sak;
+  return MI_OK;
 }
 
-uchar MFRC522_Write(uchar blockAddr, uchar *writeData)
+/*!
+ * \brief Антиколлизия и выбор карты всех уровней каскада (UID 4, 7 и 10 байт)
+ * \details Вызывается после REQA/WUPA. При нескольких картах в поле выбирается одна,
+ * остальные остаются в READY до следующего REQA.
+ */
+uchar MFRC522_Select(mfrc522_t *dev, rfid_uid_t *uid)
+{
+  uchar status;
+  uchar level;
+  uchar known;
+  uchar len;
+  uint bits;
+  uchar sel[9];
+  uchar buff[MAX_FRAME_LEN];
+
+  uid->size = 0;
+
+  for (level = 0; level < 3; level++)
+  {
+    known = 0;
+    do
+    {
+      len = MFRC522_AnticollFrame(dev, sel, level, known);
+      status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, sel, len, buff, &bits);
+      status = MFRC522_AnticollMerge(dev, sel, &known, status, buff, bits);
+    } while (status == MI_BUSY);
+
+    if (status != MI_OK)
+    {
+      return status;
+    }
+
+    len = MFRC522_SelectFrame(dev, sel);
+    status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, sel, len, buff, &bits);
+    if ((status != MI_OK) || (MFRC522_CheckCRC(dev, buff, bits, &len) != MI_OK) || (len != 1))
+    {
+      return MI_ERR;
+    }
+
+    status = MFRC522_SelectDone(uid, sel, buff[0]);
+    if (status != MI_BUSY)
+    {
+      return status;
+    }
+  }
+
+  return MI_ERR;
+}
+
+/*!
+ * \brief 4 байта UID для MFRC522_Auth и их BCC
+ * \details Для UID из 7 и 10 байт MIFARE Classic использует последние 4 байта
+ */
+void MFRC522_UidAuthBytes(const rfid_uid_t *uid, uchar *serNum)
+{
+  memcpy(serNum, &uid->bytes[uid->size - 4], 4);
+  serNum[4] = serNum[0] ^ serNum[1] ^ serNum[2] ^ serNum[3];
+}
+
+/*!
+ * \brief Расчет CRC сопроцессором RC522. Обмен с картой использует MFRC522_AppendCRC,
+ * функция оставлена для самопроверки и совместимости.
+ */
+void CalulateCRC(mfrc522_t *dev, uchar *pIndata, uchar len, uchar *pOutData)
+{
+  static const uchar crcRegs[2] = {CRCResultRegL, CRCResultRegH};
+
+  Write_MFRC522(dev, CommandReg, PCD_IDLE);
+  Write_MFRC522(dev, CommIEnReg, 0x80);    // флаги прошлого обмена не должны держать линию IRQ
+  Write_MFRC522(dev, DivlEnReg, 0x84);     // CRCIEn
+  Write_MFRC522(dev, DivIrqReg, 0x04);     // Set2 = 0: сбрасываем CRCIRq
+  Write_MFRC522(dev, FIFOLevelReg, 0x80);  // FlushBuffer
+  dev->irq = 0;
+
+  MFRC522_WriteFifo(dev, pIndata, len);
+  Write_MFRC522(dev, CommandReg, PCD_CALCCRC);
+
+  MFRC522_WaitIrq(dev, DivIrqReg, 0x04, RC522_CRC_TIMEOUT_US);
+  Write_MFRC522(dev, DivlEnReg, 0x80);
+
+  MFRC522_ReadRegs(dev, crcRegs, pOutData, 2);
+}
+
+uchar MFRC522_Write(mfrc522_t *dev, uchar blockAddr, uchar *writeData)
 {
   uchar status;
   uint recvBits;
-  uchar i;
-  uchar buff[18];
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
 
   buff[0] = PICC_WRITE;
   buff[1] = blockAddr;
-  CalulateCRC(buff, 2, &buff[2]);
-  status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+  len = MFRC522_AppendCRC(dev, buff, 2, 0);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
 
   if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A))
   {
@@ -272,12 +1360,9 @@ uchar MFRC522_Write(uchar blockAddr, uchar *writeData)
 
   if (status == MI_OK)
   {
-    for (i = 0; i < 16; i++)
-    {
-      buff[i] = *(writeData + i);
-    }
-    CalulateCRC(buff, 16, &buff[16]);
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
+    memcpy(buff, writeData, 16);
+    len = MFRC522_AppendCRC(dev, buff, 16, 0);
+    status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
 
     if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A))
     {
@@ -288,17 +1373,79 @@ uchar MFRC522_Write(uchar blockAddr, uchar *writeData)
   return status;
 }
 
-uchar MFRC522_Read(uchar blockAddr, uchar *recvData)
+uchar MFRC522_Read(mfrc522_t *dev, uchar blockAddr, uchar *recvData)
 {
   uchar status;
   uint unLen;
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
+
+  buff[0] = PICC_READ;
+  buff[1] = blockAddr;
+  len = MFRC522_AppendCRC(dev, buff, 2, 1);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &unLen);
+
+  if ((status != MI_OK) || (MFRC522_CheckCRC(dev, buff, unLen, &len) != MI_OK) || (len != 16))
+  {
+    return MI_ERR;
+  }
+
+  memcpy(recvData, buff, 16);
+  return MI_OK;
+}
+
+/*!
+ * \brief Ultralight EV1/NTAG: чтение страниц startPage..endPage одним кадром
+ * \details Ответ вместе с CRC должен поместиться в FIFO: не больше MFRC522_FAST_READ_PAGES страниц
+ */
+uchar MFRC522_FastRead(mfrc522_t *dev, uchar startPage, uchar endPage, uchar *recvData)
+{
+  uchar status;
+  uint unLen;
+  uchar len;
+  uchar pages = endPage - startPage + 1;
+  uchar buff[MFRC522_FIFO_SIZE];
+
+  if ((endPage < startPage) || (pages > MFRC522_FAST_READ_PAGES))
+  {
+    return MI_ERR;
+  }
+
+  buff[0] = PICC_UL_FAST_READ;
+  buff[1] = startPage;
+  buff[2] = endPage;
+  len = MFRC522_AppendCRC(dev, buff, 3, 1);
+  MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, buff, len);
+  while ((status = MFRC522_ToCardPoll(dev, buff, MFRC522_FIFO_SIZE, &unLen)) == MI_BUSY)
+  {
+  }
+
+  if ((status != MI_OK) || (MFRC522_CheckCRC(dev, buff, unLen, &len) != MI_OK) || (len != pages * MFRC522_PAGE_LEN))
+  {
+    return MI_ERR;
+  }
 
-  recvData[0] = PICC_READ;
-  recvData[1] = blockAddr;
-  CalulateCRC(recvData, 2, &recvData[2]);
-  status = MFRC522_ToCard(PCD_TRANSCEIVE, recvData, 4, recvData, &unLen);
+  memcpy(recvData, buff, len);
+  return MI_OK;
+}
+
+/*!
+ * \brief Ultralight/NTAG: запись страницы одной командой (в отличие от двухфазной PICC_WRITE)
+ */
+uchar MFRC522_WritePage(mfrc522_t *dev, uchar page, const uchar *writeData)
+{
+  uchar status;
+  uint recvBits;
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
+
+  buff[0] = PICC_UL_WRITE;
+  buff[1] = page;
+  memcpy(&buff[2], writeData, MFRC522_PAGE_LEN);
+  len = MFRC522_AppendCRC(dev, buff, 2 + MFRC522_PAGE_LEN, 0);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
 
-  if ((status != MI_OK) || (unLen != 0x90))
+  if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A))
   {
     status = MI_ERR;
   }
@@ -306,26 +1453,125 @@ uchar MFRC522_Read(uchar blockAddr, uchar *recvData)
   return status;
 }
 
-uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum)
+/*!
+ * \brief Ultralight EV1/NTAG: 8 байт версии (производитель, тип, объем памяти)
+ * \details Ultralight и Ultralight C отвечают NAK и уходят в IDLE
+ */
+uchar MFRC522_GetVersion(mfrc522_t *dev, uchar *version)
+{
+  uchar status;
+  uint unLen;
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
+
+  buff[0] = PICC_UL_GET_VERSION;
+  len = MFRC522_AppendCRC(dev, buff, 1, 1);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &unLen);
+
+  if ((status != MI_OK) || (MFRC522_CheckCRC(dev, buff, unLen, &len) != MI_OK) || (len != 8))
+  {
+    return MI_ERR;
+  }
+
+  memcpy(version, buff, 8);
+  return MI_OK;
+}
+
+/*!
+ * \brief Ultralight EV1/NTAG: проверка пароля, в pack - 2 байта подтверждения карты
+ */
+uchar MFRC522_PwdAuth(mfrc522_t *dev, const uchar *pwd, uchar *pack)
+{
+  uchar status;
+  uint unLen;
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
+
+  buff[0] = PICC_UL_PWD_AUTH;
+  memcpy(&buff[1], pwd, 4);
+  len = MFRC522_AppendCRC(dev, buff, 5, 1);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &unLen);
+
+  if ((status != MI_OK) || (MFRC522_CheckCRC(dev, buff, unLen, &len) != MI_OK) || (len != 2))
+  {
+    return MI_ERR;
+  }
+
+  memcpy(pack, buff, 2);
+  return MI_OK;
+}
+
+/*!
+ * \brief Операция над блоком значения: PICC_INCREMENT, PICC_DECREMENT или PICC_RESTORE
+ * \details Результат остается во внутреннем регистре карты до MFRC522_Transfer. Вторую фазу
+ * (операнд) карта не подтверждает: молчание - успех, NAK - ошибка.
+ * \param[in] operand - для PICC_RESTORE не используется (передается 0)
+ */
+uchar MFRC522_Value(mfrc522_t *dev, uchar command, uchar blockAddr, int32_t operand)
 {
   uchar status;
   uint recvBits;
-  uchar i;
-  uchar buff[12];
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
 
-  buff[0] = authMode;
-  buff[1] = BlockAddr;
-  for (i = 0; i < 6; i++)
+  buff[0] = command;
+  buff[1] = blockAddr;
+  len = MFRC522_AppendCRC(dev, buff, 2, 0);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
+
+  if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A))
   {
-    buff[i + 2] = *(Sectorkey + i);
+    return MI_ERR;
   }
-  for (i = 0; i < 4; i++)
+
+  // операнд - младшим байтом вперед
+  buff[0] = (uchar)operand;
+  buff[1] = (uchar)(operand >> 8);
+  buff[2] = (uchar)(operand >> 16);
+  buff[3] = (uchar)(operand >> 24);
+  len = MFRC522_AppendCRC(dev, buff, 4, 0);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
+
+  return (status == MI_NOTAGERR) ? MI_OK : MI_ERR;
+}
+
+/*!
+ * \brief Запись внутреннего регистра карты в блок значения (после MFRC522_Value)
+ */
+uchar MFRC522_Transfer(mfrc522_t *dev, uchar blockAddr)
+{
+  uchar status;
+  uint recvBits;
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
+
+  buff[0] = PICC_TRANSFER;
+  buff[1] = blockAddr;
+  len = MFRC522_AppendCRC(dev, buff, 2, 0);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &recvBits);
+
+  if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A))
   {
-    buff[i + 8] = *(serNum + i);
+    status = MI_ERR;
   }
-  status = MFRC522_ToCard(PCD_AUTHENT, buff, 12, buff, &recvBits);
 
-  if ((status != MI_OK) || (!(Read_MFRC522(Status2Reg) & 0x08)))
+  return status;
+}
+
+uchar MFRC522_Auth(mfrc522_t *dev, uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum)
+{
+  uchar status;
+  uint recvBits;
+  uchar buff[12];
+
+  // Команда, адрес блока, ключ и 4 байта UID уходят в FIFO одним пакетом
+  buff[0] = authMode;
+  buff[1] = BlockAddr;
+  memcpy(&buff[2], Sectorkey, KEY_LEN);
+  memcpy(&buff[8], serNum, 4);
+  status = MFRC522_ToCard(dev, PCD_AUTHENT, buff, 12, buff, &recvBits);
+
+  if ((status != MI_OK) || (!(Read_MFRC522(dev, Status2Reg) & 0x08)))
   {
     status = MI_ERR;
   }
@@ -333,24 +1579,21 @@ uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *ser
   return status;
 }
 
-uchar MFRC522_SelectTag(uchar *serNum)
+uchar MFRC522_SelectTag(mfrc522_t *dev, uchar *serNum)
 {
-  uchar i;
   uchar status;
   uchar size;
+  uchar len;
   uint recvBits;
-  uchar buffer[9];
+  uchar buffer[MAX_FRAME_LEN];
 
   buffer[0] = PICC_SElECTTAG;
   buffer[1] = 0x70;
-  for (i = 0; i < 5; i++)
-  {
-    buffer[i + 2] = *(serNum + i);
-  }
-  CalulateCRC(buffer, 7, &buffer[7]);
-  status = MFRC522_ToCard(PCD_TRANSCEIVE, buffer, 9, buffer, &recvBits);
+  memcpy(&buffer[2], serNum, 5);
+  len = MFRC522_AppendCRC(dev, buffer, 7, 1);
+  status = MFRC522_ToCard(dev, PCD_TRANSCEIVE, buffer, len, buffer, &recvBits);
 
-  if ((status == MI_OK) && (recvBits == 0x18))
+  if ((status == MI_OK) && (MFRC522_CheckCRC(dev, buffer, recvBits, &len) == MI_OK) && (len == 1))
   {
     size = buffer[0];
   }
@@ -362,108 +1605,62 @@ uchar MFRC522_SelectTag(uchar *serNum)
   return size;
 }
 
-void MFRC522_Halt()
+void MFRC522_Halt(mfrc522_t *dev)
 {
   uint unLen;
-  uchar buff[4];
+  uchar len;
+  uchar buff[MAX_FRAME_LEN];
 
   buff[0] = PICC_HALT;
   buff[1] = 0;
-  CalulateCRC(buff, 2, &buff[2]);
+  len = MFRC522_AppendCRC(dev, buff, 2, 0);
 
-  MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &unLen);
+  MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, len, buff, &unLen);
 }
 
 uchar Read_Single_Card()
 {
-  uchar requestStatus, anticollStatus;
+  mfrc522_t *dev = rfid.reader->dev;
+  uchar requestStatus, selectStatus;
 
-  requestStatus = MFRC522_Request(PICC_REQIDL, rfid.uid);
+  requestStatus = MFRC522_Request(dev, PICC_REQIDL, rfid.uid);
   if (requestStatus == MI_OK)
   {
-    anticollStatus = MFRC522_Anticoll(rfid.uid);
-    if (anticollStatus == MI_OK)
+    selectStatus = MFRC522_Select(dev, &rfid.reader->card);
+    if (selectStatus == MI_OK)
     {
-      MFRC522_SelectTag(rfid.uid);
+      MFRC522_UidAuthBytes(&rfid.reader->card, rfid.uid);
 
-      // memcpy(sNum, rfid.uid, UID_SIZE);
-      // write(sck_2,(char*)sNum, UID_SIZE);
+      // write(sck_2,(char*)rfid.reader->card.bytes, rfid.reader->card.size);
       // delay_ms(50);
 
-      MFRC522_Halt();
+      MFRC522_Halt(dev);
       return MI_OK;
     }
   }
   return MI_ERR;
 }
 
-void Read_Multiple_Cards()
-{
-  uchar requestStatus, anticollStatus;
-  uchar cardUIDs[MAX_CARDS][UID_SIZE];
-  int cardCount = 0;
-  int failedAttempts = 0;
-
-  while (failedAttempts < MAX_ATTEMPTS && cardCount < MAX_CARDS)
-  {
-    requestStatus = MFRC522_Request(PICC_REQIDL, rfid.uid);
-    if (requestStatus == MI_OK)
-    {
-      anticollStatus = MFRC522_Anticoll(rfid.uid);
-
-      if (anticollStatus == MI_OK)
-      {
-        MFRC522_SelectTag(rfid.uid);
-
-        for (int i = 0; i < UID_SIZE; i++)
-        {
-          cardUIDs[cardCount][i] = rfid.uid[i];
-        }
-        cardCount++;
-        failedAttempts = 0;
-
-        MFRC522_Halt();
-      }
-      else
-      {
-        failedAttempts++;
-      }
-    }
-    else
-    {
-      failedAttempts++;
-    }
-  }
-
-  uint8_t serNum[20] = {0};
-  for (int i = 0; i < cardCount; i++)
-  {
-    memcpy(serNum, cardUIDs[i], UID_SIZE);
-
-    write(sck_2,(char*)serNum, UID_SIZE);
-    delay_ms(50);
-  }
-}
-
 void Write_Content_Card(uchar authMode, uchar *myString, uchar block, uchar *Sectorkey)
 {
-  uchar requestStatus, anticollStatus, authStatus, writeStatus;
-  requestStatus = MFRC522_Request(PICC_REQIDL, rfid.uid);
+  mfrc522_t *dev = rfid.reader->dev;
+  uchar requestStatus, selectStatus, authStatus, writeStatus;
+  requestStatus = MFRC522_Request(dev, PICC_REQIDL, rfid.uid);
   if (requestStatus == MI_OK)
   {
-    anticollStatus = MFRC522_Anticoll(rfid.uid);
-    if (anticollStatus == MI_OK)
+    selectStatus = MFRC522_Select(dev, &rfid.reader->card);
+    if (selectStatus == MI_OK)
     {
-      MFRC522_SelectTag(rfid.uid);
-      authStatus = MFRC522_Auth(authMode, block, Sectorkey, rfid.uid);
+      MFRC522_UidAuthBytes(&rfid.reader->card, rfid.uid);
+      authStatus = MFRC522_Auth(dev, authMode, block, Sectorkey, rfid.uid);
       if (authStatus == MI_OK)
       {
-        writeStatus = MFRC522_Write(block, myString);
+        writeStatus = MFRC522_Write(dev, block, myString);
         if (writeStatus == MI_OK)
         {
           uint8_t msg[] = "Dado gravado com sucesso!\n\r";
           write(sck_2,(char*)msg, sizeof(msg));
-          MFRC522_Init();
+          MFRC522_Init(dev);
           delay_ms(1000);
         }
       }
@@ -473,23 +1670,24 @@ void Write_Content_Card(uchar authMode, uchar *myString, uchar block, uchar *Sec
 
 void Read_Content_Card(uchar authMode, uchar block, uchar *Sectorkey)
 {
-  uchar requestStatus, anticollStatus, authStatus, readStatus;
+  mfrc522_t *dev = rfid.reader->dev;
+  uchar requestStatus, selectStatus, authStatus, readStatus;
   uchar buffer[16];
-  requestStatus = MFRC522_Request(PICC_REQIDL, rfid.uid);
+  requestStatus = MFRC522_Request(dev, PICC_REQIDL, rfid.uid);
   if (requestStatus == MI_OK)
   {
-    anticollStatus = MFRC522_Anticoll(rfid.uid);
-    if (anticollStatus == MI_OK)
+    selectStatus = MFRC522_Select(dev, &rfid.reader->card);
+    if (selectStatus == MI_OK)
     {
-      MFRC522_SelectTag(rfid.uid);
-      authStatus = MFRC522_Auth(authMode, block, Sectorkey, rfid.uid);
+      MFRC522_UidAuthBytes(&rfid.reader->card, rfid.uid);
+      authStatus = MFRC522_Auth(dev, authMode, block, Sectorkey, rfid.uid);
       if (authStatus == MI_OK)
       {
-        readStatus = MFRC522_Read(block, buffer);
+        readStatus = MFRC522_Read(dev, block, buffer);
         if (readStatus == MI_OK)
         {
             write(sck_2,(char*)buffer, sizeof(buffer));
-            MFRC522_Init();
+            MFRC522_Init(dev);
             delay_ms(1000);
         }
       }
@@ -0,0 +1,276 @@
+#include "include.h"
+
+#define SPI_DMA_RX_FLAGS    (DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3)
+#define SPI_DMA_TX_FLAGS    (DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4)
+
+static void spi_dma_start(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer);
+static void spi_dma_start_next(spi_dma_bus_t *bus);
+static uint8_t spi_dma_stream_setup(spi_dma_bus_t *bus, dma_t *dma, uint32_t cr, const volatile void *mem, uint16_t len);
+static void spi_dma_abort(spi_dma_bus_t *bus);
+static uint8_t spi_dma_expired(uint32_t start);
+static void spi_dma_poll_xmit(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer);
+static void spi_dma_irq(spi_dma_bus_t *bus);
+
+// Пустышки для транзакций без буфера передачи или приема
+static volatile uint8_t spi_dma_dummy_tx[1] = {0};
+static volatile uint8_t spi_dma_dummy_rx[1];
+
+spi_dma_bus_t spi_dma_bus2 = {
+    .spi = SPI_DMA_SPI,
+    .rx = {SPI_DMA_RX_STREAM, SPI_DMA_CHANNEL, spi_dma_dummy_rx, sizeof(spi_dma_dummy_rx), 0},
+    .tx = {SPI_DMA_TX_STREAM, SPI_DMA_CHANNEL, spi_dma_dummy_tx, sizeof(spi_dma_dummy_tx), 0},
+    .rx_isr = &DMA1->LISR,
+    .rx_ifcr = &DMA1->LIFCR,
+    .tx_ifcr = &DMA1->HIFCR,
+    .rx_flags = SPI_DMA_RX_FLAGS,
+    .tx_flags = SPI_DMA_TX_FLAGS,
+    .rx_teif = DMA_LISR_TEIF3,
+    .rx_irq = SPI_DMA_RX_IRQ
+};
+
+void spi_dma_init(spi_dma_bus_t *bus)
+{
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    bus->rx.sfr->CR = 0;
+    bus->tx.sfr->CR = 0;
+    *bus->rx_ifcr = bus->rx_flags;
+    *bus->tx_ifcr = bus->tx_flags;
+
+    bus->current = NULL;
+    bus->queue_in = bus->queue_out = 0;
+    bus->aborts = 0;
+
+    // Завершение транзакции определяем по приему последнего байта, прерывание TX не нужно
+    NVIC_SetPriority(bus->rx_irq, SPI_DMA_IRQ_PRIORITY);
+    NVIC_EnableIRQ(bus->rx_irq);
+}
+
+/*!
+ * \brief Ставит транзакцию в очередь. Если шина свободна - транзакция стартует сразу.
+ * \return 1 - транзакция принята, 0 - очередь заполнена
+ */
+uint8_t spi_dma_submit(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer)
+{
+    uint8_t res = 1;
+
+    xfer->status = SPI_DMA_QUEUED;
+
+    ENTER_CRITICAL_SECTION();
+    if (bus->current == NULL) {
+        spi_dma_start(bus, xfer);
+    } else if (bus->queue_in - bus->queue_out < SPI_DMA_QUEUE_LEN) {
+        bus->queue[bus->queue_in++ & (SPI_DMA_QUEUE_LEN - 1)] = xfer;
+    } else {
+        xfer->status = SPI_DMA_IDLE;
+        res = 0;
+    }
+    LEAVE_CRITICAL_SECTION();
+
+    return res;
+}
+
+/*!
+ * \brief Ожидание завершения транзакции, не дольше SPI_DMA_TIMEOUT_US
+ * \details Если прерывание по концу приема так и не пришло, шина сбрасывается (spi_dma_abort)
+ * \return SPI_DMA_DONE или SPI_DMA_ERROR
+ */
+spi_dma_status_t spi_dma_wait(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer)
+{
+    uint32_t start = DWT->CYCCNT;
+
+    while ((xfer->status == SPI_DMA_QUEUED) || (xfer->status == SPI_DMA_BUSY))
+    {
+        if (spi_dma_expired(start))
+            spi_dma_abort(bus);
+    }
+    return xfer->status;
+}
+
+uint8_t spi_dma_busy(spi_dma_bus_t *bus)
+{
+    return bus->current != NULL;
+}
+
+/*!
+ * \brief Блокирующая транзакция. Короткие посылки (адрес + байт регистра) идут без DMA:
+ * настройка двух потоков дороже, чем передача пары байт.
+ */
+spi_dma_status_t spi_dma_xmit(spi_dma_bus_t *bus, GPIO_TypeDef *cs_port, uint16_t cs_pin,
+                              const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+    spi_dma_xfer_t xfer = {
+        .cs_port = cs_port,
+        .cs_pin = cs_pin,
+        .tx = tx,
+        .rx = rx,
+        .len = len,
+        .status = SPI_DMA_IDLE,
+        .callback = NULL,
+        .ctx = NULL
+    };
+    uint32_t start = DWT->CYCCNT;
+
+    if (len == 0)
+        return SPI_DMA_DONE;
+
+    if (len < SPI_DMA_MIN_LEN) {
+        while (spi_dma_busy(bus))
+        {
+            if (spi_dma_expired(start)) {
+                spi_dma_abort(bus);
+                return SPI_DMA_ERROR;
+            }
+        }
+        spi_dma_poll_xmit(bus, &xfer);
+        return xfer.status;
+    }
+
+    while (!spi_dma_submit(bus, &xfer))
+    {
+        if (spi_dma_expired(start)) {
+            spi_dma_abort(bus);
+            return SPI_DMA_ERROR;
+        }
+    }
+    return spi_dma_wait(bus, &xfer);
+}
+
+static uint8_t spi_dma_expired(uint32_t start)
+{
+    return (DWT->CYCCNT - start) > SPI_DMA_TIMEOUT_US * (SystemCoreClock / 1000000);
+}
+
+/*!
+ * \brief Сброс зависшей шины: потоки остановлены, текущая и ожидающие транзакции завершены с ошибкой
+ * \details callback для них не вызывается - итог только в status, его проверяет владелец транзакции.
+ * Снятие EN потоков здесь не дожидаемся: это делает spi_dma_stream_setup следующей транзакции.
+ */
+static void spi_dma_abort(spi_dma_bus_t *bus)
+{
+    spi_dma_xfer_t *xfer;
+
+    ENTER_CRITICAL_SECTION();
+    bus->rx.sfr->CR &= ~DMA_SxCR_EN;
+    bus->tx.sfr->CR &= ~DMA_SxCR_EN;
+    bus->spi->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+    *bus->rx_ifcr = bus->rx_flags;
+    *bus->tx_ifcr = bus->tx_flags;
+    NVIC_ClearPendingIRQ(bus->rx_irq); //запоздавшее прерывание не должно завершить следующую транзакцию
+
+    xfer = bus->current;
+    bus->current = NULL;
+    if (xfer) {
+        xfer->cs_port->BSRR = xfer->cs_pin;
+        xfer->status = SPI_DMA_ERROR;
+    }
+    while (bus->queue_out != bus->queue_in)
+        bus->queue[bus->queue_out++ & (SPI_DMA_QUEUE_LEN - 1)]->status = SPI_DMA_ERROR;
+    bus->aborts++;
+    LEAVE_CRITICAL_SECTION();
+}
+
+static void spi_dma_poll_xmit(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer)
+{
+    uint8_t byte;
+
+    xfer->cs_port->BSRR = (uint32_t)xfer->cs_pin << 16;
+    for (uint16_t i = 0; i < xfer->len; i++) {
+        byte = spiXmit(bus->spi, xfer->tx ? xfer->tx[i] : 0);
+        if (xfer->rx)
+            xfer->rx[i] = byte;
+    }
+    xfer->cs_port->BSRR = xfer->cs_pin;
+    xfer->status = SPI_DMA_DONE;
+}
+
+/*!
+ * \return 1 - поток настроен, 0 - поток не остановился за SPI_DMA_POLL_TIMEOUT итераций
+ */
+static uint8_t spi_dma_stream_setup(spi_dma_bus_t *bus, dma_t *dma, uint32_t cr, const volatile void *mem, uint16_t len)
+{
+    int i;
+
+    dma->sfr->CR &= ~DMA_SxCR_EN;
+    for (i = 0; (dma->sfr->CR & DMA_SxCR_EN) && (i < SPI_DMA_POLL_TIMEOUT); i++)
+    {
+    }
+    if (dma->sfr->CR & DMA_SxCR_EN)
+        return 0;
+
+    dma->sfr->PAR = (uint32_t)&bus->spi->DR;
+    if (mem) {
+        dma->sfr->M0AR = (uint32_t)mem;
+        cr |= DMA_SxCR_MINC;
+    } else {
+        dma->sfr->M0AR = (uint32_t)dma->buffer; //без инкремента - гоняем один байт пустышки
+    }
+    dma->sfr->NDTR = len;
+    dma->sfr->FCR = 0; //прямой режим, без FIFO потока
+    dma->sfr->CR = ((uint32_t)dma->DMA_Channel << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL_1 | cr;
+    return 1;
+}
+
+static void spi_dma_start(spi_dma_bus_t *bus, spi_dma_xfer_t *xfer)
+{
+    bus->current = xfer;
+    xfer->status = SPI_DMA_BUSY;
+
+    *bus->rx_ifcr = bus->rx_flags;
+    *bus->tx_ifcr = bus->tx_flags;
+    (void)bus->spi->DR; //сбрасываем возможный остаток RXNE
+
+    if (!spi_dma_stream_setup(bus, &bus->rx, DMA_SxCR_TCIE | DMA_SxCR_TEIE, xfer->rx, xfer->len) ||
+        !spi_dma_stream_setup(bus, &bus->tx, DMA_SxCR_DIR_0, xfer->tx, xfer->len)) {
+        // Поток не отпустил EN - транзакцию не начинаем, CS еще не опущен
+        xfer->status = SPI_DMA_ERROR;
+        bus->current = NULL;
+        spi_dma_start_next(bus);
+        return;
+    }
+
+    xfer->cs_port->BSRR = (uint32_t)xfer->cs_pin << 16;
+
+    // Порядок из RM0383: сначала запрос RX, затем потоки, последним - запрос TX
+    bus->spi->CR2 |= SPI_CR2_RXDMAEN;
+    bus->rx.sfr->CR |= DMA_SxCR_EN;
+    bus->tx.sfr->CR |= DMA_SxCR_EN;
+    bus->spi->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+static void spi_dma_start_next(spi_dma_bus_t *bus)
+{
+    if (bus->queue_out != bus->queue_in)
+        spi_dma_start(bus, bus->queue[bus->queue_out++ & (SPI_DMA_QUEUE_LEN - 1)]);
+}
+
+void DMA1_Stream3_IRQHandler(void)
+{
+    spi_dma_irq(&spi_dma_bus2);
+}
+
+static void spi_dma_irq(spi_dma_bus_t *bus)
+{
+    spi_dma_xfer_t *xfer = bus->current;
+    uint32_t isr = *bus->rx_isr;
+
+    *bus->rx_ifcr = bus->rx_flags;
+    *bus->tx_ifcr = bus->tx_flags;
+
+    bus->rx.sfr->CR &= ~DMA_SxCR_EN;
+    bus->tx.sfr->CR &= ~DMA_SxCR_EN;
+    bus->spi->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+
+    if (xfer == NULL)
+        return;
+
+    xfer->cs_port->BSRR = xfer->cs_pin;
+    xfer->status = (isr & bus->rx_teif) ? SPI_DMA_ERROR : SPI_DMA_DONE;
+
+    // Следующая транзакция стартует до callback, чтобы сохранить порядок очереди
+    bus->current = NULL;
+    spi_dma_start_next(bus);
+
+    if (xfer->callback)
+        xfer->callback(xfer);
+}
@@ -0,0 +1,31 @@
+/*
+ *  crc_a.h
+ *
+ *  CRC_A ISO/IEC 14443-3 (Type A)
+ *
+ *  Polynomial: x^16 + x^12 + x^5 + 1 (0x1021, reflected 0x8408)<br>
+ *  Initial value: 0x6363
+ *
+ *  Check : 0xBF05 ("123456789")
+ *  Результат передается младшим байтом вперед, пересчет по кадру вместе с CRC дает 0.
+ */
+
+#ifndef CRC_A_H_
+#define CRC_A_H_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t crc_a(const uint8_t* buf, size_t len);
+void crc_a_append(uint8_t* buf, size_t len);
+int crc_a_check(const uint8_t* buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
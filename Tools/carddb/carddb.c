@@ -0,0 +1,182 @@
+/*
+ * Сборка образа базы карт RFID_db (формат - Core/Inc/RFID_db.h) из текстового списка
+ *
+ *   carddb [-g generation] cards.txt cards.bin
+ *
+ * Строка списка: UID в hex (4, 7 или 10 байт, разделители ':' и '-' допускаются)
+ * и необязательные атрибуты в hex, по умолчанию 0F - все считыватели. '#' - комментарий.
+ *
+ *   04A1B2C3D4E580 0F
+ *   DE:AD:BE:EF    01      # только считыватель 0
+ *
+ * Образ записывается в flash с адреса 0x08020000: st-flash write cards.bin 0x08020000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "crc32_software.h"
+
+#define DB_MAGIC            0x31424443
+#define DB_SIZE             0x20000
+#define DB_HEADER           16
+#define DB_REC              12
+#define DB_UID_LEN          7
+#define DB_MAX              ((DB_SIZE - DB_HEADER) / DB_REC)
+#define UID_MAX_LEN         10
+
+typedef struct
+{
+    uint32_t hash;
+    uint8_t uid[DB_UID_LEN];
+    uint8_t attr;
+    unsigned line;
+} rec_t;
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+    const rec_t *x = a, *y = b;
+
+    if (x->hash != y->hash)
+        return (x->hash < y->hash) ? -1 : 1;
+    return memcmp(x->uid, y->uid, DB_UID_LEN);
+}
+
+/* UID в hex до пробела; возвращает длину UID или 0 */
+static int parse_uid(const char **s, uint8_t *uid)
+{
+    const char *p = *s;
+    int n = 0, nib = 0, v = 0;
+
+    for (; *p && !isspace((unsigned char)*p) && *p != '#'; p++) {
+        if (*p == ':' || *p == '-')
+            continue;
+        if (!isxdigit((unsigned char)*p) || n == UID_MAX_LEN)
+            return 0;
+        v = (v << 4) | (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+        if (++nib == 2) {
+            uid[n++] = v;
+            nib = v = 0;
+        }
+    }
+    *s = p;
+    return (nib == 0 && (n == 4 || n == 7 || n == 10)) ? n : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static rec_t recs[DB_MAX];
+    static uint8_t image[DB_SIZE];
+    uint32_t generation = 1, count = 0, dup = 0;
+    unsigned line = 0;
+    char buf[256];
+    FILE *in, *out;
+    int arg = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-g")) {
+        generation = strtoul(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-g generation] cards.txt cards.bin\n", argv[0]);
+        return 1;
+    }
+    in = fopen(argv[arg], "r");
+    if (!in) {
+        perror(argv[arg]);
+        return 1;
+    }
+    crc32sftwr_init();
+
+    while (fgets(buf, sizeof(buf), in)) {
+        const char *p = buf;
+        uint8_t key[1 + UID_MAX_LEN];
+        unsigned long attr = 0x0F;
+        char *end;
+        int size;
+
+        line++;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == 0 || *p == '#')
+            continue;
+        size = parse_uid(&p, &key[1]);
+        if (size == 0) {
+            fprintf(stderr, "%s:%u: bad UID\n", argv[arg], line);
+            return 1;
+        }
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p && *p != '#') {
+            attr = strtoul(p, &end, 16);
+            if (end == p || attr > 0xFF) {
+                fprintf(stderr, "%s:%u: bad attributes\n", argv[arg], line);
+                return 1;
+            }
+        }
+        if (count == DB_MAX) {
+            fprintf(stderr, "%s: more than %u cards\n", argv[arg], (unsigned)DB_MAX);
+            return 1;
+        }
+        //ключ - как RFID_db_hash: длина UID и все его байты
+        key[0] = size;
+        recs[count].hash = crc32_sftwr(0, key, 1 + size);
+        memset(recs[count].uid, 0, DB_UID_LEN);
+        memcpy(recs[count].uid, &key[1], size < DB_UID_LEN ? size : DB_UID_LEN);
+        recs[count].attr = attr;
+        recs[count].line = line;
+        count++;
+    }
+    fclose(in);
+    if (count == 0) {
+        fprintf(stderr, "%s: no cards\n", argv[arg]);
+        return 1;
+    }
+
+    qsort(recs, count, sizeof(rec_t), rec_cmp);
+    for (uint32_t i = 1; i < count; i++) {
+        if (recs[i].hash != recs[i - 1].hash)
+            continue;
+        if (!memcmp(recs[i].uid, recs[i - 1].uid, DB_UID_LEN)) {
+            fprintf(stderr, "%s:%u: duplicate of line %u\n", argv[arg], recs[i].line, recs[i - 1].line);
+            return 1;
+        }
+        dup++;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *p = &image[DB_HEADER + i * DB_REC];
+
+        put32(p, recs[i].hash);
+        memcpy(p + 4, recs[i].uid, DB_UID_LEN);
+        p[4 + DB_UID_LEN] = recs[i].attr;
+    }
+    put32(&image[0], DB_MAGIC);
+    put32(&image[4], count);
+    put32(&image[8], crc32_sftwr(0, &image[DB_HEADER], count * DB_REC));
+    put32(&image[12], generation);
+
+    out = fopen(argv[arg + 1], "wb");
+    if (!out) {
+        perror(argv[arg + 1]);
+        return 1;
+    }
+    fwrite(image, 1, DB_HEADER + count * DB_REC, out);
+    fclose(out);
+
+    printf("%u cards, generation %u, %u bytes", count, generation, DB_HEADER + count * DB_REC);
+    if (dup)
+        printf(", %u hash collisions", dup);
+    printf("\n");
+    return 0;
+}
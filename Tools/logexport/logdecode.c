@@ -0,0 +1,154 @@
+/*
+ * Разбор выгрузки журнала RFID_export (формат - Core/Inc/RFID_export.h) в CSV
+ *
+ *   logdecode export.bin > log.csv
+ *
+ * export.bin - принятые передачи tl подряд, в том числе нескольких выгрузок. В stderr печатается
+ * seq для продолжения: запрос 'L' с ним выгружает только новые записи.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EXPORT_MAGIC            0x4C
+#define EXPORT_VERSION          1
+#define EXPORT_HEADER           16
+#define EXPORT_RECENT           8
+#define EXPORT_LAST             0x01
+#define EXPORT_SEQ_GAP          0x01
+#define EXPORT_NEW_BOOT         0x02
+#define UID_MAX_LEN             10
+
+static const char *decisions[] = {"denied", "opened", "closed", "?"};
+static const char *sources[] = {"password", "cache", "db", "bloom"};
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int getvar(const uint8_t **p, const uint8_t *end, uint32_t *v)
+{
+    uint8_t shift = 0;
+
+    *v = 0;
+    while (*p < end && shift < 35) {
+        *v |= (uint32_t)(**p & 0x7F) << shift;
+        if (!(*(*p)++ & 0x80))
+            return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+/*
+ * Одна передача: записи в CSV, *pp - на следующую передачу, -1 - передача испорчена
+ */
+static int chunk(const uint8_t **pp, const uint8_t *end, uint32_t *next, uint8_t *last)
+{
+    const uint8_t *p = *pp;
+    uint8_t recent[EXPORT_RECENT][1 + UID_MAX_LEN];
+    uint8_t uid[1 + UID_MAX_LEN];
+    uint32_t seq, time, v;
+    uint16_t count, boot;
+    uint8_t head, i;
+
+    if (end - p < EXPORT_HEADER || p[0] != EXPORT_MAGIC || p[1] != EXPORT_VERSION)
+        return -1;
+    *last = p[2] & EXPORT_LAST;
+    count = p[4] | (p[5] << 8);
+    boot = p[6] | (p[7] << 8);
+    seq = get32(&p[8]) - 1;
+    time = get32(&p[12]);
+    p += EXPORT_HEADER;
+    memset(recent, 0, sizeof(recent));
+
+    while (count--) {
+        if (p >= end)
+            return -1;
+        head = *p++;
+        if (head & EXPORT_SEQ_GAP) {
+            if (getvar(&p, end, &v))
+                return -1;
+            seq += v;
+        }
+        seq++;
+        if (head & EXPORT_NEW_BOOT) {
+            if (getvar(&p, end, &v))
+                return -1;
+            boot = v;
+            if (getvar(&p, end, &time))
+                return -1;
+        } else {
+            if (getvar(&p, end, &v))
+                return -1;
+            time += v;
+        }
+        if (getvar(&p, end, &v) || p >= end)
+            return -1;
+
+        memset(uid, 0, sizeof(uid));
+        if (*p & 0x80) {
+            i = *p++ & 0x7F;
+            if (i >= EXPORT_RECENT)
+                return -1;
+            memcpy(uid, recent[i], sizeof(uid));
+        } else {
+            i = EXPORT_RECENT - 1;
+            uid[0] = *p++;
+            if (uid[0] > UID_MAX_LEN || end - p < uid[0])
+                return -1;
+            memcpy(&uid[1], p, uid[0]);
+            p += uid[0];
+            //список с переносом в начало, как на устройстве
+            for (uint8_t j = 0; j < EXPORT_RECENT - 1; j++) {
+                if (!memcmp(recent[j], uid, sizeof(uid))) {
+                    i = j;
+                    break;
+                }
+            }
+        }
+        memmove(recent[1], recent[0], i * sizeof(uid));
+        memcpy(recent[0], uid, sizeof(uid));
+
+        printf("%u,%u,%u,", seq, boot, time);
+        for (i = 0; i < uid[0]; i++)
+            printf("%02X", uid[1 + i]);
+        printf(",%s,%s,%u,%u\n", decisions[(head >> 2) & 0x03], sources[(head >> 4) & 0x03], head >> 6, v);
+        *next = seq + 1;
+    }
+    *pp = p;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[1 << 24];
+    uint32_t next = 0;
+    uint8_t last = 1;
+    size_t len;
+    FILE *f;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s export.bin\n", argv[0]);
+        return 1;
+    }
+    if (!(f = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    //передачи идут подряд без длины: конец каждой находится разбором ее записей
+    printf("seq,boot,time_ms,uid,decision,source,reader,latency_us\n");
+    for (const uint8_t *p = buf; p < buf + len;) {
+        if (chunk(&p, buf + len, &next, &last)) {
+            fprintf(stderr, "bad chunk at %ld\n", (long)(p - buf));
+            return 1;
+        }
+    }
+    fprintf(stderr, "next seq %u%s\n", next, last ? "" : " (export interrupted)");
+    return 0;
+}
@@ -0,0 +1,1158 @@
+/*
+ * Замер обменов драйвера RC522 на модели (см. rc522_sim.h)
+ *
+ * Собирается на ПК вместе с драйвером и модулями RFID_* (список - Makefile, make в этом каталоге).
+ * Для каждой операции печатает число транзакций SPI, байт, время шины и эфира:
+ * по этим числам сравниваются изменения драйвера без платы и без карт.
+ * Задачи главного цикла (цепочки, инвентаризация, присутствие, обнаружение, образ карты)
+ * выполняются проходами bench_loop, flash секторов базы и журнала - память по тем же адресам,
+ * канал tl выгрузки - петля к приемнику бенча, который проверяет формат передач.
+ */
+
+#define MAIN
+#include "include.h"
+#include "rc522_sim.h"
+#include "crc32_software.h"
+#include "tl_protocol.h"
+#include <sys/mman.h>
+
+//заглушки платы и модулей прошивки, не участвующих в замере
+
+//время: модель считает SPI и эфир, бенч добавляет задержки и проходы главного цикла
+#define BENCH_LOOP_US       100                 // проход главного цикла без обменов
+
+static uint64_t bench_us;
+
+uint32_t HAL_GetTick(void)
+{
+    return (uint32_t)((rc522_sim_time_ns() / 1000 + bench_us) / 1000);
+}
+
+void delay_ms(uint32_t ms)
+{
+    bench_us += (uint64_t)ms * 1000;
+}
+
+void delay_us(uint32_t us)
+{
+    bench_us += us;
+}
+
+void software_timer_start(timeout_t *timer, uint32_t ms)
+{
+    (void)timer;
+    (void)ms;
+}
+
+STIME_RESULT software_timer(timeout_t *timer)
+{
+    (void)timer;
+    return (STIME_RESULT)0;
+}
+
+//flash: сектора 5..7 STM32F411 по 128 КБ (база карт и журнал) по тем же адресам, что на плате
+#define BENCH_FLASH_ADDR    RFID_DB_ADDR
+#define BENCH_FLASH_SECTOR  0x20000
+#define BENCH_FLASH_SIZE    (RFID_LOG_ADDR + RFID_LOG_SECTORS * RFID_LOG_SECTOR_SIZE - RFID_DB_ADDR)
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE MAP_FIXED
+#endif
+
+static uint8_t *bench_flash;
+
+static int bench_flash_init(void)
+{
+    bench_flash = mmap((void *)(uintptr_t)BENCH_FLASH_ADDR, BENCH_FLASH_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (bench_flash != (uint8_t *)(uintptr_t)BENCH_FLASH_ADDR)
+        return -1;
+    memset(bench_flash, 0xFF, BENCH_FLASH_SIZE);    //новая микросхема стерта
+    return 0;
+}
+
+/*!
+ * \brief Стирание n секторов с сектора по адресу, 0xFFFFFFFF - успех, как HAL_FLASHEx_Erase
+ */
+uint32_t flash_erase(uint32_t address, uint16_t n)
+{
+    uint32_t offset = address - BENCH_FLASH_ADDR;
+
+    if (address < BENCH_FLASH_ADDR || offset % BENCH_FLASH_SECTOR ||
+        offset + (uint32_t)n * BENCH_FLASH_SECTOR > BENCH_FLASH_SIZE)
+        return offset / BENCH_FLASH_SECTOR;
+    memset(bench_flash + offset, 0xFF, (uint32_t)n * BENCH_FLASH_SECTOR);
+    return 0xFFFFFFFFU;
+}
+
+/*!
+ * \brief Запись словами: программирование только сбрасывает биты, хвост дополняется 0xFF
+ */
+flsh_error_status flash_write(uint32_t *address, void *data, size_t size)
+{
+    const uint8_t *src = data;
+    uint32_t offset = *address - BENCH_FLASH_ADDR;
+    uint32_t words = (size + 3) / 4;
+
+    if ((*address % 4) || *address < BENCH_FLASH_ADDR || offset + words * 4 > BENCH_FLASH_SIZE)
+        return FLSH_ERROR;
+    for (size_t i = 0; i < words * 4; i++)
+        bench_flash[offset + i] &= (i < size) ? src[i] : 0xFF;
+    *address += words * 4;
+    return FLSH_ERROR_NONE;
+}
+
+//канал tl RFID_export - петля: передача подтверждается следующим tl_task и уходит приемнику бенча
+static struct
+{
+    uint8_t lost;                               // приемник не отвечает: передача кончается потерей связи
+    uint8_t request[8];                         // запрос к прошивке, принимается следующим tl_task
+    uint8_t request_len;
+    void (*recv)(const uint8_t *data, uint16_t len);
+} bench_peer;
+
+void tl_init(tl_object_t *tl, int socket, uint16_t repeat_timeout, uint16_t reset_timeout)
+{
+    memset(tl, 0, sizeof(*tl));
+    tl->tl_socket = socket;
+}
+
+void tl_set_rx_file(tl_object_t *tl, uint8_t *file, uint16_t file_size)
+{
+    tl->rx_file.data_file = file;
+    tl->rx_file.file_size = file_size;
+}
+
+uint16_t tl_get_rx_msg_size(tl_object_t *tl)
+{
+    return tl->rx_file.result_offset;
+}
+
+void tl_reset_rx_msg_size(tl_object_t *tl)
+{
+    tl->rx_file.result_offset = 0;
+}
+
+uint8_t tl_busy_status(tl_object_t *tl)
+{
+    return tl->busy;
+}
+
+void tl_send(tl_object_t *tl, uint8_t *file, size_t file_size)
+{
+    tl->tx_file.data_file = file;
+    tl->tx_file.file_size = file_size;
+    tl->busy = 1;
+}
+
+tl_process_t tl_task(tl_object_t *tl)
+{
+    if (tl->busy) {
+        tl->busy = 0;
+        if (bench_peer.lost)
+            return TL_LOST_CONNECT;
+        if (bench_peer.recv)
+            bench_peer.recv(tl->tx_file.data_file, tl->tx_file.file_size);
+        return TL_PROCESS_END;
+    }
+    if (bench_peer.request_len) {
+        tl->rx_file.result_offset = MIN(bench_peer.request_len, tl->rx_file.file_size);
+        memcpy(tl->rx_file.data_file, bench_peer.request, tl->rx_file.result_offset);
+        bench_peer.request_len = 0;
+        return TL_PROCESS_END;
+    }
+    return TL_EMPTY;
+}
+
+static void bench_report(const char *name, uint8_t status)
+{
+    const rc522_sim_stats_t *st = rc522_sim_stats();
+
+    printf("%-28s %-3s %6u tr %7u B %4u fr %9.1f us SPI %9.1f us RF\n",
+           name, (status == MI_OK) ? "ok" : "ERR",
+           (unsigned)st->transactions, (unsigned)st->bytes, (unsigned)st->frames,
+           st->spi_ns / 1000.0, st->rf_ns / 1000.0);
+    rc522_sim_stats_reset();
+}
+
+/*
+ * Векторы разбора ответа ANTICOLLISION по правилам datasheet MFRC522 (см. MFRC522_AnticollMerge),
+ * а не по модели: CollReg задается явно. Ответ - содержимое FIFO, младшие RxAlign бит первого
+ * байта в нем - мусор, их место занимают переданные нами биты.
+ */
+typedef struct
+{
+    uint8_t known;                              // бит UID уровня известно до запроса, RxAlign = known % 8
+    uint8_t sel[7];                             // кадр SEL, NVB, UID, BCC до ответа
+    uint8_t resp[5];
+    uint8_t bits;                               // принято бит, как возвращает MFRC522_ToCard
+    uint8_t status;
+    uint8_t coll;                               // CollReg
+    uint8_t result;
+    uint8_t known_after;
+    uint8_t uid_after[5];                       // UID и BCC уровня после разбора
+} bench_anticoll_vector_t;
+
+static const bench_anticoll_vector_t anticoll_vectors[] = {
+    //CollPos 01h: коллизия в 1-м бите, 12 и 13 в первом байте
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x34, 0x56, 0x78, 0x08}, 40, MI_COLLISION, 0x01,
+         MI_BUSY, 1,  {0x13, 0x34, 0x56, 0x78, 0x08}},
+    //CollPos 00h: коллизия в 32-м бите
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x34, 0x56, 0x78, 0x08}, 40, MI_COLLISION, 0x00,
+         MI_BUSY, 32, {0x12, 0x34, 0x56, 0xF8, 0x08}},
+    //CollPos 0Dh: 13-й бит, внутри второго байта
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x24, 0x56, 0x78, 0x08}, 40, MI_COLLISION, 0x0D,
+         MI_BUSY, 13, {0x12, 0x34, 0x56, 0x78, 0x08}},
+    //RxAlign 5 после 13 бит: ответ с 14-го бита UID, коллизия в 20-м - 7-й принятый бит,
+    //CollPos = 5 + 7 = 0Ch. Не выровнено ни по байту кадра, ни по байту FIFO
+    {13, {0x93, 0x35, 0x12, 0xF4, 0, 0, 0}, {0x2B, 0x56, 0x78, 0x08}, 32, MI_COLLISION, 0x0C,
+         MI_BUSY, 20, {0x12, 0x34, 0x5E, 0x78, 0x08}},
+    //RxAlign 7: первый принятый бит - старший бит байта FIFO, коллизия в 9-м бите UID, CollPos 09h
+    {7,  {0x93, 0x27, 0x12, 0, 0, 0, 0}, {0x55, 0x34, 0x56, 0x78, 0x08}, 40, MI_COLLISION, 0x09,
+         MI_BUSY, 9,  {0x12, 0x35, 0x56, 0x78, 0x08}},
+    //24 бита известны, RxAlign 0: ответ с 4-го байта, коллизия в 30-м бите - 6-й принятый
+    {24, {0x93, 0x50, 0x12, 0x34, 0x56, 0, 0}, {0x58, 0x08}, 16, MI_COLLISION, 0x06,
+         MI_BUSY, 30, {0x12, 0x34, 0x56, 0x78, 0x08}},
+    //CollPosNotValid
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x34, 0x56, 0x78, 0x08}, 40, MI_COLLISION, 0x20,
+         MI_ERR, 0, {0}},
+    //коллизия в уже известном бите
+    {13, {0x93, 0x35, 0x12, 0xF4, 0, 0, 0}, {0x2B, 0x56, 0x78, 0x08}, 32, MI_COLLISION, 0x05,
+         MI_ERR, 0, {0}},
+    //без коллизии: проверка BCC
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x34, 0x56, 0x78, 0x08}, 40, MI_OK, 0x00,
+         MI_OK, 32, {0x12, 0x34, 0x56, 0x78, 0x08}},
+    {0,  {0x93, 0x20, 0, 0, 0, 0, 0}, {0x12, 0x34, 0x56, 0x78, 0x09}, 40, MI_OK, 0x00,
+         MI_ERR, 0, {0}},
+};
+
+static void bench_anticoll_vectors(void)
+{
+    const bench_anticoll_vector_t *v;
+    uint8_t sel[9];
+    uint8_t known, status;
+    uint8_t failed = 0;
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(anticoll_vectors); i++) {
+        v = &anticoll_vectors[i];
+        memcpy(sel, v->sel, sizeof(v->sel));
+        known = v->known;
+        rc522_sim_set_coll(v->coll);
+        status = MFRC522_AnticollMerge(rfid.reader->dev, sel, &known, v->status, v->resp, v->bits);
+        if (status != v->result ||
+            (status != MI_ERR && (known != v->known_after || memcmp(&sel[2], v->uid_after, 5)))) {
+            printf("  vector %u: status %u, known %u, UID %02X %02X %02X %02X %02X\n",
+                   i, status, known, sel[2], sel[3], sel[4], sel[5], sel[6]);
+            failed = 1;
+        }
+    }
+    bench_report("AnticollMerge vectors", failed ? MI_ERR : MI_OK);
+}
+
+static void bench_add_cards(uint8_t cards)
+{
+    uint8_t uid[4];
+
+    rc522_sim_remove_cards();
+    for (uint8_t i = 0; i < cards; i++) {
+        uid[0] = 0x20 + i;                      //отличаются младшими битами первого байта
+        uid[1] = 0x5A;
+        uid[2] = i * 37;
+        uid[3] = 0xC3;
+        rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, sizeof(uid));
+    }
+}
+
+static void bench_single(const char *title, const uint8_t *uid, uint8_t size)
+{
+    uint8_t auth_uid[UID_SIZE];
+    uint8_t block[16];
+    uint8_t sector[48];
+    uint8_t status;
+
+    printf("-- %s\n", title);
+    rc522_sim_remove_cards();
+    rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    rc522_sim_stats_reset();
+
+    status = RFID_getUID(auth_uid);
+    bench_report("RFID_getUID", status);
+    status = RFID_ReadBlock(4, block, rfid.defkey, auth_uid);
+    bench_report("RFID_ReadBlock (auth)", status);
+    status = RFID_ReadBlock(5, block, rfid.defkey, auth_uid);
+    bench_report("RFID_ReadBlock (session)", status);
+    status = RFID_ReadSector(2, sector, rfid.defkey, auth_uid);
+    bench_report("RFID_ReadSector", status);
+    RFID_close();
+    bench_report("RFID_close", MI_OK);
+}
+
+static void bench_retry(const uint8_t *uid, uint8_t size)
+{
+    static uint8_t wrong_key[KEY_LEN] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5};
+    uint8_t auth_uid[UID_SIZE];
+    uint8_t block[16];
+    uint8_t status;
+
+    printf("-- auth failure and retry\n");
+    rc522_sim_remove_cards();
+    rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    status = RFID_getUID(auth_uid);
+    rc522_sim_stats_reset();
+
+    //после отказа карта в IDLE: повтор выбирает ее заново без RFID_getUID
+    status = RFID_ReadBlock(4, block, wrong_key, auth_uid);
+    bench_report("RFID_ReadBlock (wrong key)", (status == MI_OK) ? MI_ERR : MI_OK);
+    status = RFID_ReadBlock(4, block, rfid.defkey, auth_uid);
+    bench_report("RFID_ReadBlock (retry)", status);
+    status = RFID_ReadBlock(5, block, rfid.defkey, auth_uid);
+    bench_report("RFID_ReadBlock (session)", status);
+    RFID_close();
+    rc522_sim_stats_reset();
+}
+
+static void bench_field(uint8_t cards)
+{
+    mfrc522_t *dev = rfid.reader->dev;
+    uint8_t atqa[2];
+    rfid_uid_t card;
+    uint8_t found = 0;
+
+    printf("-- %u cards, REQA + SELECT + HALT\n", cards);
+    bench_add_cards(cards);
+    RFID_session_reset();
+    rc522_sim_stats_reset();
+
+    while (MFRC522_Request(dev, PICC_REQIDL, atqa) == MI_OK) {
+        if (MFRC522_Select(dev, &card) != MI_OK)
+            break;
+        found++;
+        MFRC522_Halt(dev);
+        ClearBitMask(dev, Status2Reg, 0x08);
+    }
+    bench_report("inventory", (found == cards) ? MI_OK : MI_ERR);
+    printf("   found %u of %u\n", found, cards);
+}
+
+static void bench_ntag(const char *title, rc522_sim_card_type_t type, const uint8_t *uid)
+{
+    static uint8_t user[231 * MFRC522_PAGE_LEN];
+    static const uint8_t page[MFRC522_PAGE_LEN] = {0x03, 0x00, 0xFE, 0x00};
+    static const uint8_t pwd[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t pack[2] = {0x00, 0x00};
+    uint8_t auth_uid[UID_SIZE];
+    uint8_t block[16];
+    uint16_t len;
+    uint8_t status;
+    uint8_t pages;
+
+    printf("-- %s\n", title);
+    rc522_sim_remove_cards();
+    rc522_sim_add_card(type, uid, 7);
+    rc522_sim_stats_reset();
+
+    status = RFID_getUID(auth_uid);
+    bench_report("RFID_getUID", status);
+    status = RFID_ntag_detect();
+    bench_report("RFID_ntag_detect", status);
+    status = RFID_ntag_read_user(user, sizeof(user), &len);
+    bench_report("RFID_ntag_read_user", status);
+    printf("   %u bytes\n", len);
+
+    //то же постранично командой READ, для сравнения
+    pages = len / MFRC522_PAGE_LEN;
+    status = MI_OK;
+    for (uint8_t p = 0; p < pages && status == MI_OK; p += 4)
+        status = MFRC522_Read(rfid.reader->dev, RFID_NTAG_USER_FIRST + p, block);
+    bench_report("MFRC522_Read (user, 4 pages)", status);
+
+    status = RFID_ntag_write(RFID_NTAG_USER_FIRST, page, 1);
+    bench_report("RFID_ntag_write (1 page)", status);
+    if (rfid.reader->ntag.pwd_page) {
+        status = RFID_ntag_auth(pwd, pack);
+        bench_report("RFID_ntag_auth", status);
+    }
+    RFID_close();
+    bench_report("RFID_close", MI_OK);
+}
+
+static void bench_value(const uint8_t *uid, uint8_t size)
+{
+    uint8_t auth_uid[UID_SIZE];
+    uint8_t block[16];
+    int32_t value = 0;
+    uint8_t status;
+
+    printf("-- value block\n");
+    rc522_sim_remove_cards();
+    rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    RFID_getUID(auth_uid);
+    rc522_sim_stats_reset();
+
+    status = RFID_value_format(4, 10, rfid.defkey, auth_uid);
+    bench_report("RFID_value_format", status);
+
+    //списание чтением и записью блока с проверкой
+    status = RFID_ReadBlock(4, block, rfid.defkey, auth_uid);
+    if (status == MI_OK && RFID_value_decode(block, &value, NULL) == MI_OK) {
+        RFID_value_encode(value - 1, 4, block);
+        status = RFID_WriteReadBlock(4, block, block, rfid.defkey, auth_uid);
+    }
+    bench_report("read + write + verify", status);
+
+    status = RFID_value_decrement(4, 1, rfid.defkey, auth_uid);
+    bench_report("RFID_value_decrement", status);
+    status = RFID_value_copy(4, 5, rfid.defkey, auth_uid);
+    bench_report("RFID_value_copy", status);
+    status = RFID_value_read(5, &value, rfid.defkey, auth_uid);
+    bench_report("RFID_value_read", (status == MI_OK && value == 8) ? MI_OK : MI_ERR);
+    RFID_close();
+    rc522_sim_stats_reset();
+}
+
+/*
+ * Главный цикл прошивки (main.c) без Lock_task: проходы до условия done или ms миллисекунд
+ * \return 1 - условие выполнено
+ */
+static uint8_t bench_loop(uint8_t (*done)(void), uint32_t ms)
+{
+    uint32_t end = HAL_GetTick() + ms;
+
+    while ((int32_t)(HAL_GetTick() - end) < 0) {
+        RFID_reinit();
+        RFID_poll();
+        RFID_log_task();
+        RFID_export_task();
+        RFID_image_task();
+        RFID_trace_task();
+        RFID_inventory_task();
+        RFID_detect_task();
+        RFID_presence_task();
+        RFID_reader_task();
+        if (done && done())
+            return 1;
+        bench_us += BENCH_LOOP_US;
+    }
+    return 0;
+}
+
+static uint8_t bench_async_idle(void)
+{
+    return !RFID_busy();
+}
+
+static void bench_async(const uint8_t *uid, uint8_t size)
+{
+    static uint8_t data[16] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+                               0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F};
+    static uint8_t block[16];
+    const rfid_step_t steps[] = {
+        {RFID_STEP_REQA,     0, NULL,        NULL},
+        {RFID_STEP_ANTICOLL, 0, NULL,        NULL},
+        {RFID_STEP_SELECT,   0, NULL,        NULL},
+        {RFID_STEP_AUTH,     4, rfid.defkey, NULL},
+        {RFID_STEP_WRITE,    5, NULL,        data},
+        {RFID_STEP_READ,     5, NULL,        block},
+    };
+    rfid_request_t req = {.steps = steps, .count = ARRAY_SIZE(steps), .halt = 1};
+    rfid_request_t other = req;
+    uint8_t *mem;
+    uint8_t status;
+    int card;
+
+    printf("-- async chain\n");
+    rc522_sim_remove_cards();
+    card = rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    mem = rc522_sim_card_memory(card);
+    RFID_reader_task();
+    rc522_sim_stats_reset();
+
+    status = RFID_submit(&req);
+    if (status == MI_OK && RFID_submit(&other) == MI_OK)
+        status = MI_ERR;                        //вторая цепочка при занятом считывателе не принимается
+    if (status == MI_OK && bench_loop(bench_async_idle, 100))
+        status = req.status;
+    if (status == MI_OK && (req.card.size != size || memcmp(req.card.bytes, uid, size) ||
+                            memcmp(&mem[5 * 16], data, 16) || memcmp(block, data, 16)))
+        status = MI_ERR;
+    bench_report("RFID_submit (chain)", status);
+
+    //без карты цепочка кончается на REQA, HALT не отправляется
+    rc522_sim_card_present(card, 0);
+    status = MI_ERR;
+    if (RFID_submit(&req) == MI_OK && bench_loop(bench_async_idle, 100))
+        status = (req.status == MI_NOTAGERR && req.failed_step == 0) ? MI_OK : MI_ERR;
+    bench_report("RFID_submit (no card)", status);
+}
+
+static struct
+{
+    uint8_t cards;
+    uint8_t ends;
+    uint8_t dup;
+} bench_inv;
+
+static void bench_inventory_sink(const rfid_uid_t *uid, void *ctx)
+{
+    if (uid == NULL) {
+        bench_inv.ends++;
+        return;
+    }
+    for (uint8_t i = 0; i + 1 < RFID_inventory_count(); i++) {
+        if (!memcmp(RFID_inventory_card(i), uid, sizeof(*uid)))
+            bench_inv.dup++;
+    }
+    bench_inv.cards++;
+}
+
+static uint8_t bench_inventory_idle(void)
+{
+    return !RFID_inventory_busy();
+}
+
+static void bench_inventory(uint8_t cards)
+{
+    uint8_t status;
+
+    printf("-- %u cards, RFID_inventory\n", cards);
+    bench_add_cards(cards);
+    memset(&bench_inv, 0, sizeof(bench_inv));
+    RFID_session_reset();
+    rc522_sim_stats_reset();
+
+    status = RFID_inventory_start(bench_inventory_sink, NULL);
+    if (status == MI_OK && !bench_loop(bench_inventory_idle, 2000))
+        status = MI_ERR;
+    if (status == MI_OK && (bench_inv.cards != cards || RFID_inventory_count() != cards ||
+                            bench_inv.ends != 1 || bench_inv.dup || RFID_inventory_overflow()))
+        status = MI_ERR;
+    bench_report("RFID_inventory", status);
+    printf("   found %u of %u\n", bench_inv.cards, cards);
+}
+
+static struct
+{
+    uint8_t arrived;
+    uint8_t present;
+    uint8_t left;
+    uint8_t status;                             // RFID_CARD_ARRIVED
+    rfid_uid_t card;
+} bench_pres;
+
+static void bench_presence_cb(rfid_card_event_t event, const rfid_uid_t *card, uint8_t status, void *ctx)
+{
+    switch (event) {
+        case RFID_CARD_ARRIVED:
+            bench_pres.arrived++;
+            bench_pres.status = status;
+            bench_pres.card = *card;
+            break;
+        case RFID_CARD_PRESENT:
+            bench_pres.present++;
+            break;
+        case RFID_CARD_LEFT:
+            bench_pres.left++;
+            break;
+    }
+}
+
+static uint8_t bench_presence_accept(const rfid_uid_t *card)
+{
+    return MI_OK;
+}
+
+static uint8_t bench_presence_reject(const rfid_uid_t *card)
+{
+    return MI_ERR;
+}
+
+static uint8_t bench_presence_arrived(void)
+{
+    return bench_pres.arrived != 0;
+}
+
+static uint8_t bench_presence_left(void)
+{
+    return bench_pres.left != 0;
+}
+
+static void bench_presence(const uint8_t *uid, uint8_t size)
+{
+    static uint8_t block[16];
+    const rfid_step_t steps[] = {
+        {RFID_STEP_CHECK,    0, NULL,        NULL},
+        {RFID_STEP_AUTH,     4, rfid.defkey, NULL},
+        {RFID_STEP_READ,     4, NULL,        block},
+    };
+    uint8_t status;
+    int card;
+
+    printf("-- presence\n");
+    rc522_sim_remove_cards();
+    card = rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    memset(&bench_pres, 0, sizeof(bench_pres));
+    RFID_detect_enable(0);                      //поле включено всегда: проверяется только отслеживание
+    RFID_presence_init(bench_presence_cb, NULL, steps, ARRAY_SIZE(steps));
+    RFID_presence_check(bench_presence_accept);
+    rc522_sim_stats_reset();
+
+    status = bench_loop(bench_presence_arrived, 100) ? bench_pres.status : MI_ERR;
+    if (status == MI_OK && (bench_pres.card.size != size || memcmp(bench_pres.card.bytes, uid, size) ||
+                            memcmp(block, rc522_sim_card_memory(card) + 4 * 16, 16)))
+        status = MI_ERR;
+    bench_report("RFID_CARD_ARRIVED", status);
+
+    //карта в HALT: раз в RFID_PRES_PROBE_MS короткая проверка WUPA + ANTICOLL
+    bench_loop(NULL, 10 * RFID_PRES_PROBE_MS);
+    status = (bench_pres.present >= 9 && bench_pres.arrived == 1 && !bench_pres.left &&
+              RFID_presence_present()) ? MI_OK : MI_ERR;
+    bench_report("RFID_CARD_PRESENT (1 s)", status);
+    printf("   %u checks\n", bench_pres.present);
+
+    //CARD_LEFT - только после RFID_PRES_MISSES пропусков подряд
+    rc522_sim_card_present(card, 0);
+    bench_loop(NULL, (RFID_PRES_MISSES - 1) * RFID_PRES_PROBE_MS);
+    status = bench_pres.left ? MI_ERR : MI_OK;
+    if (status == MI_OK && !bench_loop(bench_presence_left, 2 * RFID_PRES_PROBE_MS))
+        status = MI_ERR;
+    bench_report("RFID_CARD_LEFT", (status == MI_OK && RFID_presence_card() == NULL) ? MI_OK : MI_ERR);
+
+    //отказ проверки UID: карта приходит с ошибкой шага CHECK, ключ и чтение не нужны
+    RFID_presence_check(bench_presence_reject);
+    bench_pres.arrived = 0;
+    rc522_sim_card_present(card, 1);
+    status = bench_loop(bench_presence_arrived, 100) ? MI_OK : MI_ERR;
+    if (status == MI_OK && (bench_pres.status == MI_OK || rfid.reader->presence.req.failed_step != RFID_PRES_SELECT_STEPS))
+        status = MI_ERR;
+    bench_report("RFID_CARD_ARRIVED (rejected)", status);
+
+    RFID_presence_init(NULL, NULL, NULL, 0);
+    RFID_detect_enable(1);
+}
+
+static uint32_t bench_det_sleeps;
+
+static uint8_t bench_detect_sleeping(void)
+{
+    return RFID_detect_stats()->sleeps != bench_det_sleeps;
+}
+
+static uint8_t bench_detect_awake(void)
+{
+    return RFID_detect_active();
+}
+
+static void bench_detect(const uint8_t *uid, uint8_t size)
+{
+    const rfid_detect_policy_t *policy = RFID_detect_policy();
+    const rfid_detect_stats_t *st = RFID_detect_stats();
+    rfid_detect_stats_t before = *st;
+    uint8_t status;
+    int card;
+
+    printf("-- detect\n");
+    rc522_sim_remove_cards();
+    RFID_detect_wake();
+    rc522_sim_stats_reset();
+
+    //пустое поле: после hold_ms проверка WUPA и PowerDown
+    bench_det_sleeps = st->sleeps;
+    status = bench_loop(bench_detect_sleeping, policy->hold_ms + 50) ? MI_OK : MI_ERR;
+    if (status == MI_OK && st->sleeps != before.sleeps + 1)
+        status = MI_ERR;
+    bench_report("sleep after hold", status);
+
+    //зонды раз в interval_ms, поле только на burst_ms перед REQA
+    bench_loop(NULL, 10 * policy->interval_ms);
+    status = (!RFID_detect_active() && st->probes - before.probes >= 9 && st->wakes == before.wakes) ? MI_OK : MI_ERR;
+    bench_report("probes, empty field", status);
+    printf("   %u probes\n", (unsigned)(st->probes - before.probes));
+
+    //карта найдена зондом; поле включено только что не было - ждать его не нужно
+    card = rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    status = bench_loop(bench_detect_awake, 2 * policy->interval_ms) ? MI_OK : MI_ERR;
+    if (status == MI_OK && (st->wakes != before.wakes + 1 || !RFID_detect_powered()))
+        status = MI_ERR;
+    bench_report("wake by probe", status);
+
+    //пробуждение из PowerDown вызывающим: карте нужен burst_ms, до этого RFID_session_select - MI_BUSY
+    rc522_sim_card_present(card, 0);
+    bench_det_sleeps = st->sleeps;
+    bench_loop(bench_detect_sleeping, policy->hold_ms + 50);
+    status = (RFID_detect_wake() == 1 && !RFID_detect_powered()) ? MI_OK : MI_ERR;
+    delay_ms(policy->burst_ms);
+    if (status == MI_OK && !RFID_detect_powered())
+        status = MI_ERR;
+    bench_report("RFID_detect_wake", status);
+}
+
+static void bench_cache(void)
+{
+    const rfid_cache_stats_t *st = RFID_cache_stats();
+    rfid_uid_t cards[RFID_CACHE_SIZE + 1];
+    uint8_t result = MI_ERR;
+    uint8_t status = MI_OK;
+
+    printf("-- cache\n");
+    memset(cards, 0, sizeof(cards));
+    for (uint8_t i = 0; i <= RFID_CACHE_SIZE; i++) {
+        cards[i].size = 4;
+        cards[i].bytes[0] = 0xC0;
+        cards[i].bytes[3] = i;
+    }
+    RFID_cache_clear();
+    rc522_sim_stats_reset();
+
+    RFID_cache_put(&cards[0], MI_OK);
+    RFID_cache_put(&cards[1], MI_ERR);
+    if (RFID_cache_get(&cards[0], &result) != MI_OK || result != MI_OK ||
+        RFID_cache_get(&cards[1], &result) != MI_OK || result != MI_ERR ||
+        RFID_cache_get(&cards[2], &result) != MI_ERR)
+        status = MI_ERR;
+    bench_report("hit and miss", status);
+
+    //срок действия: запись удаляется при обращении
+    delay_ms(RFID_CACHE_TTL_MS);
+    status = (RFID_cache_get(&cards[0], &result) == MI_ERR && st->expired == 1) ? MI_OK : MI_ERR;
+    bench_report("expired", status);
+
+    //заполненный кэш вытесняет давно не предъявленную карту, недавно прочитанная остается
+    RFID_cache_clear();
+    for (uint8_t i = 0; i < RFID_CACHE_SIZE; i++) {
+        RFID_cache_put(&cards[i], MI_OK);
+        delay_ms(1);
+    }
+    RFID_cache_get(&cards[0], &result);
+    RFID_cache_put(&cards[RFID_CACHE_SIZE], MI_OK);
+    status = (st->evictions == 1 && RFID_cache_get(&cards[0], &result) == MI_OK &&
+              RFID_cache_get(&cards[1], &result) == MI_ERR &&
+              RFID_cache_get(&cards[RFID_CACHE_SIZE], &result) == MI_OK) ? MI_OK : MI_ERR;
+    bench_report("eviction", status);
+    printf("   hits %u, misses %u, expired %u, evictions %u\n",
+           (unsigned)st->hits, (unsigned)st->misses, (unsigned)st->expired, (unsigned)st->evictions);
+}
+
+#define BENCH_DB_CARDS      500
+
+static int bench_db_cmp(const void *a, const void *b)
+{
+    const rfid_db_rec_t *x = a, *y = b;
+
+    return (x->hash > y->hash) - (x->hash < y->hash);
+}
+
+static rfid_uid_t bench_db_card(uint16_t i)
+{
+    rfid_uid_t card = {0};
+
+    card.size = (i & 1) ? 7 : 4;
+    card.bytes[0] = 0x04;
+    card.bytes[1] = i;
+    card.bytes[2] = i >> 8;
+    card.bytes[3] = 0x5C;
+    return card;
+}
+
+static void bench_db(void)
+{
+    static uint8_t image[sizeof(rfid_db_header_t) + BENCH_DB_CARDS * sizeof(rfid_db_rec_t)];
+    rfid_db_header_t *header = (rfid_db_header_t *)image;
+    rfid_db_rec_t *recs = (rfid_db_rec_t *)(image + sizeof(rfid_db_header_t));
+    rfid_uid_t card;
+    uint32_t offset, len;
+    uint16_t found = 0;
+    uint8_t attr;
+    uint8_t status;
+
+    printf("-- card database\n");
+    for (uint16_t i = 0; i < BENCH_DB_CARDS; i++) {
+        card = bench_db_card(i);
+        memset(&recs[i], 0, sizeof(recs[i]));
+        recs[i].hash = RFID_db_hash(&card);
+        memcpy(recs[i].uid, card.bytes, card.size);
+        recs[i].attr = (i % 10 == 0) ? RFID_DB_ATTR_BLOCKED : 1;
+    }
+    qsort(recs, BENCH_DB_CARDS, sizeof(rfid_db_rec_t), bench_db_cmp);
+    header->magic = RFID_DB_MAGIC;
+    header->count = BENCH_DB_CARDS;
+    header->crc = crc32_sftwr(0, (const uint8_t *)recs, BENCH_DB_CARDS * sizeof(rfid_db_rec_t));
+    header->generation = 7;
+    rc522_sim_stats_reset();
+
+    //загрузка частями по 256 байт, как из канала связи
+    status = RFID_db_write_begin();
+    for (offset = 0; status == MI_OK && offset < sizeof(image); offset += len) {
+        len = MIN(256, sizeof(image) - offset);
+        status = RFID_db_write(offset, image + offset, len);
+    }
+    if (status == MI_OK)
+        status = RFID_db_write_end();
+    if (status == MI_OK && (RFID_db_count() != BENCH_DB_CARDS || RFID_db_generation() != 7))
+        status = MI_ERR;
+    bench_report("RFID_db_write", status);
+
+    for (uint16_t i = 0; i < BENCH_DB_CARDS; i++) {
+        card = bench_db_card(i);
+        if (RFID_db_lookup(&card, &attr) == MI_OK && attr == ((i % 10 == 0) ? RFID_DB_ATTR_BLOCKED : 1))
+            found++;
+    }
+    card = bench_db_card(BENCH_DB_CARDS);
+    status = (found == BENCH_DB_CARDS && RFID_db_lookup(&card, &attr) == MI_ERR) ? MI_OK : MI_ERR;
+    //тот же UID другой длины - другая карта
+    card = bench_db_card(2);
+    card.size = 7;
+    if (RFID_db_lookup(&card, &attr) == MI_OK)
+        status = MI_ERR;
+    bench_report("RFID_db_lookup", status);
+    printf("   found %u of %u\n", found, BENCH_DB_CARDS);
+
+    //прерванная загрузка: сектор без заголовка, база пуста, а не частична
+    status = RFID_db_write_begin();
+    if (status == MI_OK)
+        status = RFID_db_write(sizeof(rfid_db_header_t), recs, 64 * sizeof(rfid_db_rec_t));
+    RFID_db_init();
+    card = bench_db_card(0);
+    status = (status == MI_OK && RFID_db_count() == 0 && RFID_db_lookup(&card, &attr) == MI_ERR) ? MI_OK : MI_ERR;
+    bench_report("interrupted load", status);
+
+    //испорченная запись: CRC не сходится, RFID_db_write_end отказывает
+    recs[3].attr ^= 0x01;
+    status = RFID_db_write_begin();
+    for (offset = 0; status == MI_OK && offset < sizeof(image); offset += len) {
+        len = MIN(256, sizeof(image) - offset);
+        status = RFID_db_write(offset, image + offset, len);
+    }
+    status = (status == MI_OK && RFID_db_write_end() == MI_ERR && RFID_db_count() == 0) ? MI_OK : MI_ERR;
+    bench_report("bad CRC rejected", status);
+}
+
+static void bench_log_events(uint16_t n)
+{
+    rfid_uid_t card = {.size = 4, .bytes = {0x11, 0x22, 0x33, 0x00}};
+
+    for (uint16_t i = 0; i < n; i++) {
+        card.bytes[3] = i % 12;                 //повторы UID: ссылки на недавние в выгрузке
+        RFID_log_event(&card, (i % 3 == 0) ? RFID_LOG_DENIED : RFID_LOG_OPENED, RFID_LOG_SRC_DB, 0, 1500 + i);
+        RFID_log_task();
+        delay_ms(250);
+    }
+}
+
+static void bench_log(void)
+{
+    const rfid_log_stats_t *st = RFID_log_stats();
+    rfid_log_iter_t it;
+    rfid_log_rec_t rec;
+    uint32_t addr, first = 0, next = 0, count = 0;
+    uint32_t zero = 0;
+    uint8_t status;
+
+    printf("-- log\n");
+    rc522_sim_stats_reset();
+
+    //пустая flash: первый сектор стирается при запуске
+    RFID_log_init();
+    bench_log_events(20);
+    status = (RFID_log_flush() == MI_OK && st->erases == 1 && st->written == 20 && st->pending == 0) ? MI_OK : MI_ERR;
+    bench_report("RFID_log_event + flush", status);
+
+    //после перезапуска seq продолжается, boot растет, записи читаются по порядку
+    RFID_log_init();
+    status = (st->seq == 20 && st->boot == 1) ? MI_OK : MI_ERR;
+    RFID_log_rewind(&it);
+    while (RFID_log_next(&it, &rec) == MI_OK) {
+        if (rec.seq != count++ || rec.boot != 0)
+            status = MI_ERR;
+    }
+    bench_report("RFID_log_init (reboot)", (count == 20) ? status : MI_ERR);
+
+    //запись, оборванная сбросом: CRC не сходится, чтение ее пропускает
+    addr = RFID_LOG_ADDR + 6 * sizeof(rfid_log_rec_t) + offsetof(rfid_log_rec_t, latency_us);
+    flash_write(&addr, &zero, sizeof(zero));
+    status = MI_OK;
+    RFID_log_rewind(&it);
+    for (count = 0; RFID_log_next(&it, &rec) == MI_OK; count++) {
+        if (rec.seq == 5)
+            status = MI_ERR;
+    }
+    bench_report("torn record skipped", (count == 19 && st->torn == 1) ? status : MI_ERR);
+
+    //два сектора по кругу: самый старый стирается, в журнале остаются последние записи
+    bench_log_events(2 * RFID_LOG_SLOTS);
+    RFID_log_flush();
+    status = st->dropped ? MI_ERR : MI_OK;
+    RFID_log_rewind(&it);
+    for (count = 0; RFID_log_next(&it, &rec) == MI_OK; count++) {
+        if (count == 0)
+            first = rec.seq;
+        else if (rec.seq != next)
+            status = MI_ERR;
+        next = rec.seq + 1;
+    }
+    if (first == 0 || next != st->seq || count != next - first)
+        status = MI_ERR;
+    bench_report("sector rotation", status);
+    printf("   %u records, seq %u..%u, %u erases\n", (unsigned)count, (unsigned)first, (unsigned)(next - 1),
+           (unsigned)st->erases);
+}
+
+//приемник канала RFID_export: разбор передач журнала, сборка образа карты, файл трассировки
+static struct
+{
+    uint16_t chunks;
+    uint32_t records;
+    uint32_t first;                             // seq первой записи выгрузки
+    uint32_t next;                              // ожидаемый seq следующей
+    uint8_t last;                               // принята последняя передача или часть
+    uint8_t bad;                                // нарушен формат
+    uint16_t len;
+    uint8_t image[4 + UID_MAX_LEN + 256 * MAX_LEN + (RFID_IMAGE_MAX_SECTORS + 7) / 8 + 4];  // образ 4K
+    FILE *trace;
+} bench_rx;
+
+static const uint8_t *bench_rx_var(const uint8_t *p, uint32_t *v)
+{
+    *v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        *v |= (uint32_t)(*p & 0x7F) << shift;
+        if (!(*p++ & 0x80))
+            break;
+    }
+    return p;
+}
+
+/*!
+ * \brief Передача журнала: заголовок 16 байт и записи разностью (формат - RFID_export.h)
+ */
+static void bench_rx_log(const uint8_t *data, uint16_t len)
+{
+    const uint8_t *p = data + 16;
+    uint32_t seq = (data[8] | (data[9] << 8) | (data[10] << 16) | ((uint32_t)data[11] << 24)) - 1;
+    uint16_t count = data[4] | (data[5] << 8);
+    uint32_t v;
+
+    if (data[1] != RFID_EXPORT_VERSION)
+        bench_rx.bad = 1;
+    if (bench_rx.chunks++ == 0)
+        bench_rx.first = bench_rx.next = seq + 1;
+    for (uint16_t i = 0; i < count && p < data + len; i++) {
+        uint8_t head = *p++;
+
+        if (head & 0x01) {
+            p = bench_rx_var(p, &v);
+            seq += v;
+        }
+        if (++seq != bench_rx.next++)
+            bench_rx.bad = 1;
+        if (head & 0x02)
+            p = bench_rx_var(p, &v);            //boot
+        p = bench_rx_var(p, &v);                //time или разность
+        p = bench_rx_var(p, &v);                //latency_us
+        if (*p & 0x80)
+            p++;                                //ссылка на недавний UID
+        else
+            p += 1 + *p;
+        bench_rx.records++;
+    }
+    if (p != data + len)
+        bench_rx.bad = 1;
+    bench_rx.last = data[2] & 0x01;
+}
+
+static void bench_rx_part(const uint8_t *data, uint16_t len)
+{
+    switch (data[0]) {
+        case RFID_EXPORT_MAGIC:
+            bench_rx_log(data, len);
+            break;
+
+        case RFID_IMAGE_MAGIC:
+            if (bench_rx.len + len - 2 > sizeof(bench_rx.image)) {
+                bench_rx.bad = 1;
+                break;
+            }
+            memcpy(&bench_rx.image[bench_rx.len], data + 2, len - 2);
+            bench_rx.len += len - 2;
+            bench_rx.last = data[1] & 0x01;
+            break;
+
+        case RFID_TRACE_MAGIC:
+            if (bench_rx.trace)
+                fwrite(data + 2, 1, len - 2, bench_rx.trace);
+            bench_rx.last = data[1] & 0x01;
+            break;
+
+        default:
+            bench_rx.bad = 1;
+    }
+}
+
+static uint8_t bench_rx_done(void)
+{
+    return bench_rx.last;
+}
+
+static void bench_export_request(uint32_t since)
+{
+    memset(&bench_rx, 0, sizeof(bench_rx));
+    bench_peer.request[0] = RFID_EXPORT_CMD_LOG;
+    bench_peer.request[1] = since;
+    bench_peer.request[2] = since >> 8;
+    bench_peer.request[3] = since >> 16;
+    bench_peer.request[4] = since >> 24;
+    bench_peer.request_len = 5;
+}
+
+static void bench_export(void)
+{
+    uint32_t since = RFID_log_stats()->seq - 1000;
+    uint8_t status;
+
+    printf("-- log export\n");
+    rc522_sim_stats_reset();
+
+    //последние 1000 записей несколькими передачами, подряд без пропусков seq
+    bench_export_request(since);
+    status = bench_loop(bench_rx_done, 1000) ? MI_OK : MI_ERR;
+    if (status == MI_OK && (bench_rx.bad || bench_rx.records != 1000 || bench_rx.first != since ||
+                            bench_rx.next != RFID_log_stats()->seq || bench_rx.chunks < 2))
+        status = MI_ERR;
+    bench_report("export 'L'", status);
+    printf("   %u records in %u transfers\n", (unsigned)bench_rx.records, bench_rx.chunks);
+
+    //приемник пропал: выгрузка останавливается после первой передачи
+    bench_peer.lost = 1;
+    bench_export_request(since);
+    bench_loop(NULL, 100);
+    status = (bench_rx.chunks == 0 && RFID_export_sent() == MI_ERR) ? MI_OK : MI_ERR;
+    bench_peer.lost = 0;
+    bench_report("export, connection lost", status);
+}
+
+static uint8_t bench_image_done(void)
+{
+    return RFID_image_result() != MI_BUSY;
+}
+
+static void bench_image(const uint8_t *uid, uint8_t size)
+{
+    static const uint8_t key[KEY_LEN] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5};
+    static const uint8_t zero[64] = {0};
+    rfid_key_table_t table;
+    const uint8_t *img = bench_rx.image;
+    uint8_t *mem;
+    uint16_t len = 4 + size + 16 * 64 + (RFID_IMAGE_MAX_SECTORS + 7) / 8 + 4;
+    uint8_t status;
+    int card;
+
+    printf("-- card image\n");
+    rc522_sim_remove_cards();
+    card = rc522_sim_add_card(RC522_SIM_CLASSIC_1K, uid, size);
+    mem = rc522_sim_card_memory(card);
+    memcpy(&mem[15 * 16], key, KEY_LEN);        //ключ сектора 3 не из таблицы: сектор нулями
+    for (uint16_t b = 1; b < 64; b++) {
+        if ((b & 3) != 3)
+            memset(&mem[b * 16], b, 16);
+    }
+    RFID_key_table_init(&table);
+    memset(&bench_rx, 0, sizeof(bench_rx));
+    RFID_close();
+    rc522_sim_stats_reset();
+
+    status = RFID_image_read(&table);
+    if (status == MI_OK && bench_loop(bench_image_done, 2000))
+        status = RFID_image_result();
+    if (status == MI_OK &&
+        (bench_rx.bad || !bench_rx.last || bench_rx.len != len ||
+         img[0] != 'M' || img[1] != 'F' || img[2] != 16 || img[3] != size || memcmp(&img[4], uid, size) ||
+         memcmp(&img[4 + size], mem, 3 * 64) || memcmp(&img[4 + size + 3 * 64], zero, 64) ||
+         memcmp(&img[4 + size + 4 * 64], &mem[4 * 64], 12 * 64) ||
+         img[len - 9] != 0xF7 || img[len - 8] != 0xFF || img[len - 7] || img[len - 6] || img[len - 5] ||
+         crc32_sftwr(0, img, len - 4) != (img[len - 4] | (img[len - 3] << 8) | (img[len - 2] << 16) |
+                                           ((uint32_t)img[len - 1] << 24)) ||
+         table.sector_key[0] != 0 || table.sector_key[3] != RFID_IMAGE_KEY_UNKNOWN))
+        status = MI_ERR;
+    bench_report("RFID_image_read", status);
+    printf("   %u bytes, 15 of 16 sectors\n", bench_rx.len);
+}
+
+int main(void)
+{
+    static const uint8_t uid4[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+    static const uint8_t uid7[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+    static const uint8_t uid10[10] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99};
+    uint8_t status;
+
+    rc522_sim_reset();
+    if (bench_flash_init()) {
+        printf("flash: 0x%08X is not available\n", BENCH_FLASH_ADDR);
+        return 1;
+    }
+    sck_2 = -1;
+    RFID_init();
+    RFID_export_init(sck_2);
+    bench_peer.recv = bench_rx_part;
+    delay_ms(RFID_detect_policy()->burst_ms);   //MFRC522_Init включил поле: карте нужно время на запуск
+    bench_report("RFID_init", MI_OK);
+    status = (MFRC522_Check(rfid.reader->dev) == RC522_FAULT_NONE) ? MI_OK : MI_ERR;
+    bench_report("MFRC522_Check", status);
+    bench_anticoll_vectors();
+
+    bench_single("UID 4 bytes", uid4, sizeof(uid4));
+    bench_single("UID 7 bytes", uid7, sizeof(uid7));
+    bench_single("UID 10 bytes", uid10, sizeof(uid10));
+
+    bench_field(2);
+    bench_field(8);
+    bench_field(RC522_SIM_MAX_CARDS);
+
+    bench_value(uid4, sizeof(uid4));
+    bench_ntag("NTAG216", RC522_SIM_NTAG216, uid7);
+    bench_ntag("Ultralight", RC522_SIM_ULTRALIGHT, uid7);
+    bench_retry(uid7, sizeof(uid7));
+
+    rc522_sim_remove_cards();
+    status = RFID_getUID(rfid.uid);
+    bench_report("RFID_getUID (no card)", (status == MI_OK) ? MI_ERR : MI_OK);
+
+    //теневые копии регистров настройки должны совпадать с моделью
+    status = MFRC522_ShadowVerify(rfid.reader->dev) ? MI_ERR : MI_OK;
+    bench_report("MFRC522_ShadowVerify", status);
+
+    //границы ожидания ответа после обучения, мкс
+    printf("timeouts, us:");
+    for (int p = 0; p < RC522_TMO_COUNT; p++)
+        printf(" %u", MFRC522_Timeout(rfid.reader->dev, p) * 25);
+    printf("\n");
+
+    //задачи главного цикла
+    bench_async(uid7, sizeof(uid7));
+    bench_inventory(8);
+    bench_inventory(RC522_SIM_MAX_CARDS);
+    bench_presence(uid4, sizeof(uid4));
+    bench_detect(uid4, sizeof(uid4));
+    bench_image(uid4, sizeof(uid4));
+
+    //flash: база карт и журнал
+    bench_cache();
+    bench_db();
+    bench_log();
+    bench_export();
+
+#if RFID_TRACE
+    //последние обмены - в файл для Tools/trace2pcap
+    {
+        uint16_t records = RFID_trace_count();
+
+        memset(&bench_rx, 0, sizeof(bench_rx));
+        bench_rx.trace = fopen("rc522_trace.bin", "wb");
+        if (bench_rx.trace) {
+            RFID_trace_dump();
+            bench_loop(bench_rx_done, 1000);
+            fclose(bench_rx.trace);
+            printf("trace: %u records in rc522_trace.bin\n", records);
+        }
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,852 @@
+#include <string.h>
+#include "include.h"
+#include "rc522_sim.h"
+
+#define SIM_RF_BIT_NS               9440        // 1 / 106 кбит/с
+#define SIM_FDT_NS                  86000       // время ответа карты (FDT, n = 9)
+#define SIM_AUTH_NS                 900000      // 3 прохода MIFARE Classic
+#define SIM_EEPROM_NS               2500000     // запись блока в EEPROM карты
+#define SIM_POLL_NS                 100         // каждое чтение счетчика тактов двигает время
+#define SIM_NO_AUTH                 0xFF
+#define SIM_NO_WRITE                0xFFFF
+#define SIM_NTAG216_PWD             0xE5        // страница PWD, следом PACK
+#define SIM_UL(c)                   ((c)->type == RC522_SIM_ULTRALIGHT || (c)->type == RC522_SIM_NTAG216)
+
+typedef enum {
+    SIM_IDLE,
+    SIM_READY,
+    SIM_ACTIVE,
+    SIM_HALT
+} sim_state_t;
+
+typedef struct
+{
+    rc522_sim_card_type_t type;
+    uint8_t present;
+    uint8_t uid[UID_MAX_LEN];
+    uint8_t uid_size;
+    sim_state_t state;
+    uint8_t halted;                             // состояние до WUPA/REQA: IDLE или HALT
+    uint8_t level;                              // уровень каскада в READY
+    uint8_t auth_sector;
+    uint16_t write_block;                       // вторая фаза WRITE
+    uint8_t value_cmd;                          // вторая фаза INC/DEC/RESTORE, 0 - нет
+    uint16_t value_block;
+    uint8_t transfer;                           // внутренний регистр заполнен, ждет TRANSFER
+    uint8_t value_reg[16];                      // внутренний регистр: блок значения
+    uint8_t mem[4096];
+} sim_card_t;
+
+static uint8_t regs[64];
+static uint8_t fifo[MFRC522_FIFO_SIZE];
+static uint8_t fifo_len;
+static uint8_t irq_line;
+static uint64_t now_ns;
+static uint16_t tcounter;                       // TCounterValueReg: таймер останавливается по приему ответа
+static rc522_sim_stats_t stats;
+static sim_card_t cards[RC522_SIM_MAX_CARDS];
+static int card_count;
+
+static uint8_t sim_read(uint8_t addr);
+static void sim_write(uint8_t addr, uint8_t val);
+static void sim_command(uint8_t cmd);
+static void sim_transceive(void);
+static void sim_authent(void);
+static void sim_update_irq(void);
+static void sim_card_idle(sim_card_t *c);
+static int sim_card_rx(sim_card_t *c, const uint8_t *f, uint16_t bits, uint8_t *resp, uint16_t *resp_bits);
+
+/*!
+ * \brief Сброс модели: регистры в состояние после SoftReset, карты остаются
+ */
+void rc522_sim_reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[CommandReg] = 0x20;
+    regs[CommIEnReg] = 0x80;
+    regs[FIFOLevelReg] = 0x00;
+    regs[WaterLevelReg] = 0x08;
+    regs[ControlReg] = 0x10;
+    regs[CollReg] = 0x80;
+    regs[ModeReg] = 0x3F;
+    regs[TxControlReg] = 0x80;
+    regs[TxSelReg] = 0x10;
+    regs[RxSelReg] = 0x84;
+    regs[RxThresholdReg] = 0x84;
+    regs[DemodReg] = 0x4D;
+    regs[MifareReg] = 0x62;
+    regs[SerialSpeedReg] = 0xEB;
+    regs[CRCResultRegH] = 0xFF;
+    regs[CRCResultRegL] = 0xFF;
+    regs[ModWidthReg] = 0x26;
+    regs[RFCfgReg] = 0x48;
+    regs[GsNReg] = 0x88;
+    regs[CWGsPReg] = 0x20;
+    regs[ModGsPReg] = 0x20;
+    regs[VersionReg] = 0x92;
+    fifo_len = 0;
+    irq_line = 0;
+}
+
+/*!
+ * \brief Одна транзакция SPI (один цикл CS), формат datasheet 8.1.2
+ */
+void rc522_sim_xmit(const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+    uint8_t dummy[MFRC522_FIFO_SIZE + 1];
+
+    if (len == 0)
+        return;
+    if (rx == NULL)
+        rx = dummy;
+
+    stats.transactions++;
+    stats.bytes += len;
+    stats.spi_ns += RC522_SIM_CS_NS + (uint64_t)len * 8 * 1000000000u / RC522_SIM_SPI_HZ;
+    now_ns += RC522_SIM_CS_NS + (uint64_t)len * 8 * 1000000000u / RC522_SIM_SPI_HZ;
+
+    rx[0] = 0;
+    if (tx[0] & SPI_READ_SIGN) {
+        // каждый следующий байт - адрес, ответ на него приходит со следующим байтом
+        for (uint16_t i = 0; i + 1 < len; i++)
+            rx[i + 1] = (tx[i] & SPI_READ_SIGN) ? sim_read((tx[i] >> 1) & 0x3F) : 0;
+    } else {
+        for (uint16_t i = 1; i < len; i++) {
+            sim_write((tx[0] >> 1) & 0x3F, tx[i]);
+            rx[i] = 0;
+        }
+    }
+}
+
+uint32_t rc522_sim_cycles(void)
+{
+    now_ns += SIM_POLL_NS;
+    return (uint32_t)(now_ns * RC522_SIM_CPU_MHZ / 1000);
+}
+
+uint64_t rc522_sim_time_ns(void)
+{
+    return now_ns;
+}
+
+/*!
+ * \brief CollPos и CollPosNotValid (CollReg b5..b0) как после приема - для векторов разбора ответа
+ */
+void rc522_sim_set_coll(uint8_t coll)
+{
+    regs[CollReg] = (regs[CollReg] & 0x80) | (coll & 0x3F);
+}
+
+void rc522_sim_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+const rc522_sim_stats_t *rc522_sim_stats(void)
+{
+    return &stats;
+}
+
+/*!
+ * \brief Карта в поле: память заполнена как у новой карты (ключи 0xFF..FF, транспортные права)
+ * \return номер карты или -1
+ */
+int rc522_sim_add_card(rc522_sim_card_type_t type, const uint8_t *uid, uint8_t uid_size)
+{
+    static const uint8_t trailer[16] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+    sim_card_t *c;
+
+    if (card_count >= RC522_SIM_MAX_CARDS || (uid_size != 4 && uid_size != 7 && uid_size != 10))
+        return -1;
+
+    c = &cards[card_count];
+    memset(c, 0, sizeof(*c));
+    c->type = type;
+    c->present = 1;
+    memcpy(c->uid, uid, uid_size);
+    c->uid_size = uid_size;
+    c->state = SIM_IDLE;
+    c->auth_sector = SIM_NO_AUTH;
+    c->write_block = SIM_NO_WRITE;
+
+    if (SIM_UL(c)) {
+        memcpy(&c->mem[0], uid, 3);
+        c->mem[3] = PICC_CASCADE_TAG ^ uid[0] ^ uid[1] ^ uid[2];
+        memcpy(&c->mem[4], &uid[3], 4);
+        c->mem[8] = uid[3] ^ uid[4] ^ uid[5] ^ uid[6];
+        if (type == RC522_SIM_NTAG216)
+            memset(&c->mem[SIM_NTAG216_PWD * 4], 0xFF, 4);  // пароль по умолчанию, PACK 0000
+    } else {
+        for (uint16_t b = 0; b < 256; b++) {
+            uint8_t trailer_block = (b < 128) ? ((b & 3) == 3) : ((b & 15) == 15);
+            if (trailer_block && (type == RC522_SIM_CLASSIC_4K || b < 64))
+                memcpy(&c->mem[b * 16], trailer, 16);
+        }
+        memcpy(c->mem, uid, 4);
+        c->mem[4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+    }
+
+    return card_count++;
+}
+
+void rc522_sim_card_present(int card, uint8_t present)
+{
+    if (card < 0 || card >= card_count)
+        return;
+    cards[card].present = present;
+    if (!present) {
+        // без поля карта теряет состояние
+        cards[card].state = SIM_IDLE;
+        cards[card].auth_sector = SIM_NO_AUTH;
+        cards[card].write_block = SIM_NO_WRITE;
+        cards[card].value_cmd = 0;
+        cards[card].transfer = 0;
+    }
+}
+
+uint8_t *rc522_sim_card_memory(int card)
+{
+    return (card >= 0 && card < card_count) ? cards[card].mem : NULL;
+}
+
+void rc522_sim_remove_cards(void)
+{
+    card_count = 0;
+}
+
+//========================================================================================================
+
+static uint8_t sim_read(uint8_t addr)
+{
+    uint8_t val;
+
+    switch (addr) {
+        case FIFODataReg:
+            if (fifo_len == 0)
+                return 0;
+            val = fifo[0];
+            memmove(fifo, &fifo[1], --fifo_len);
+            return val;
+
+        case FIFOLevelReg:
+            return fifo_len;
+
+        case TCounterValueRegH:
+            return tcounter >> 8;
+
+        case TCounterValueRegL:
+            return tcounter & 0xFF;
+    }
+    return regs[addr];
+}
+
+static void sim_write(uint8_t addr, uint8_t val)
+{
+    switch (addr) {
+        case CommandReg:
+            regs[CommandReg] = (regs[CommandReg] & 0xCF) | (val & 0x30);     // RcvOff, PowerDown
+            sim_command(val & 0x0F);
+            break;
+
+        case CommIrqReg:
+        case DivIrqReg:
+            // Set1/Set2: 1 - установить отмеченные биты, 0 - сбросить
+            if (val & 0x80)
+                regs[addr] |= val & 0x7F;
+            else
+                regs[addr] &= ~val;
+            break;
+
+        case FIFODataReg:
+            if (fifo_len < sizeof(fifo))
+                fifo[fifo_len++] = val;
+            else
+                regs[ErrorReg] |= 0x10;         // BufferOvfl
+            break;
+
+        case FIFOLevelReg:
+            if (val & 0x80) {
+                fifo_len = 0;
+                regs[ErrorReg] &= ~0x10;
+            }
+            break;
+
+        case BitFramingReg:
+            regs[BitFramingReg] = val;
+            if ((val & 0x80) && (regs[CommandReg] & 0x0F) == PCD_TRANSCEIVE)
+                sim_transceive();
+            break;
+
+        case Status2Reg:
+            regs[Status2Reg] = (regs[Status2Reg] & ~0x08) | (val & 0x08);   // сбрасывается только MFCrypto1On
+            break;
+
+        case CollReg:
+            regs[CollReg] = (regs[CollReg] & 0x7F) | (val & 0x80);
+            break;
+
+        case TxControlReg:
+            regs[TxControlReg] = val;
+            if (!(val & 0x03)) {
+                // поле выключено - карты обесточены и после включения снова в IDLE
+                for (int i = 0; i < card_count; i++) {
+                    cards[i].halted = 0;
+                    sim_card_idle(&cards[i]);
+                }
+            }
+            break;
+
+        case ErrorReg:
+        case Status1Reg:
+        case VersionReg:
+            break;
+
+        default:
+            regs[addr] = val;
+            break;
+    }
+    sim_update_irq();
+}
+
+static void sim_command(uint8_t cmd)
+{
+    uint16_t crc;
+
+    regs[CommandReg] = (regs[CommandReg] & 0xF0) | cmd;
+
+    switch (cmd) {
+        case PCD_RESETPHASE:
+            rc522_sim_reset();
+            break;
+
+        case PCD_CALCCRC:
+            crc = crc_a(fifo, fifo_len);
+            regs[CRCResultRegL] = crc & 0xFF;
+            regs[CRCResultRegH] = crc >> 8;
+            now_ns += fifo_len * 600u;
+            regs[DivIrqReg] |= 0x04;            // CRCIRq
+            break;
+
+        case PCD_AUTHENT:
+            sim_authent();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static uint8_t sim_sector(uint8_t block)
+{
+    return (block < 128) ? block / 4 : 32 + (block - 128) / 16;
+}
+
+static uint16_t sim_trailer(uint8_t sector)
+{
+    return (sector < 32) ? sector * 4 + 3 : 128 + (sector - 32) * 16 + 15;
+}
+
+static uint32_t sim_tick_ns(void)
+{
+    uint32_t prescaler = ((regs[TModeReg] & 0x0F) << 8) | regs[TPrescalerReg];
+
+    return (2 * prescaler + 1) * 1000000u / 13560;         // 13,56 МГц / (2 * TPrescaler + 1)
+}
+
+static uint32_t sim_timer_ns(void)
+{
+    uint32_t reload = (regs[TReloadRegH] << 8) | regs[TReloadRegL];
+
+    return sim_tick_ns() * (reload + 1);
+}
+
+/*!
+ * \brief Ответ пришел через fdt после передачи: 1 - раньше таймера, счетчик остановлен
+ */
+static int sim_timer_stop(uint64_t fdt)
+{
+    uint32_t reload = (regs[TReloadRegH] << 8) | regs[TReloadRegL];
+
+    if (fdt >= sim_timer_ns())
+        return 0;
+    tcounter = reload - fdt / sim_tick_ns();
+    return 1;
+}
+
+static void sim_timeout(void)
+{
+    uint32_t t = sim_timer_ns();
+
+    stats.rf_ns += t;
+    now_ns += t;
+    regs[CommIrqReg] |= 0x01;                   // TimerIRq
+    tcounter = 0;
+}
+
+static sim_card_t *sim_active_card(void)
+{
+    for (int i = 0; i < card_count; i++)
+        if (cards[i].present && cards[i].state == SIM_ACTIVE)
+            return &cards[i];
+    return NULL;
+}
+
+/*!
+ * \brief MFAuthent: проверяется только исход (ключ сектора из трейлера, UID, состояние Crypto1)
+ */
+static void sim_authent(void)
+{
+    sim_card_t *c = sim_active_card();
+    uint8_t crypto = regs[Status2Reg] & 0x08;
+    uint8_t sector;
+    const uint8_t *trailer;
+    const uint8_t *key;
+
+    stats.frames++;
+    regs[ErrorReg] = 0;
+
+    if (fifo_len < 12 || c == NULL || c->type == RC522_SIM_ULTRALIGHT ||
+        (crypto && c->auth_sector == SIM_NO_AUTH) || (fifo[0] != PICC_AUTHENT1A && fifo[0] != PICC_AUTHENT1B)) {
+        sim_timeout();
+        if (c) {
+            c->state = SIM_IDLE;
+            c->auth_sector = SIM_NO_AUTH;
+        }
+        return;
+    }
+
+    sector = sim_sector(fifo[1]);
+    if (c->type == RC522_SIM_CLASSIC_1K && sector >= 16) {
+        sim_timeout();
+        return;
+    }
+    trailer = &c->mem[sim_trailer(sector) * 16];
+    key = (fifo[0] == PICC_AUTHENT1A) ? trailer : &trailer[10];
+
+    if (!sim_timer_stop(SIM_AUTH_NS)) {
+        sim_timeout();                          // таймер короче аутентификации
+        return;
+    }
+    stats.rf_ns += SIM_AUTH_NS;
+    now_ns += SIM_AUTH_NS;
+
+    if (memcmp(&fifo[2], key, KEY_LEN) || memcmp(&fifo[8], &c->uid[c->uid_size - 4], 4)) {
+        // неверный ключ: карта молчит и уходит в IDLE
+        c->state = SIM_IDLE;
+        c->auth_sector = SIM_NO_AUTH;
+        regs[Status2Reg] &= ~0x08;
+        sim_timeout();
+        return;
+    }
+
+    c->auth_sector = sector;
+    regs[Status2Reg] |= 0x08;
+    regs[CommandReg] &= 0xF0;
+    regs[CommIrqReg] |= 0x10;                   // IdleIRq
+}
+
+static uint64_t sim_air_ns(uint16_t bits)
+{
+    // бит четности на каждый байт, SOF и EOF
+    return (uint64_t)(bits + bits / 8 + 2) * SIM_RF_BIT_NS;
+}
+
+/*!
+ * \brief Transceive: кадр из FIFO всем картам в поле, ответы складываются по битам
+ */
+static void sim_transceive(void)
+{
+    uint8_t frame[MFRC522_FIFO_SIZE + 2];
+    uint8_t resp[MFRC522_FIFO_SIZE + 2];
+    uint8_t out[MFRC522_FIFO_SIZE + 2];
+    uint16_t resp_bits, out_bits = 0, tx_bits, len = fifo_len;
+    uint8_t tx_last = regs[BitFramingReg] & 0x07;
+    uint8_t rx_align = (regs[BitFramingReg] >> 4) & 0x07;
+    int coll = -1, responders = 0;
+    uint64_t tx_end;
+
+    stats.frames++;
+    memcpy(frame, fifo, len);
+    fifo_len = 0;
+    regs[ErrorReg] = 0;
+    regs[CollReg] |= 0x20;
+
+    if ((regs[TxModeReg] & 0x80) && tx_last == 0) {
+        crc_a_append(frame, len);
+        len += 2;
+    }
+    tx_bits = tx_last ? (len - 1) * 8 + tx_last : len * 8;
+    stats.rf_ns += sim_air_ns(tx_bits);
+    now_ns += sim_air_ns(tx_bits);
+    tx_end = now_ns;
+    regs[CommIrqReg] |= 0x40;                   // TxIRq
+
+    memset(out, 0, sizeof(out));
+    for (int i = 0; i < card_count; i++) {
+        if (!cards[i].present || !(regs[TxControlReg] & 0x03))
+            continue;
+        if (!sim_card_rx(&cards[i], frame, tx_bits, resp, &resp_bits))
+            continue;
+
+        if (responders == 0) {
+            memcpy(out, resp, (resp_bits + 7) / 8);
+            out_bits = resp_bits;
+        } else {
+            uint16_t common = (resp_bits < out_bits) ? resp_bits : out_bits;
+            for (uint16_t b = 0; b < common; b++) {
+                uint8_t x = (out[b / 8] ^ resp[b / 8]) & (1 << (b % 8));
+                if (x && (coll < 0 || b < coll))
+                    coll = b;
+                out[b / 8] |= resp[b / 8] & (1 << (b % 8));
+            }
+            if (resp_bits != out_bits && (coll < 0 || common < coll))
+                coll = common;
+            if (resp_bits > out_bits) {
+                memcpy(&out[out_bits / 8], &resp[out_bits / 8], (resp_bits + 7) / 8 - out_bits / 8);
+                out_bits = resp_bits;
+            }
+        }
+        responders++;
+    }
+
+    // таймер RC522 (TAuto) идет с конца передачи; запись EEPROM картой уже сдвинула время
+    if (responders == 0 || !sim_timer_stop(SIM_FDT_NS + now_ns - tx_end)) {
+        stats.rf_ns -= now_ns - tx_end;
+        now_ns = tx_end;
+        sim_timeout();
+        return;
+    }
+
+    stats.rf_ns += SIM_FDT_NS + sim_air_ns(out_bits);
+    now_ns += SIM_FDT_NS + sim_air_ns(out_bits);
+
+    if (coll >= 0) {
+        uint8_t pos = rx_align + coll + 1;     // CollPos считает и RxAlign позиций первого байта FIFO
+
+        regs[ErrorReg] |= 0x08;                 // CollErr
+        if (!(regs[CollReg] & 0x80)) {
+            // ValuesAfterColl = 0: биты после коллизии принимаются нулями
+            for (uint16_t b = coll + 1; b < out_bits; b++)
+                out[b / 8] &= ~(1 << (b % 8));
+        }
+        regs[CollReg] = (regs[CollReg] & 0x80) | ((pos <= 32) ? (pos & 0x1F) : 0x20);
+    } else if ((regs[RxModeReg] & 0x80) && out_bits >= 24 && !(out_bits % 8)) {
+        if (!crc_a_check(out, out_bits / 8))
+            regs[ErrorReg] |= 0x04;             // CRCErr
+        out_bits -= 16;
+    }
+
+    memset(fifo, 0, sizeof(fifo));
+    for (uint16_t b = 0; b < out_bits; b++) {
+        uint16_t p = rx_align + b;
+        if (out[b / 8] & (1 << (b % 8)))
+            fifo[p / 8] |= 1 << (p % 8);
+    }
+    fifo_len = (rx_align + out_bits + 7) / 8;
+    regs[ControlReg] = (regs[ControlReg] & 0xF8) | ((rx_align + out_bits) % 8);
+
+    regs[CommIrqReg] |= 0x20;                   // RxIRq
+    if (regs[ErrorReg])
+        regs[CommIrqReg] |= 0x02;               // ErrIRq
+}
+
+static void sim_update_irq(void)
+{
+    uint8_t active = (regs[CommIEnReg] & regs[CommIrqReg] & 0x7F) || (regs[DivlEnReg] & regs[DivIrqReg] & 0x14);
+
+    // EXTI1 настроен на спад: IRqInv дает ноль на линии при активном запросе
+    if (active && !irq_line)
+        EXTI1_IRQHandler();
+    irq_line = active;
+}
+
+//========================================================================================================
+
+static void sim_card_level_uid(const sim_card_t *c, uint8_t level, uint8_t *out)
+{
+    uint8_t levels = (c->uid_size == 4) ? 1 : (c->uid_size == 7) ? 2 : 3;
+    uint8_t off = 3 * level;
+
+    if (level + 1 < levels) {
+        out[0] = PICC_CASCADE_TAG;
+        memcpy(&out[1], &c->uid[off], 3);
+    } else {
+        memcpy(out, &c->uid[off], 4);
+    }
+    out[4] = out[0] ^ out[1] ^ out[2] ^ out[3];
+}
+
+static uint8_t sim_card_levels(const sim_card_t *c)
+{
+    return (c->uid_size == 4) ? 1 : (c->uid_size == 7) ? 2 : 3;
+}
+
+static void sim_card_idle(sim_card_t *c)
+{
+    c->state = c->halted ? SIM_HALT : SIM_IDLE;
+    c->auth_sector = SIM_NO_AUTH;
+    c->write_block = SIM_NO_WRITE;
+    c->value_cmd = 0;
+    c->transfer = 0;
+}
+
+static uint16_t sim_card_ack(uint8_t *resp, uint8_t ack)
+{
+    resp[0] = ack;
+    return 4;
+}
+
+/*!
+ * \brief Блок значения: value, ~value, value, addr, ~addr, addr, ~addr
+ */
+static int sim_value_valid(const uint8_t *b)
+{
+    for (int i = 0; i < 4; i++) {
+        if ((uint8_t)~b[4 + i] != b[i] || b[8 + i] != b[i])
+            return 0;
+    }
+    return (uint8_t)~b[13] == b[12] && b[14] == b[12] && (uint8_t)~b[15] == b[12];
+}
+
+static uint16_t sim_card_mem_size(const sim_card_t *c)
+{
+    switch (c->type) {
+        case RC522_SIM_CLASSIC_1K: return 1024;
+        case RC522_SIM_CLASSIC_4K: return 4096;
+        case RC522_SIM_NTAG216: return 231 * 4;
+        default: return 64;
+    }
+}
+
+/*!
+ * \brief Обработка кадра картой по ISO14443-3 и командам MIFARE
+ * \return 1 - карта ответила (resp, resp_bits), 0 - молчит
+ */
+static int sim_card_rx(sim_card_t *c, const uint8_t *f, uint16_t bits, uint8_t *resp, uint16_t *resp_bits)
+{
+    uint8_t crypto = regs[Status2Reg] & 0x08;
+    uint8_t level_uid[5];
+    uint16_t len = bits / 8;
+    uint16_t addr;
+
+    // Шифрование включено только с одной стороны - карта принимает мусор
+    if (!crypto != (c->auth_sector == SIM_NO_AUTH))
+        return 0;
+
+    if (bits == 7) {
+        if ((f[0] == PICC_REQIDL && c->state == SIM_IDLE) ||
+            (f[0] == PICC_REQALL && (c->state == SIM_IDLE || c->state == SIM_HALT))) {
+            uint8_t base = (c->type == RC522_SIM_CLASSIC_4K) ? 0x02 : 0x04;
+            c->halted = (c->state == SIM_HALT);
+            c->state = SIM_READY;
+            c->level = 0;
+            resp[0] = base | ((sim_card_levels(c) - 1) << 6);
+            resp[1] = 0x00;
+            *resp_bits = 16;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (c->state == SIM_READY && bits >= 16 && f[0] == PICC_SEL_CL1 + 2 * c->level) {
+        uint8_t nvb = f[1];
+        uint16_t known = ((nvb >> 4) - 2) * 8 + (nvb & 0x07);
+
+        sim_card_level_uid(c, c->level, level_uid);
+
+        if (nvb == 0x70) {
+            if (bits != 72 || !crc_a_check(f, 9))
+                return 0;
+            if (memcmp(&f[2], level_uid, 5)) {
+                sim_card_idle(c);               // выбрана другая карта
+                return 0;
+            }
+            if (c->level + 1 < sim_card_levels(c)) {
+                c->level++;
+                resp[0] = 0x04;
+            } else {
+                c->state = SIM_ACTIVE;
+                resp[0] = (c->type == RC522_SIM_CLASSIC_1K) ? 0x08 :
+                          (c->type == RC522_SIM_CLASSIC_4K) ? 0x18 : 0x00;
+            }
+            crc_a_append(resp, 1);
+            *resp_bits = 24;
+            return 1;
+        }
+
+        if (known != bits - 16 || known > 32)
+            return 0;
+        for (uint16_t b = 0; b < known; b++) {
+            if (((f[2 + b / 8] ^ level_uid[b / 8]) >> (b % 8)) & 1)
+                return 0;                       // известная часть UID не наша - молчим
+        }
+        memset(resp, 0, 6);
+        for (uint16_t b = known; b < 40; b++) {
+            if (level_uid[b / 8] & (1 << (b % 8)))
+                resp[(b - known) / 8] |= 1 << ((b - known) % 8);
+        }
+        *resp_bits = 40 - known;
+        return 1;
+    }
+
+    // в READY любая команда, кроме ANTICOLL/SELECT своего уровня, возвращает карту в IDLE или HALT
+    if (c->state == SIM_READY) {
+        sim_card_idle(c);
+        return 0;
+    }
+    if (c->state != SIM_ACTIVE)
+        return 0;
+
+    if ((bits % 8) || len < 3 || !crc_a_check(f, len))
+        return 0;
+
+    if (c->value_cmd) {
+        // операнд младшим байтом вперед; ответа карта не дает, ошибка - NAK
+        uint32_t v = c->value_reg[0] | (c->value_reg[1] << 8) | (c->value_reg[2] << 16) | ((uint32_t)c->value_reg[3] << 24);
+        uint32_t op = f[0] | (f[1] << 8) | (f[2] << 16) | ((uint32_t)f[3] << 24);
+        uint8_t cmd = c->value_cmd;
+
+        c->value_cmd = 0;
+        if (len != 6) {
+            sim_card_idle(c);
+            *resp_bits = sim_card_ack(resp, 0x04);
+            return 1;
+        }
+        if (cmd == PICC_INCREMENT)
+            v += op;
+        else if (cmd == PICC_DECREMENT)
+            v -= op;
+        for (int i = 0; i < 4; i++) {
+            c->value_reg[i] = c->value_reg[8 + i] = v >> (8 * i);
+            c->value_reg[4 + i] = ~c->value_reg[i];
+        }
+        c->transfer = 1;
+        return 0;
+    }
+
+    if (c->write_block != SIM_NO_WRITE) {
+        addr = c->write_block;
+        c->write_block = SIM_NO_WRITE;
+        if (len != 18)
+            return 0;
+        memcpy(&c->mem[addr], f, SIM_UL(c) ? 4 : 16);
+        stats.rf_ns += SIM_EEPROM_NS;
+        now_ns += SIM_EEPROM_NS;
+        *resp_bits = sim_card_ack(resp, 0x0A);
+        return 1;
+    }
+
+    switch (f[0]) {
+        case PICC_HALT:
+            c->state = SIM_HALT;
+            c->halted = 1;
+            c->auth_sector = SIM_NO_AUTH;
+            return 0;
+
+        case PICC_READ:
+            if (SIM_UL(c)) {
+                for (uint8_t i = 0; i < 16; i++)
+                    resp[i] = c->mem[(f[1] * 4 + i) % sim_card_mem_size(c)];
+            } else {
+                if (f[1] * 16 >= sim_card_mem_size(c) || c->auth_sector != sim_sector(f[1])) {
+                    sim_card_idle(c);
+                    *resp_bits = sim_card_ack(resp, 0x04);
+                    return 1;
+                }
+                memcpy(resp, &c->mem[f[1] * 16], 16);
+            }
+            crc_a_append(resp, 16);
+            *resp_bits = 18 * 8;
+            return 1;
+
+        case PICC_WRITE:
+            if (SIM_UL(c)) {
+                if (f[1] < 4 || f[1] * 4 >= sim_card_mem_size(c)) {
+                    *resp_bits = sim_card_ack(resp, 0x00);
+                    return 1;
+                }
+                c->write_block = f[1] * 4;
+            } else {
+                if (f[1] == 0 || f[1] * 16 >= sim_card_mem_size(c) || c->auth_sector != sim_sector(f[1])) {
+                    sim_card_idle(c);
+                    *resp_bits = sim_card_ack(resp, 0x04);
+                    return 1;
+                }
+                c->write_block = f[1] * 16;
+            }
+            *resp_bits = sim_card_ack(resp, 0x0A);
+            return 1;
+
+        case 0xA2:                              // WRITE Ultralight, одна страница
+            if (!SIM_UL(c) || len != 8 || f[1] < 4 || f[1] * 4 >= sim_card_mem_size(c)) {
+                *resp_bits = sim_card_ack(resp, 0x00);
+                return 1;
+            }
+            memcpy(&c->mem[f[1] * 4], &f[2], 4);
+            stats.rf_ns += SIM_EEPROM_NS;
+            now_ns += SIM_EEPROM_NS;
+            *resp_bits = sim_card_ack(resp, 0x0A);
+            return 1;
+
+        case PICC_INCREMENT:
+        case PICC_DECREMENT:
+        case PICC_RESTORE:
+            if (SIM_UL(c) || f[1] * 16 >= sim_card_mem_size(c) || c->auth_sector != sim_sector(f[1]) ||
+                !sim_value_valid(&c->mem[f[1] * 16])) {
+                sim_card_idle(c);
+                *resp_bits = sim_card_ack(resp, 0x04);
+                return 1;
+            }
+            memcpy(c->value_reg, &c->mem[f[1] * 16], 16);
+            c->value_cmd = f[0];
+            *resp_bits = sim_card_ack(resp, 0x0A);
+            return 1;
+
+        case PICC_TRANSFER:
+            if (SIM_UL(c) || !c->transfer || f[1] == 0 || f[1] * 16 >= sim_card_mem_size(c) ||
+                c->auth_sector != sim_sector(f[1])) {
+                sim_card_idle(c);
+                *resp_bits = sim_card_ack(resp, 0x04);
+                return 1;
+            }
+            memcpy(&c->mem[f[1] * 16], c->value_reg, 16);
+            c->transfer = 0;
+            stats.rf_ns += SIM_EEPROM_NS;
+            now_ns += SIM_EEPROM_NS;
+            *resp_bits = sim_card_ack(resp, 0x0A);
+            return 1;
+
+        case PICC_UL_GET_VERSION:
+            if (c->type != RC522_SIM_NTAG216 || len != 3)
+                break;
+            memcpy(resp, (const uint8_t[]){0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x13, 0x03}, 8);
+            crc_a_append(resp, 8);
+            *resp_bits = 10 * 8;
+            return 1;
+
+        case PICC_UL_FAST_READ:
+            // ответ больше FIFO RC522 модель не передает
+            if (c->type != RC522_SIM_NTAG216 || len != 5 || f[1] > f[2] || f[2] * 4 >= sim_card_mem_size(c) ||
+                (f[2] - f[1] + 1) * 4 + 2 > MFRC522_FIFO_SIZE)
+                break;
+            addr = (f[2] - f[1] + 1) * 4;
+            memcpy(resp, &c->mem[f[1] * 4], addr);
+            crc_a_append(resp, addr);
+            *resp_bits = (addr + 2) * 8;
+            return 1;
+
+        case PICC_UL_PWD_AUTH:
+            if (c->type != RC522_SIM_NTAG216 || len != 7 || memcmp(&f[1], &c->mem[SIM_NTAG216_PWD * 4], 4))
+                break;
+            memcpy(resp, &c->mem[(SIM_NTAG216_PWD + 1) * 4], 2);
+            crc_a_append(resp, 2);
+            *resp_bits = 4 * 8;
+            return 1;
+    }
+
+    sim_card_idle(c);
+    *resp_bits = sim_card_ack(resp, 0x04);
+    return 1;
+}
@@ -0,0 +1,51 @@
+#ifndef RC522_SIM_H_
+#define RC522_SIM_H_
+
+/*
+ * Модель MFRC522 для сборки драйвера на ПК (-DRC522_SIM)
+ *
+ * Подключается под Write_MFRC522/Read_MFRC522: rc522.c вместо SPI2 вызывает
+ * rc522_sim_xmit. Моделируются регистры, FIFO, таймер, сопроцессор CRC, команды
+ * Idle/SoftReset/CalcCRC/Transceive/MFAuthent, линия IRQ и карты в поле.
+ * Время - виртуальное: SPI по частоте шины, эфир по 106 кбит/с.
+ */
+
+#include <stdint.h>
+
+#define RC522_SIM_CPU_MHZ           72          // SYSCLK прошивки, для счетчика DWT
+#define RC522_SIM_SPI_HZ            2250000     // SPI2: APB1 36 МГц / 16
+#define RC522_SIM_CS_NS             500         // накладные расходы на транзакцию (CS, запуск)
+#define RC522_SIM_MAX_CARDS         32
+
+typedef enum {
+    RC522_SIM_CLASSIC_1K,
+    RC522_SIM_CLASSIC_4K,
+    RC522_SIM_ULTRALIGHT,
+    RC522_SIM_NTAG216                           // GET_VERSION, FAST_READ, PWD_AUTH, 231 страница
+} rc522_sim_card_type_t;
+
+typedef struct
+{
+    uint32_t transactions;                      // транзакций SPI (циклов CS)
+    uint32_t bytes;                             // байт по SPI
+    uint32_t frames;                            // кадров в эфире (команд Transceive/MFAuthent)
+    uint64_t spi_ns;                            // время шины SPI
+    uint64_t rf_ns;                             // время эфира и ожидания таймера RC522
+} rc522_sim_stats_t;
+
+void rc522_sim_reset(void);
+void rc522_sim_xmit(const uint8_t *tx, uint8_t *rx, uint16_t len);
+uint32_t rc522_sim_cycles(void);
+uint64_t rc522_sim_time_ns(void);
+
+int rc522_sim_add_card(rc522_sim_card_type_t type, const uint8_t *uid, uint8_t uid_size);
+void rc522_sim_card_present(int card, uint8_t present);
+uint8_t *rc522_sim_card_memory(int card);
+void rc522_sim_remove_cards(void);
+
+void rc522_sim_set_coll(uint8_t coll);
+
+void rc522_sim_stats_reset(void);
+const rc522_sim_stats_t *rc522_sim_stats(void);
+
+#endif /* RC522_SIM_H_ */
@@ -0,0 +1,190 @@
+/*
+ * Перевод выгрузки трассировки RC522 (RFID_trace_dump, формат - Core/Inc/RFID_trace.h) в pcap
+ *
+ *   trace2pcap [-r] trace.bin trace.pcap
+ *
+ * По умолчанию - LINKTYPE_ISO_14443: кадр к карте и ответ карты отдельными пакетами,
+ * Wireshark разбирает их как ISO14443. С -r каждая запись целиком (с ErrorReg, CollReg,
+ * статусом и длительностью) уходит пакетом LINKTYPE_USER0. Список обменов печатается всегда.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "crc32_software.h"
+
+#define TRACE_VERSION           1
+#define TRACE_DATA              18
+#define TRACE_HEADER            10
+#define TRACE_FIXED             16
+
+#define LINKTYPE_USER0          147
+#define LINKTYPE_ISO_14443      264
+#define ISO14443_PCD_TO_PICC    0xFF
+#define ISO14443_PICC_TO_PCD    0xFE
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(FILE *f, uint32_t v)
+{
+    fwrite(&v, 4, 1, f);                        // pcap пишется в порядке байт хоста
+}
+
+static void pcap_header(FILE *f, uint32_t linktype)
+{
+    put32(f, 0xA1B2C3D4);
+    put32(f, 0x00040002);                       // версия 2.4: младшие 16 бит - major
+    put32(f, 0);
+    put32(f, 0);
+    put32(f, 65535);
+    put32(f, linktype);
+}
+
+static void pcap_packet(FILE *f, uint64_t us, const uint8_t *data, uint32_t len)
+{
+    put32(f, (uint32_t)(us / 1000000));
+    put32(f, (uint32_t)(us % 1000000));
+    put32(f, len);
+    put32(f, len);
+    fwrite(data, 1, len, f);
+}
+
+static void iso14443_packet(FILE *f, uint64_t us, uint8_t event, const uint8_t *data, uint8_t len)
+{
+    uint8_t pkt[4 + TRACE_DATA];
+
+    pkt[0] = 0;
+    pkt[1] = event;
+    pkt[2] = 0;
+    pkt[3] = len;
+    memcpy(&pkt[4], data, len);
+    pcap_packet(f, us, pkt, 4 + len);
+}
+
+static const char *command_name(uint8_t command)
+{
+    switch (command) {
+        case 0x0C: return "Transceive";
+        case 0x0E: return "MFAuthent";
+        default: return "?";
+    }
+}
+
+static const char *status_name(uint8_t status)
+{
+    static const char *names[] = {"OK", "NOTAG", "ERR", "BUSY", "COLL"};
+    return (status < 5) ? names[status] : "?";
+}
+
+static void hex(const uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+        printf("%02X", data[i]);
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[1 << 20];
+    const char *in_name, *out_name;
+    uint64_t base = 0;
+    uint32_t prev = 0, count, lost, crc;
+    size_t size, pos;
+    uint8_t mhz;
+    int raw = 0;
+    FILE *in, *out;
+
+    if (argc > 1 && !strcmp(argv[1], "-r")) {
+        raw = 1;
+        argc--;
+        argv++;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "usage: trace2pcap [-r] trace.bin trace.pcap\n");
+        return 2;
+    }
+    in_name = argv[1];
+    out_name = argv[2];
+
+    in = fopen(in_name, "rb");
+    if (!in) {
+        perror(in_name);
+        return 1;
+    }
+    size = fread(buf, 1, sizeof(buf), in);
+    fclose(in);
+
+    if (size < TRACE_HEADER + 4 || buf[0] != 'R' || buf[1] != 'T' || buf[2] != TRACE_VERSION || buf[3] == 0) {
+        fprintf(stderr, "%s: not a trace dump\n", in_name);
+        return 1;
+    }
+    crc32sftwr_init();
+    crc = crc32_sftwr(0, buf, size - 4);
+    if (crc != get32(&buf[size - 4])) {
+        fprintf(stderr, "%s: CRC32 mismatch\n", in_name);
+        return 1;
+    }
+
+    mhz = buf[3];
+    count = buf[4] | (buf[5] << 8);
+    lost = get32(&buf[6]);
+    printf("%u records, %u lost before dump, %u cycles/us\n", count, lost, mhz);
+
+    out = fopen(out_name, "wb");
+    if (!out) {
+        perror(out_name);
+        return 1;
+    }
+    pcap_header(out, raw ? LINKTYPE_USER0 : LINKTYPE_ISO_14443);
+
+    pos = TRACE_HEADER;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *rec = &buf[pos];
+        uint32_t start, cycles;
+        uint16_t rx_bits;
+        uint8_t tx_len, tx_n, rx_n;
+        uint64_t us;
+
+        if (pos + TRACE_FIXED > size - 4)
+            break;
+        start = get32(&rec[0]);
+        cycles = get32(&rec[4]);
+        rx_bits = rec[8] | (rec[9] << 8);
+        tx_len = rec[15];
+        tx_n = (tx_len < TRACE_DATA) ? tx_len : TRACE_DATA;
+        rx_n = ((rx_bits + 7) / 8 < TRACE_DATA) ? (rx_bits + 7) / 8 : TRACE_DATA;
+        if (pos + TRACE_FIXED + tx_n + rx_n > size - 4)
+            break;
+
+        // счетчик тактов 32-битный: переполнение - каждые 2^32 такта
+        if (i > 0 && start < prev)
+            base += 1ull << 32;
+        prev = start;
+        us = (base + start) / mhz;
+
+        if (raw) {
+            pcap_packet(out, us, rec, TRACE_FIXED + tx_n + rx_n);
+        } else {
+            iso14443_packet(out, us, ISO14443_PCD_TO_PICC, &rec[TRACE_FIXED], tx_n);
+            if (rx_n)
+                iso14443_packet(out, us + cycles / mhz, ISO14443_PICC_TO_PCD, &rec[TRACE_FIXED + tx_n], rx_n);
+        }
+
+        printf("%12.3f ms  r%u %-10s %-5s err %02X coll %02X %8.1f us  ",
+               us / 1000.0, rec[10], command_name(rec[11]), status_name(rec[12]), rec[13], rec[14],
+               (double)cycles / mhz);
+        hex(&rec[TRACE_FIXED], tx_n);
+        printf(" -> ");
+        hex(&rec[TRACE_FIXED + tx_n], rx_n);
+        if (rx_bits % 8)
+            printf(" (%u bits)", rx_bits);
+        printf("\n");
+
+        pos += TRACE_FIXED + tx_n + rx_n;
+    }
+
+    fclose(out);
+    return 0;
+}